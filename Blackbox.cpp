@@ -0,0 +1,256 @@
+#include <Arduino.h>
+
+#include "Blackbox.h"
+
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+#include <SPI.h>
+#endif
+
+// Largest frame: the type byte and every field at its longest varint
+const uint8_t MAX_FRAME = 1 + (BB_FIELDS * 5);
+
+// Field names with their units, in BlackboxField order
+static const char FIELD_NAMES[] PROGMEM =
+   "iteration,time_us,loop_us,"
+   "yaw_cmd_ddeg,pitch_cmd_ddeg,roll_cmd_ddeg,throttle_deg,arm_pct,"
+   "yaw_ddeg,pitch_ddeg,roll_ddeg,"
+   "yaw_rate_dps,pitch_rate_dps,roll_rate_dps,"
+   "yaw_pid_ddeg,pitch_pid_ddeg,roll_pid_ddeg,"
+   "motor1_deg,motor2_deg,motor3_deg,motor4_deg,"
+   "failsafe";
+
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+// W25Qxx commands
+const uint8_t FLASH_WRITE_ENABLE = 0x06;
+const uint8_t FLASH_READ_STATUS  = 0x05;
+const uint8_t FLASH_PAGE_PROGRAM = 0x02;
+const uint8_t FLASH_READ_DATA    = 0x03;
+const uint8_t FLASH_BUSY         = 0x01;  // status register 1, write in progress
+
+const uint16_t FLASH_PAGE = 256;
+
+// Bytes programmed per Service(), bounding the time it spends clocking SPI
+const uint16_t FLASH_CHUNK = 64;
+
+static const SPISettings FLASH_SPI(8000000, MSBFIRST, SPI_MODE0);
+
+// Starts a command with a 24 bit address
+static void FlashCommand(const uint8_t command, const unsigned long address)
+{
+   SPI.beginTransaction(FLASH_SPI);
+   digitalWrite(BLACKBOX_FLASH_CS_PIN, LOW);
+   SPI.transfer(command);
+   SPI.transfer((uint8_t)(address >> 16));
+   SPI.transfer((uint8_t)(address >> 8));
+   SPI.transfer((uint8_t)address);
+}
+
+static void FlashEnd()
+{
+   digitalWrite(BLACKBOX_FLASH_CS_PIN, HIGH);
+   SPI.endTransaction();
+}
+
+static bool FlashBusy()
+{
+   uint8_t status;
+
+   SPI.beginTransaction(FLASH_SPI);
+   digitalWrite(BLACKBOX_FLASH_CS_PIN, LOW);
+   SPI.transfer(FLASH_READ_STATUS);
+   status = SPI.transfer(0);
+   FlashEnd();
+   return (status & FLASH_BUSY) != 0;
+}
+
+// True if every byte of the page is erased
+static bool FlashPageErased(const unsigned long page)
+{
+   bool erased = true;
+
+   FlashCommand(FLASH_READ_DATA, page * FLASH_PAGE);
+   for (uint16_t i = 0; i < FLASH_PAGE; i++)
+   {
+      erased = (SPI.transfer(0) == 0xFF) && erased;
+   }
+   FlashEnd();
+   return erased;
+}
+#endif
+
+Blackbox::Blackbox() :
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+   mFlashAddress(0),
+   mQueue(mBuffer, BLACKBOX_RING_SIZE),
+#endif
+   mSinceKey(0),
+   mNeedKey(true)
+{
+   memset(mLast, 0, sizeof(mLast));
+   memset(&mStatus, 0, sizeof(mStatus));
+}
+
+void Blackbox::Begin()
+{
+   uint8_t c;
+   uint16_t i = 0;
+
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+   pinMode(BLACKBOX_FLASH_CS_PIN, OUTPUT);
+   digitalWrite(BLACKBOX_FLASH_CS_PIN, HIGH);
+   SPI.begin();
+   FlashFindEnd();
+#else
+   serialTx.begin(BLACKBOX_BAUD);
+#endif
+
+   // the queue is empty and far larger than the header
+   Put((const uint8_t *)BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC));
+   c = BB_FIELDS;
+   Put(&c, 1);
+   do
+   {
+      c = pgm_read_byte(&FIELD_NAMES[i++]);
+      Put(&c, 1);
+   } while (c != '\0');
+   mNeedKey = true;
+}
+
+void Blackbox::Log(const int32_t fields[BB_FIELDS])
+{
+   uint8_t frame[MAX_FRAME];
+   uint8_t length = 1;
+   const bool key = mNeedKey || (mSinceKey >= BLACKBOX_KEYFRAME_INTERVAL);
+
+   frame[0] = key ? BLACKBOX_KEYFRAME : BLACKBOX_DELTA;
+   for (uint8_t i = 0; i < BB_FIELDS; i++)
+   {
+      // unsigned, so a wrapping field gives a small delta rather than overflow
+      const int32_t value = key ? fields[i] : (int32_t)((uint32_t)fields[i] - (uint32_t)mLast[i]);
+      length += PutVarint(&frame[length], value);
+   }
+
+   if (!Put(frame, length))
+   {
+      // the next frame cannot be a delta from one the decoder never sees
+      mStatus.dropped++;
+      mNeedKey = true;
+      return;
+   }
+   memcpy(mLast, fields, sizeof(mLast));
+
+   mNeedKey = false;
+   mSinceKey = key ? 1 : (mSinceKey + 1);
+   mStatus.frames++;
+   if (key)
+   {
+      mStatus.keyframes++;
+   }
+}
+
+void Blackbox::Service()
+{
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+   FlashService();
+   mStatus.peakUsed = mQueue.GetPeak();
+#else
+   const SerialTxStatus tx = serialTx.GetStatus();
+
+   mStatus.bytes = tx.bytes;
+   mStatus.peakUsed = tx.peakUsed;
+#endif
+}
+
+bool Blackbox::Put(const uint8_t *data, const uint16_t length)
+{
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+   return mQueue.Push(data, length);
+#else
+   return serialTx.write(data, length) == length;
+#endif
+}
+
+uint8_t Blackbox::PutVarint(uint8_t *out, const int32_t value)
+{
+   // zig-zag: 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+   uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+   uint8_t length = 0;
+
+   while (zigzag >= 0x80)
+   {
+      out[length++] = (uint8_t)zigzag | 0x80;
+      zigzag >>= 7;
+   }
+   out[length++] = (uint8_t)zigzag;
+   return length;
+}
+
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+void Blackbox::FlashFindEnd()
+{
+   // logs are appended from the start of an erased chip, so written pages
+   // come first; a partly written last page is left as is and its erased
+   // tail skipped by the decoder
+   unsigned long low = 0;
+   unsigned long high = BLACKBOX_FLASH_BYTES / FLASH_PAGE;
+
+   while (low < high)
+   {
+      const unsigned long mid = low + ((high - low) / 2);
+
+      if (FlashPageErased(mid))
+      {
+         high = mid;
+      }
+      else
+      {
+         low = mid + 1;
+      }
+   }
+   mFlashAddress = low * FLASH_PAGE;
+}
+
+void Blackbox::FlashService()
+{
+   const uint8_t *data;
+   const uint16_t run = mQueue.Peek(data);
+   uint16_t length = FLASH_PAGE - (uint16_t)(mFlashAddress % FLASH_PAGE);
+
+   // once full the queue backs up and frames are counted as dropped
+   if ((run == 0) || (mFlashAddress >= BLACKBOX_FLASH_BYTES))
+   {
+      return;
+   }
+
+   // each program occupies the chip for up to a few hundred microseconds
+   // whatever its length, so wait for a full chunk (or the end of the page)
+   if (length > FLASH_CHUNK)
+   {
+      length = FLASH_CHUNK;
+   }
+   if ((mQueue.Used() < length) || FlashBusy())
+   {
+      return;
+   }
+   if (length > run)
+   {
+      length = run;
+   }
+
+   SPI.beginTransaction(FLASH_SPI);
+   digitalWrite(BLACKBOX_FLASH_CS_PIN, LOW);
+   SPI.transfer(FLASH_WRITE_ENABLE);
+   FlashEnd();
+
+   FlashCommand(FLASH_PAGE_PROGRAM, mFlashAddress);
+   for (uint16_t i = 0; i < length; i++)
+   {
+      SPI.transfer(data[i]);
+   }
+   FlashEnd();
+
+   mQueue.Pop(length);
+   mFlashAddress += length;
+   mStatus.bytes += length;
+}
+#endif
@@ -0,0 +1,147 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <Arduino.h>
+
+#include "SerialTx.h"
+#include "TxQueue.h"
+
+// Set to 1 to log every control pass in compact binary (see Blackbox below)
+#ifndef BLACKBOX
+#define BLACKBOX 1
+#endif
+
+// Where the log drains to
+#define BLACKBOX_SINK_SERIAL  0  // serialTx (USART2), as fast as BLACKBOX_BAUD allows
+#define BLACKBOX_SINK_FLASH   1  // SPI NOR flash (W25Qxx) on BLACKBOX_FLASH_CS_PIN
+
+#ifndef BLACKBOX_SINK
+#define BLACKBOX_SINK BLACKBOX_SINK_SERIAL
+#endif
+
+const unsigned long BLACKBOX_BAUD = 1000000;
+
+const uint8_t BLACKBOX_FLASH_CS_PIN = 53;          // SPI SS on the Mega
+const unsigned long BLACKBOX_FLASH_BYTES = 4194304; // W25Q32, 4 MB
+
+// Bytes buffered between encoding and the flash (power of 2); the serial sink
+// queues in serialTx's ring
+const uint16_t BLACKBOX_RING_SIZE = 1024;
+
+// Frames between keyframes
+const uint8_t BLACKBOX_KEYFRAME_INTERVAL = 32;
+
+// Logged fields, in frame order. Angles are in tenths of a degree, rates in
+// degrees/second, motors in servo degrees.
+enum BlackboxField
+{
+   BB_ITERATION = 0,    // pass count, so dropped frames show as a gap
+   BB_TIME_US,          // pass start, wraps with micros()
+   BB_LOOP_US,          // time since the previous pass started
+   BB_YAW_CMD,
+   BB_PITCH_CMD,
+   BB_ROLL_CMD,
+   BB_THROTTLE,
+   BB_ARM,
+   BB_YAW,
+   BB_PITCH,
+   BB_ROLL,
+   BB_YAW_RATE,
+   BB_PITCH_RATE,
+   BB_ROLL_RATE,
+   BB_YAW_PID,
+   BB_PITCH_PID,
+   BB_ROLL_PID,
+   BB_MOTOR_1,
+   BB_MOTOR_2,
+   BB_MOTOR_3,
+   BB_MOTOR_4,
+   BB_FAILSAFE,         // receiver FailsafeState
+   BB_FIELDS
+};
+
+// Stream header magic
+const char BLACKBOX_MAGIC[4] = { 'Q', 'B', 'B', '1' };
+
+// Frame type bytes
+const uint8_t BLACKBOX_KEYFRAME = 'K';
+const uint8_t BLACKBOX_DELTA    = 'D';
+
+// Logging health
+typedef struct
+{
+   unsigned long frames;      // frames queued
+   unsigned long keyframes;   // of which keyframes
+   unsigned long dropped;     // frames lost to a full queue
+   unsigned long bytes;       // bytes sent
+   uint16_t peakUsed;         // highest queue use seen (bytes)
+} BlackboxStatus;
+
+/*
+ * Per pass flight recorder.
+ *
+ * Log() encodes a frame of BB_FIELDS 32 bit signed values into a TxQueue that
+ * the serial port's interrupt drains (serialTx), or that Service() hands to
+ * the flash as it can take it, so neither ever blocks the control loop. The
+ * stream opens with a header naming the fields:
+ *   "QBB1", field count, comma separated names, '\0'
+ * followed by frames:
+ *   keyframe  'K', each field as a zig-zag varint
+ *   delta     'D', each field's change since the last frame as a zig-zag varint
+ *             (32 bit wrapping, so counters such as time_us may roll over)
+ * Varints are little endian base 128 (7 bits per byte, high bit set on all
+ * but the last), so small changes take one byte. Every
+ * BLACKBOX_KEYFRAME_INTERVAL frames, and after a frame is dropped for lack of
+ * room, a keyframe restarts the chain so a decoder can start there.
+ */
+class Blackbox
+{
+ public:
+   Blackbox();
+
+   /*
+    * Opens the sink and queues the header.
+    */
+   void Begin();
+
+   /*
+    * Queues one frame; dropped (and counted) if the queue has no room.
+    */
+   void Log(const int32_t fields[BB_FIELDS]);
+
+   /*
+    * Moves buffered bytes to the flash, as many as it takes without waiting,
+    * and updates the status.
+    */
+   void Service();
+
+   inline const BlackboxStatus &GetStatus() const { return mStatus; }
+
+ private:
+   // Appends value to out as a zig-zag varint, returns the bytes written
+   static uint8_t PutVarint(uint8_t *out, const int32_t value);
+
+   // Queues length bytes for the sink if they all fit
+   bool Put(const uint8_t *data, const uint16_t length);
+
+#if (BLACKBOX_SINK == BLACKBOX_SINK_FLASH)
+   // Finds the first erased page to append to
+   void FlashFindEnd();
+
+   // Programs up to a page from the queue if the flash is idle
+   void FlashService();
+
+   unsigned long mFlashAddress;  // next byte to program
+
+   uint8_t mBuffer[BLACKBOX_RING_SIZE];
+   TxQueue mQueue;
+#endif
+
+   int32_t mLast[BB_FIELDS];     // fields of the last queued frame
+   uint8_t mSinceKey;            // frames since the last keyframe
+   bool mNeedKey;                // the chain was broken (or not started)
+
+   BlackboxStatus mStatus;
+};
+
+#endif /* BLACKBOX_H */
@@ -0,0 +1,86 @@
+#ifndef DMPSTREAM_H
+#define DMPSTREAM_H
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#elif !defined(pgm_read_byte)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
+
+// Run length coding of the DMP firmware image (see host/dmp_compress).
+// Each token byte is followed by its payload:
+//   0x00-0x7F  literal run, (token + 1) bytes follow
+//   0x80-0xBF  zero run of (token & 0x3F) + 1 bytes, no payload
+//   0xC0-0xFF  repeat run of (token & 0x3F) + 3 copies of the next byte
+const uint8_t DMP_RLE_LITERAL   = 0x00;
+const uint8_t DMP_RLE_ZEROS     = 0x80;
+const uint8_t DMP_RLE_REPEAT    = 0xC0;
+const uint8_t DMP_RLE_COUNT     = 0x3F;
+const uint8_t DMP_RLE_LITERAL_MAX = 128;
+const uint8_t DMP_RLE_ZEROS_MAX   = DMP_RLE_COUNT + 1;
+const uint8_t DMP_RLE_REPEAT_MIN  = 3;
+const uint8_t DMP_RLE_REPEAT_MAX  = DMP_RLE_COUNT + DMP_RLE_REPEAT_MIN;
+
+// Streams the decoded image one byte at a time straight from PROGMEM, so
+// upload needs no buffer beyond the chunk being written.
+class DmpRleStream
+{
+ public:
+   DmpRleStream(const uint8_t *packed) :
+      mNext(packed),
+      mCount(0),
+      mToken(0),
+      mValue(0)
+   {
+   }
+
+   /*
+    * Returns the next decoded byte. Reading past the end of the image is
+    * undefined; callers know the decoded size.
+    */
+   uint8_t Read()
+   {
+      if (mCount == 0)
+      {
+         mToken = pgm_read_byte(mNext++);
+         if (mToken < DMP_RLE_ZEROS)
+         {
+            mCount = mToken + 1;
+         }
+         else if (mToken < DMP_RLE_REPEAT)
+         {
+            mCount = (mToken & DMP_RLE_COUNT) + 1;
+            mValue = 0;
+         }
+         else
+         {
+            mCount = (mToken & DMP_RLE_COUNT) + DMP_RLE_REPEAT_MIN;
+            mValue = pgm_read_byte(mNext++);
+         }
+      }
+
+      mCount--;
+      return (mToken < DMP_RLE_ZEROS) ? pgm_read_byte(mNext++) : mValue;
+   }
+
+   /*
+    * Discards the next count decoded bytes.
+    */
+   void Skip(uint16_t count)
+   {
+      while (count-- > 0)
+      {
+         Read();
+      }
+   }
+
+ private:
+   const uint8_t *mNext;   // next packed byte
+   uint8_t mCount;         // decoded bytes left in the current run
+   uint8_t mToken;         // current run token
+   uint8_t mValue;         // value of the current zero or repeat run
+};
+
+#endif /* DMPSTREAM_H */
@@ -215,7 +215,11 @@ int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8
     #endif
 
     int8_t count = 0;
+    I2CdevError error = I2CDEV_OK;
     uint32_t t1 = millis();
+    #if I2CDEV_PROFILE == 1
+        uint32_t us = micros();
+    #endif
 
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE)
 
@@ -299,12 +303,31 @@ int8_t I2Cdev::readBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8
             count = length; // success
         } else {
             count = -1; // error
+            error = fastwireError(status);
         }
 
+    #elif (I2CDEV_IMPLEMENTATION == I2CDEV_HOST)
+
+        error = (hostBus != 0) ? hostBus->read(devAddr, regAddr, data, length) : I2CDEV_ERR_ADDR_NACK;
+        count = (error == I2CDEV_OK) ? length : -1;
+
     #endif
 
     // check for timeout
-    if (timeout > 0 && millis() - t1 >= timeout && count < length) count = -1; // timeout
+    if (timeout > 0 && millis() - t1 >= timeout && count < length) {
+        count = -1; // timeout
+        error = I2CDEV_ERR_TIMEOUT;
+    }
+    if (count != length && error == I2CDEV_OK) error = I2CDEV_ERR_BUS; // short read
+    lastError = error;
+
+    #if I2CDEV_PROFILE == 1
+        profileRecord(devAddr, regAddr, 0, length, micros() - us);
+    #endif
+
+    #if I2CDEV_SHADOW_CACHE == 1
+        if (count == length) shadowStore(devAddr, regAddr, length, data);
+    #endif
 
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print(". Done (");
@@ -335,6 +358,7 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
     #endif
 
     int8_t count = 0;
+    I2CdevError error = I2CDEV_OK;
     uint32_t t1 = millis();
 
     #if (I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE)
@@ -452,11 +476,30 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
             }
         } else {
             count = -1; // error
+            error = fastwireError(status);
+        }
+
+    #elif (I2CDEV_IMPLEMENTATION == I2CDEV_HOST)
+
+        uint8_t bytes[2 * length];
+        error = (hostBus != 0) ? hostBus->read(devAddr, regAddr, bytes, 2 * length) : I2CDEV_ERR_ADDR_NACK;
+        if (error == I2CDEV_OK) {
+            count = length;
+            for (uint8_t i = 0; i < length; i++) {
+                data[i] = (bytes[2 * i] << 8) | bytes[2 * i + 1];
+            }
+        } else {
+            count = -1;
         }
 
     #endif
 
-    if (timeout > 0 && millis() - t1 >= timeout && count < length) count = -1; // timeout
+    if (timeout > 0 && millis() - t1 >= timeout && count < length) {
+        count = -1; // timeout
+        error = I2CDEV_ERR_TIMEOUT;
+    }
+    if (count != length && error == I2CDEV_OK) error = I2CDEV_ERR_BUS; // short read
+    lastError = error;
 
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.print(". Done (");
@@ -476,6 +519,9 @@ int8_t I2Cdev::readWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint1
  */
 bool I2Cdev::writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data) {
     uint8_t b;
+    #if I2CDEV_SHADOW_CACHE == 1
+        if (!shadowRead(devAddr, regAddr, &b))
+    #endif
     readByte(devAddr, regAddr, &b);
     b = (data != 0) ? (b | (1 << bitNum)) : (b & ~(1 << bitNum));
     return writeByte(devAddr, regAddr, b);
@@ -512,7 +558,11 @@ bool I2Cdev::writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8
     // 10100011 original & ~mask
     // 10101011 masked | value
     uint8_t b;
-    if (readByte(devAddr, regAddr, &b) != 0) {
+    bool known = false;
+    #if I2CDEV_SHADOW_CACHE == 1
+        known = shadowRead(devAddr, regAddr, &b);
+    #endif
+    if (known || readByte(devAddr, regAddr, &b) != 0) {
         uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
         data <<= (bitStart - length + 1); // shift data into correct position
         data &= mask; // zero all non-important bits in data
@@ -591,6 +641,9 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
         Serial.print("...");
     #endif
     uint8_t status = 0;
+    #if I2CDEV_PROFILE == 1
+        uint32_t us = micros();
+    #endif
     #if ((I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE && ARDUINO < 100) || I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_NBWIRE)
         Wire.beginTransmission(devAddr);
         Wire.send((uint8_t) regAddr); // send address
@@ -598,8 +651,11 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
         Wire.beginTransmission(devAddr);
         Wire.write((uint8_t) regAddr); // send address
     #elif (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
-        Fastwire::beginTransmission(devAddr);
-        Fastwire::write(regAddr);
+        // single transfer so a failure at any step is reported
+        status = Fastwire::writeBuf(devAddr << 1, regAddr, data, length);
+    #elif (I2CDEV_IMPLEMENTATION == I2CDEV_HOST)
+        lastError = (hostBus != 0) ? hostBus->write(devAddr, regAddr, data, length) : I2CDEV_ERR_ADDR_NACK;
+        status = (lastError == I2CDEV_OK) ? 0 : 1;
     #endif
     for (uint8_t i = 0; i < length; i++) {
         #ifdef I2CDEV_SERIAL_DEBUG
@@ -610,8 +666,6 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
             Wire.send((uint8_t) data[i]);
         #elif (I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE && ARDUINO >= 100)
             Wire.write((uint8_t) data[i]);
-        #elif (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
-            Fastwire::write((uint8_t) data[i]);
         #endif
     }
     #if ((I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE && ARDUINO < 100) || I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_NBWIRE)
@@ -622,6 +676,21 @@ bool I2Cdev::writeBytes(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint8_
         Fastwire::stop();
         //status = Fastwire::endTransmission();
     #endif
+    #if (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
+        lastError = fastwireError(status);
+    #elif (I2CDEV_IMPLEMENTATION != I2CDEV_HOST)
+        lastError = (status == 0) ? I2CDEV_OK : I2CDEV_ERR_BUS;
+    #endif
+    #if I2CDEV_SHADOW_CACHE == 1
+        if (status == 0) {
+            shadowStore(devAddr, regAddr, length, data);
+        } else {
+            shadowDrop(devAddr, regAddr, length);
+        }
+    #endif
+    #if I2CDEV_PROFILE == 1
+        profileRecord(devAddr, regAddr, 1, length, micros() - us);
+    #endif
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.println(". Done.");
     #endif
@@ -655,6 +724,14 @@ bool I2Cdev::writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16
     #elif (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
         Fastwire::beginTransmission(devAddr);
         Fastwire::write(regAddr);
+    #elif (I2CDEV_IMPLEMENTATION == I2CDEV_HOST)
+        uint8_t bytes[2 * length];
+        for (uint8_t i = 0; i < length; i++) {
+            bytes[2 * i] = data[i] >> 8;        // MSB first
+            bytes[2 * i + 1] = data[i];
+        }
+        lastError = (hostBus != 0) ? hostBus->write(devAddr, regAddr, bytes, 2 * length) : I2CDEV_ERR_ADDR_NACK;
+        status = (lastError == I2CDEV_OK) ? 0 : 1;
     #endif
     for (uint8_t i = 0; i < length * 2; i++) {
         #ifdef I2CDEV_SERIAL_DEBUG
@@ -681,6 +758,12 @@ bool I2Cdev::writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16
         Fastwire::stop();
         //status = Fastwire::endTransmission();
     #endif
+    #if (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE)
+        // Fastwire::write() reports 1 for a stuck bus, 2 for a data NACK
+        lastError = (status == 0) ? I2CDEV_OK : ((status == 1) ? I2CDEV_ERR_TIMEOUT : I2CDEV_ERR_DATA_NACK);
+    #elif (I2CDEV_IMPLEMENTATION != I2CDEV_HOST)
+        lastError = (status == 0) ? I2CDEV_OK : I2CDEV_ERR_BUS;
+    #endif
     #ifdef I2CDEV_SERIAL_DEBUG
         Serial.println(". Done.");
     #endif
@@ -692,6 +775,244 @@ bool I2Cdev::writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16
  */
 uint16_t I2Cdev::readTimeout = I2CDEV_DEFAULT_READ_TIMEOUT;
 
+/** Outcome of the last read or write transfer.
+ * Callers that return register values (which cannot carry an error) leave
+ * the reason a read failed here.
+ */
+I2CdevError I2Cdev::lastError = I2CDEV_OK;
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_HOST
+/** Simulated bus used by the host build (see host/).
+ */
+I2CdevHostBus *I2Cdev::hostBus = 0;
+#endif
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+/** Map a Fastwire::readBuf()/writeBuf() status to a bus error.
+ * @param status Fastwire return value (0 = success)
+ * @return Matching error type
+ */
+I2CdevError I2Cdev::fastwireError(uint8_t status) {
+    switch (status) {
+        case 0:
+            return I2CDEV_OK;
+        case 1: case 3: case 5: case 7:                 // writeBuf step timed out
+        case 16: case 18: case 20: case 22: case 24: case 26: // readBuf step timed out
+            return I2CDEV_ERR_TIMEOUT;
+        case 2: case 17: case 23:
+            return I2CDEV_ERR_START;
+        case 4: case 19: case 25:
+            return I2CDEV_ERR_ADDR_NACK;
+        case 6: case 8: case 21:
+            return I2CDEV_ERR_DATA_NACK;
+        case 27:                                        // readBuf data byte got a bad TWI status
+        default:
+            return I2CDEV_ERR_BUS;
+    }
+}
+#endif
+
+#if I2CDEV_PROFILE == 1
+
+/** Transfers not accounted because every profile slot was taken.
+ */
+uint16_t I2Cdev::profileMissed = 0;
+
+I2CdevProfileEntry I2Cdev::profile[I2CDEV_PROFILE_SLOTS];
+uint8_t I2Cdev::profileEntries = 0;
+
+/** Clear the transaction profile, e.g. at the start of a measured section.
+ */
+void I2Cdev::profileReset() {
+    profileEntries = 0;
+    profileMissed = 0;
+}
+
+/** Access the transaction profile.
+ * @param entries Container for the number of valid entries
+ * @return First profile entry, in order of first use
+ */
+const I2CdevProfileEntry *I2Cdev::profileTable(uint8_t *entries) {
+    *entries = profileEntries;
+    return profile;
+}
+
+/** Print the transaction profile as CSV, one line per (device, register,
+ * direction): dev,reg,dir,count,bytes,total_us,max_us. Register and device
+ * addresses are hex.
+ */
+void I2Cdev::profileDump() {
+    uint32_t totalUs = 0;
+    uint32_t count = 0;
+
+    Serial.println(F("dev,reg,dir,count,bytes,total_us,max_us"));
+    for (uint8_t i = 0; i < profileEntries; i++) {
+        const I2CdevProfileEntry *e = &profile[i];
+        Serial.print(e->devAddr, HEX);
+        Serial.print(F(","));
+        Serial.print(e->regAddr, HEX);
+        Serial.print(e->write ? F(",W,") : F(",R,"));
+        Serial.print(e->count);
+        Serial.print(F(","));
+        Serial.print(e->bytes);
+        Serial.print(F(","));
+        Serial.print(e->totalUs);
+        Serial.print(F(","));
+        Serial.println(e->maxUs);
+        totalUs += e->totalUs;
+        count += e->count;
+    }
+    Serial.print(F("# transfers "));
+    Serial.print(count);
+    Serial.print(F(", "));
+    Serial.print(totalUs);
+    Serial.print(F(" us, missed "));
+    Serial.println(profileMissed);
+}
+
+void I2Cdev::profileRecord(uint8_t devAddr, uint8_t regAddr, uint8_t write, uint8_t length, uint32_t us) {
+    I2CdevProfileEntry *e = 0;
+    for (uint8_t i = 0; i < profileEntries; i++) {
+        if (profile[i].devAddr == devAddr && profile[i].regAddr == regAddr && profile[i].write == write) {
+            e = &profile[i];
+            break;
+        }
+    }
+    if (e == 0) {
+        if (profileEntries == I2CDEV_PROFILE_SLOTS) {
+            profileMissed++;
+            return;
+        }
+        e = &profile[profileEntries++];
+        memset(e, 0, sizeof(I2CdevProfileEntry));
+        e->devAddr = devAddr;
+        e->regAddr = regAddr;
+        e->write = write;
+    }
+    e->count++;
+    e->bytes += length;
+    e->totalUs += us;
+    if (us > e->maxUs) e->maxUs = (us > 0xFFFF) ? 0xFFFF : us;
+}
+
+#endif
+
+#if I2CDEV_SHADOW_CACHE == 1
+
+/** Number of register reads skipped because the shadow value was known.
+ */
+uint16_t I2Cdev::shadowHits = 0;
+
+I2CdevShadow I2Cdev::shadow[I2CDEV_SHADOW_DEVICES];
+
+/** Mark a range of configuration registers as safe to shadow.
+ * Only registers the device never changes on its own may be shadowed, since
+ * writeBit()/writeBits() use the shadow value instead of reading the register.
+ * Shadow values start out unknown and are filled in by the first read or write.
+ * Bits in selfClearMask are cleared by the device after a write (reset
+ * strobes) and are never kept in the shadow value.
+ * @param devAddr I2C slave device address
+ * @param regStart First register to shadow
+ * @param count Number of consecutive registers to shadow
+ * @param selfClearMask Bits that self-clear after being written
+ */
+void I2Cdev::shadowRegisters(uint8_t devAddr, uint8_t regStart, uint8_t count, uint8_t selfClearMask) {
+    I2CdevShadow *slot = shadowSlot(devAddr);
+    if (slot == 0) {
+        // claim a free slot for a new device
+        for (uint8_t i = 0; i < I2CDEV_SHADOW_DEVICES && slot == 0; i++) {
+            if (shadow[i].devAddr == 0) {
+                slot = &shadow[i];
+                memset(slot, 0, sizeof(I2CdevShadow));
+                slot->devAddr = devAddr;
+            }
+        }
+        if (slot == 0) return; // no room, device stays uncached
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t reg = regStart + i;
+        if (reg >= I2CDEV_SHADOW_REGISTERS) break;
+        slot->cacheable[reg >> 3] |= 1 << (reg & 7);
+        slot->valid[reg >> 3] &= ~(1 << (reg & 7));
+        if (selfClearMask != 0) {
+            for (uint8_t k = 0; k < I2CDEV_SHADOW_CLEAR_SLOTS; k++) {
+                if (slot->clearMask[k] == 0 || slot->clearReg[k] == reg) {
+                    slot->clearReg[k] = reg;
+                    slot->clearMask[k] = selfClearMask;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/** Forget every shadow value of a device (e.g. after a device reset).
+ * @param devAddr I2C slave device address
+ */
+void I2Cdev::invalidateShadow(uint8_t devAddr) {
+    I2CdevShadow *slot = shadowSlot(devAddr);
+    if (slot != 0) memset(slot->valid, 0, sizeof(slot->valid));
+}
+
+/** Forget the shadow value of one register.
+ * @param devAddr I2C slave device address
+ * @param regAddr Register address
+ */
+void I2Cdev::invalidateShadow(uint8_t devAddr, uint8_t regAddr) {
+    shadowDrop(devAddr, regAddr, 1);
+}
+
+I2CdevShadow *I2Cdev::shadowSlot(uint8_t devAddr) {
+    for (uint8_t i = 0; i < I2CDEV_SHADOW_DEVICES; i++) {
+        if (shadow[i].devAddr == devAddr) return &shadow[i];
+    }
+    return 0;
+}
+
+bool I2Cdev::shadowRead(uint8_t devAddr, uint8_t regAddr, uint8_t *data) {
+    I2CdevShadow *slot = shadowSlot(devAddr);
+    if (slot == 0 || regAddr >= I2CDEV_SHADOW_REGISTERS) return false;
+    if ((slot->valid[regAddr >> 3] & (1 << (regAddr & 7))) == 0) return false;
+    *data = slot->value[regAddr];
+    shadowHits++;
+    return true;
+}
+
+void I2Cdev::shadowStore(uint8_t devAddr, uint8_t regAddr, uint8_t length, const uint8_t *data) {
+    I2CdevShadow *slot = shadowSlot(devAddr);
+    if (slot == 0 || regAddr >= I2CDEV_SHADOW_REGISTERS) return;
+
+    // a burst that starts on an uncached register is a FIFO or memory port
+    // transfer, which does not advance through the following registers
+    if ((slot->cacheable[regAddr >> 3] & (1 << (regAddr & 7))) == 0) return;
+
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t reg = regAddr + i;
+        if (reg >= I2CDEV_SHADOW_REGISTERS) break;
+        uint8_t bit = 1 << (reg & 7);
+        if ((slot->cacheable[reg >> 3] & bit) == 0) continue;
+        uint8_t b = data[i];
+        for (uint8_t k = 0; k < I2CDEV_SHADOW_CLEAR_SLOTS; k++) {
+            if (slot->clearMask[k] != 0 && slot->clearReg[k] == reg) b &= ~slot->clearMask[k];
+        }
+        slot->value[reg] = b;
+        slot->valid[reg >> 3] |= bit;
+    }
+}
+
+void I2Cdev::shadowDrop(uint8_t devAddr, uint8_t regAddr, uint8_t length) {
+    I2CdevShadow *slot = shadowSlot(devAddr);
+    if (slot == 0) return;
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t reg = regAddr + i;
+        if (reg >= I2CDEV_SHADOW_REGISTERS) break;
+        slot->valid[reg >> 3] &= ~(1 << (reg & 7));
+    }
+}
+
+#endif
+
 #if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
     // I2C library
     //////////////////////
@@ -867,7 +1188,7 @@ uint16_t I2Cdev::readTimeout = I2CDEV_DEFAULT_READ_TIMEOUT;
                 TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWEA);
             if (!waitInt()) return 26;
             twst = TWSR & 0xF8;
-            if (twst != TW_MR_DATA_ACK && twst != TW_MR_DATA_NACK) return twst;
+            if (twst != TW_MR_DATA_ACK && twst != TW_MR_DATA_NACK) return 27;
             data[i] = TWDR;
             //Serial.print(data[i], HEX);
             //Serial.print(" ");
@@ -887,6 +1208,37 @@ uint16_t I2Cdev::readTimeout = I2CDEV_DEFAULT_READ_TIMEOUT;
         if (!waitInt()) return 1;
         return 0;
     }
+
+    // added for bus recovery:
+    // a slave reset part way through a read (e.g. by a brownout) can hold SDA
+    // low waiting for clocks that never come. Clock SCL by hand until it lets
+    // go (at most one byte plus ACK), then send a STOP. The TWI module must be
+    // off (reset()) and set up again afterwards.
+    // Returns true if both lines are released.
+    boolean Fastwire::clearBus() {
+        TWCR = 0; // hand the pins back to the port
+        pinMode(SDA, INPUT_PULLUP);
+        pinMode(SCL, INPUT_PULLUP);
+        delayMicroseconds(5);
+
+        for (byte i = 0; i < 9 && digitalRead(SDA) == LOW; i++) {
+            // open drain: drive low, release to the pull-up for high
+            digitalWrite(SCL, LOW);
+            pinMode(SCL, OUTPUT);
+            delayMicroseconds(5);
+            pinMode(SCL, INPUT_PULLUP);
+            delayMicroseconds(5);
+        }
+
+        // STOP: SDA rises while SCL is high
+        digitalWrite(SDA, LOW);
+        pinMode(SDA, OUTPUT);
+        delayMicroseconds(5);
+        pinMode(SDA, INPUT_PULLUP);
+        delayMicroseconds(5);
+
+        return digitalRead(SDA) == HIGH && digitalRead(SCL) == HIGH;
+    }
 #endif
 
 #if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_NBWIRE
@@ -50,7 +50,11 @@ THE SOFTWARE.
 // I2C interface implementation setting
 // -----------------------------------------------------------------------------
 //#define I2CDEV_IMPLEMENTATION       I2CDEV_ARDUINO_WIRE
-#define I2CDEV_IMPLEMENTATION       I2CDEV_BUILTIN_FASTWIRE
+#ifdef ARDUINO
+    #define I2CDEV_IMPLEMENTATION       I2CDEV_BUILTIN_FASTWIRE
+#else
+    #define I2CDEV_IMPLEMENTATION       I2CDEV_HOST
+#endif
 
 // comment this out if you are using a non-optimal IDE/implementation setting
 // but want the compiler to shut up about it
@@ -64,6 +68,7 @@ THE SOFTWARE.
                                       // ^^^ NBWire implementation is still buggy w/some interrupts!
 #define I2CDEV_BUILTIN_FASTWIRE     3 // FastWire object from Francesco Ferrara's project
 #define I2CDEV_I2CMASTER_LIBRARY    4 // I2C object from DSSCircuits I2C-Master Library at https://github.com/DSSCircuits/I2C-Master-Library
+#define I2CDEV_HOST                 5 // host (Linux) build, transfers go to an I2CdevHostBus (see host/)
 
 // -----------------------------------------------------------------------------
 // Arduino-style "Serial.print" debug constant (uncomment to enable)
@@ -82,11 +87,77 @@ THE SOFTWARE.
     #if I2CDEV_IMPLEMENTATION == I2CDEV_I2CMASTER_LIBRARY
         #include <I2C.h>
     #endif
+#elif I2CDEV_IMPLEMENTATION == I2CDEV_HOST
+    #include "Arduino.h" // host/shim
 #endif
 
 // 1000ms default read timeout (modify with "I2Cdev::readTimeout = [ms];")
 #define I2CDEV_DEFAULT_READ_TIMEOUT     1000
 
+// Bus error reported for the last transfer (see I2Cdev::lastError)
+typedef enum {
+    I2CDEV_OK = 0,              // transfer completed
+    I2CDEV_ERR_TIMEOUT,         // bus stuck, the interface never finished a step
+    I2CDEV_ERR_START,           // START not accepted (bus busy or arbitration lost)
+    I2CDEV_ERR_ADDR_NACK,       // device did not acknowledge its address
+    I2CDEV_ERR_DATA_NACK,       // device did not acknowledge a data byte
+    I2CDEV_ERR_BUS              // any other failure (short read, unexpected bus state)
+} I2CdevError;
+
+// -----------------------------------------------------------------------------
+// Shadow register cache (set to 0 to always read before read-modify-write)
+// -----------------------------------------------------------------------------
+#ifndef I2CDEV_SHADOW_CACHE
+    #define I2CDEV_SHADOW_CACHE         1
+#endif
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_HOST
+    // Device side of the host build. A simulated bus implements both calls
+    // and is installed with "I2Cdev::hostBus = &bus;".
+    class I2CdevHostBus {
+        public:
+            virtual ~I2CdevHostBus() {}
+            virtual I2CdevError read(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint8_t length) = 0;
+            virtual I2CdevError write(uint8_t devAddr, uint8_t regAddr, const uint8_t *data, uint8_t length) = 0;
+    };
+#endif
+
+// -----------------------------------------------------------------------------
+// Transaction profiler (set to 1 to account traffic per device and register)
+// -----------------------------------------------------------------------------
+#ifndef I2CDEV_PROFILE
+    #define I2CDEV_PROFILE              0
+#endif
+
+#if I2CDEV_PROFILE == 1
+    #define I2CDEV_PROFILE_SLOTS        32  // distinct (device, register, direction) entries
+
+    typedef struct {
+        uint8_t devAddr;
+        uint8_t regAddr;
+        uint8_t write;          // 1 = write transfer
+        uint16_t count;         // transfers
+        uint32_t bytes;         // payload bytes
+        uint32_t totalUs;       // time spent in readBytes()/writeBytes()
+        uint16_t maxUs;         // longest single transfer
+    } I2CdevProfileEntry;
+#endif
+
+#if I2CDEV_SHADOW_CACHE == 1
+    #define I2CDEV_SHADOW_DEVICES       1   // devices with a shadow slot
+    #define I2CDEV_SHADOW_REGISTERS     128 // registers 0x00-0x7F per device
+    #define I2CDEV_SHADOW_CLEAR_SLOTS   4   // registers with self-clearing bits
+
+    typedef struct {
+        uint8_t devAddr;                                    // 0 = slot unused
+        uint8_t value[I2CDEV_SHADOW_REGISTERS];
+        uint8_t cacheable[I2CDEV_SHADOW_REGISTERS / 8];     // bitmap
+        uint8_t valid[I2CDEV_SHADOW_REGISTERS / 8];         // bitmap
+        uint8_t clearReg[I2CDEV_SHADOW_CLEAR_SLOTS];
+        uint8_t clearMask[I2CDEV_SHADOW_CLEAR_SLOTS];
+    } I2CdevShadow;
+#endif
+
 class I2Cdev {
     public:
         I2Cdev();
@@ -110,6 +181,48 @@ class I2Cdev {
         static bool writeWords(uint8_t devAddr, uint8_t regAddr, uint8_t length, uint16_t *data);
 
         static uint16_t readTimeout;
+        static I2CdevError lastError;
+
+        #if I2CDEV_IMPLEMENTATION == I2CDEV_HOST
+            static I2CdevHostBus *hostBus;
+        #endif
+
+        #if I2CDEV_PROFILE == 1
+            static void profileReset();
+            static const I2CdevProfileEntry *profileTable(uint8_t *entries);
+            static void profileDump();
+
+            static uint16_t profileMissed;
+        #endif
+
+        #if I2CDEV_SHADOW_CACHE == 1
+            static void shadowRegisters(uint8_t devAddr, uint8_t regStart, uint8_t count, uint8_t selfClearMask=0);
+            static void invalidateShadow(uint8_t devAddr);
+            static void invalidateShadow(uint8_t devAddr, uint8_t regAddr);
+
+            static uint16_t shadowHits;
+        #endif
+
+    private:
+        #if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+            static I2CdevError fastwireError(uint8_t status);
+        #endif
+
+        #if I2CDEV_PROFILE == 1
+            static void profileRecord(uint8_t devAddr, uint8_t regAddr, uint8_t write, uint8_t length, uint32_t us);
+
+            static I2CdevProfileEntry profile[I2CDEV_PROFILE_SLOTS];
+            static uint8_t profileEntries;
+        #endif
+
+        #if I2CDEV_SHADOW_CACHE == 1
+            static I2CdevShadow *shadowSlot(uint8_t devAddr);
+            static bool shadowRead(uint8_t devAddr, uint8_t regAddr, uint8_t *data);
+            static void shadowStore(uint8_t devAddr, uint8_t regAddr, uint8_t length, const uint8_t *data);
+            static void shadowDrop(uint8_t devAddr, uint8_t regAddr, uint8_t length);
+
+            static I2CdevShadow shadow[I2CDEV_SHADOW_DEVICES];
+        #endif
 };
 
 #if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
@@ -153,6 +266,7 @@ class I2Cdev {
             static byte readBuf(byte device, byte address, byte *data, byte num);
             static void reset();
             static byte stop();
+            static boolean clearBus();
     };
 #endif
 
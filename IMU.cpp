@@ -3,6 +3,7 @@
 //necessary to add before EnableInterrupt to avoid collision (all but 1 file)
 #define LIBCALL_ENABLEINTERRUPT
 #include <EnableInterrupt.h>
+#include <util/atomic.h>
 #include "I2Cdev.h"
 #include "MPU6050_6Axis_MotionApps20.h"
 
@@ -13,62 +14,346 @@
 
 #include "pinmap.h"
 #include "IMU.h"
+#include "Log.h"
+
+
+// gyro sensitivity at the +/- 2000 deg/sec range set by dmpInitialize
+const float GYRO_LSB_PER_DPS = 16.4;
+
+// I2C clock (kHz), also restored after a bus recovery
+const int I2C_CLOCK_KHZ = 400;
+
+// MPU6050 FIFO capacity (bytes)
+const uint16_t FIFO_SIZE = 1024;
+
+// FIFO count reads spent waiting for the rest of a packet before giving up
+// until the next pass
+const uint8_t FIFO_WAIT_READS = 8;
+
+const uint8_t IMU_TIME_RING_MASK = IMU_TIME_RING_SIZE - 1;
 
 // indicates whether MPU interrupt pin has gone high
 static volatile bool mpuInterrupt = false;
+
+// longest single FIFO read (I2Cdev lengths are 8 bit)
+const uint8_t FIFO_BURST_MAX = 255;
+
+// holds a burst of queued DMP packets, the newest at the end
+static uint8_t fifoBurst[FIFO_BURST_MAX];
+
+// time of each data ready edge, written by the ISR at sampleHead
+static volatile unsigned long sampleTimes[IMU_TIME_RING_SIZE];
+static volatile uint8_t sampleHead = 0;
+
+// Reads a ring timestamp without the ISR tearing it
+static unsigned long EdgeTime(const uint8_t index)
+{
+   unsigned long time;
+
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+   {
+      time = sampleTimes[index & IMU_TIME_RING_MASK];
+   }
+
+   return time;
+}
+
+#if (IMU_BOOT_BENCHMARK == 1) && defined(__AVR__)
+extern char __heap_start;
+extern char *__brkval;
+
+// fill pattern for unused RAM and the run of it that marks the heap peak
+const uint8_t RAM_PAINT = 0xA5;
+const uint8_t RAM_PAINT_RUN = 16;
+
+// bytes left untouched below the stack pointer while painting
+const uint16_t RAM_PAINT_STACK_MARGIN = 128;
+
+// Fills free RAM between the heap and the stack with RAM_PAINT
+static char *PaintFreeRam()
+{
+   char *base = (__brkval == 0) ? &__heap_start : __brkval;
+   char *top = (char *)SP - RAM_PAINT_STACK_MARGIN;
+
+   for (char *p = base; p < top; p++)
+   {
+      *p = RAM_PAINT;
+   }
+   return base;
+}
+
+// Bytes above base the heap has grown into since PaintFreeRam
+static unsigned int HeapPeak(char *base)
+{
+   char *top = (char *)SP - RAM_PAINT_STACK_MARGIN;
+   uint8_t run = 0;
+   char *p;
+
+   for (p = base; (p < top) && (run < RAM_PAINT_RUN); p++)
+   {
+      run = ((uint8_t)*p == RAM_PAINT) ? run + 1 : 0;
+   }
+   return (p - run) - base;
+}
+#endif
+
+// Converts sensor frame gyro readings to quadcopter body rates (deg/sec).
+// Axes follow the yaw/pitch/roll mapping applied to the DMP attitude in ReadIMU.
+static void GyroToBodyRates(const int16_t gx, const int16_t gy, const int16_t gz,
+                            float &yawRate, float &pitchRate, float &rollRate)
+{
+   yawRate   = -gz / GYRO_LSB_PER_DPS;
+   pitchRate =  gx / GYRO_LSB_PER_DPS;
+   rollRate  = -gy / GYRO_LSB_PER_DPS;
+}
    
 IMU::IMU() :
-   mDmpReady(false),
-   mPacketSize(42)
+   mFifoCount(0),
+   mImuReady(false),
+   mPacketSize(42),
+   mFilter(MAHONY_KP, MAHONY_KI, M_PI / 180.0 / GYRO_LSB_PER_DPS),
+   mLastSampleTime(0),
+   mServicedHead(0),
+   mPacketTail(0),
+   mServiceTime(0),
+   mBusFailures(0),
+   mRecoveries(0)
 {   
+   mStatus.sampleTime     = 0;
+   mStatus.coalescedCount = 0;
+   mStatus.skippedCount   = 0;
+   mStatus.overflowCount  = 0;
+   mStatus.drainedCount   = 0;
+   mStatus.busErrorCount  = 0;
+   mStatus.recoveryCount  = 0;
+   mStatus.lastBusError   = I2CDEV_OK;
+   mStatus.recoveryFailed = false;
+   mStatus.sensorLost     = false;
+#if (IMU_LOG_RAW == 1)
+   mRawReady = false;
+#endif
 }
 
 void IMU::DmpDataReady()
 {
+   // stamp first so the time is as close to the edge as possible
+   sampleTimes[sampleHead & IMU_TIME_RING_MASK] = micros();
+   sampleHead++;
    mpuInterrupt = true;
 }
 
+#if (IMU_LOG_RAW == 1)
+bool IMU::TakeRawSample(ImuRawSample &sample)
+{
+   if (!mRawReady)
+   {
+      return false;
+   }
+
+   sample = mRawSample;
+   mRawReady = false;
+   return true;
+}
+#endif
+
+bool IMU::DataReady() const
+{
+   return mImuReady && (mpuInterrupt || (mFifoCount >= mPacketSize));
+}
+
+void IMU::ServiceInterrupt()
+{
+   uint8_t head;
+   uint8_t edges;
+
+   // an edge after the flag is cleared is counted now or raises it again
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+   {
+      mpuInterrupt = false;
+      head = sampleHead;
+   }
+   edges = head - mServicedHead;
+   mServiceTime = micros();
+
+   // every edge past the first arrived before we got here and shares this pass
+   if (edges > 1)
+   {
+      mStatus.coalescedCount += edges - 1;
+   }
+   mServicedHead = head;
+}
+
+unsigned long IMU::TakePacketTime()
+{
+   uint8_t head = sampleHead;
+   uint8_t pending = head - mPacketTail;
+   unsigned long time;
+
+   // more packets than the ring holds means the oldest times were overwritten
+   if (pending > IMU_TIME_RING_SIZE)
+   {
+      mStatus.skippedCount += pending - IMU_TIME_RING_SIZE;
+      mPacketTail = head - IMU_TIME_RING_SIZE;
+   }
+
+   // a packet with no edge of its own (e.g. read right after a reset) is
+   // stamped with the newest edge
+   if (pending == 0)
+   {
+      return LatestTime();
+   }
+
+   time = EdgeTime(mPacketTail);
+   mPacketTail++;
+   return time;
+}
+
+unsigned long IMU::LatestTime() const
+{
+   return EdgeTime(sampleHead - 1);
+}
+
+void IMU::DropPackets()
+{
+   uint8_t head = sampleHead;
+
+   mStatus.skippedCount += (uint8_t)(head - mPacketTail);
+   mPacketTail = head;
+}
+
+void IMU::SkipPackets(const uint8_t count)
+{
+   uint8_t pending = sampleHead - mPacketTail;
+
+   mPacketTail += (count < pending) ? count : pending;
+}
+
+const uint8_t *IMU::ReadNewestPacket()
+{
+   uint16_t packets = mFifoCount / mPacketSize;
+   uint16_t length = packets * mPacketSize;
+
+   // clocking out more than one burst of stale data costs longer than
+   // waiting for the next packet after a reset
+   if (length > FIFO_BURST_MAX)
+   {
+      mpu.resetFIFO();
+      mFifoCount = 0;
+      mStatus.drainedCount += packets;
+      DropPackets();
+      return NULL;
+   }
+
+   // one read for every complete packet, a partial packet stays queued
+   if (!CheckBus(mpu.getFIFOBytes(fifoBurst, length)))
+   {
+      // the FIFO position is unknown after a failed read
+      mFifoCount = 0;
+      return NULL;
+   }
+   mFifoCount -= length;
+
+   mStatus.drainedCount += packets - 1;
+   SkipPackets(packets - 1);
+
+   return fifoBurst + length - mPacketSize;
+}
+
 void IMU::SetupIMU() 
 {
    uint8_t devStatus;   // return status after device operation (0 = success, !0 = error)
+   bool warm = false;   // DMP survived an MCU reset and is still running
 
    // Init I2C bus
 #if I2CDEV_IMPLEMENTATION == I2CDEV_ARDUINO_WIRE
    Wire.begin();
    TWBR = 24; // 400kHz I2C clock (200kHz if CPU is 8MHz). Comment this line if having compilation difficulties with TWBR.
 #elif I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
-   Fastwire::setup(400, true);
+   Fastwire::setup(I2C_CLOCK_KHZ, true);
+#endif
+
+#if (IMU_ATTITUDE == IMU_ATTITUDE_DMP) && (IMU_WARM_START == 1)
+   // checked before initialize(), which would change the gyro range under
+   // a running DMP
+   warm = mpu.dmpIsLoaded();
 #endif
 
    // Init IMU
-   Serial.println(F("Initializing I2C devices..."));
-   mpu.initialize();
+   if (!warm)
+   {
+      LOG_INFO("Initializing I2C devices...");
+      mpu.initialize();
+   }
 
    // Verify connection
-   Serial.println(F("Testing device connections..."));
-   Serial.println(mpu.testConnection() ? F("MPU6050 connection successful") : F("MPU6050 connection failed"));
+   LOG_INFO("Testing device connections...");
+   if (mpu.testConnection())
+   {
+      LOG_INFO("MPU6050 connection successful");
+   }
+   else
+   {
+      LOG_ERROR("MPU6050 connection failed");
+   }
 
+#if (IMU_ATTITUDE == IMU_ATTITUDE_MAHONY)
+   // the filter runs on raw samples so the DMP firmware is never loaded
+   LOG_INFO("Configuring raw sampling for Mahony filter...");
+   ConfigureSampling();
+
+   enableInterrupt(IMU_INT_PIN, DmpDataReady, RISING);
+
+   mFilter.Reset();
+   mLastSampleTime = micros();
+   mServiceTime = mLastSampleTime;
+   mImuReady = true;
+   (void)devStatus;
+   (void)warm;
+#else
    // load and configure the DMP
-   Serial.println(F("Initializing DMP..."));
-   devStatus = mpu.dmpInitialize();
+   if (warm)
+   {
+      // skip the reset and firmware upload, the DMP kept power and is running
+      LOG_INFO("DMP already loaded, warm starting...");
+      devStatus = mpu.dmpWarmInitialize();
+   }
+   else
+   {
+      LOG_INFO("Initializing DMP...");
+#if (IMU_BOOT_BENCHMARK == 1)
+      unsigned long start = micros();
+#ifdef __AVR__
+      char *heapBase = PaintFreeRam();
+#endif
+#endif
+
+      devStatus = mpu.dmpInitialize();
+
+#if (IMU_BOOT_BENCHMARK == 1)
+#ifdef __AVR__
+      LOG_INFO("DMP init (fast upload %d): %lu us, heap peak %u bytes", MPU6050_DMP_FAST_UPLOAD,
+               micros() - start, HeapPeak(heapBase));
+#else
+      LOG_INFO("DMP init (fast upload %d): %lu us", MPU6050_DMP_FAST_UPLOAD, micros() - start);
+#endif
+#endif
+   }
 
    // Ensure we are good to go
    if (devStatus == 0) 
    {
       // turn on the DMP, now that it's ready
-      Serial.println(F("Enabling DMP..."));
-      mpu.setDMPEnabled(true);
-	  
-      // Enable low pass filtering of readings
-      mpu.setDLPFMode(MPU6050_DLPF_BW_42);
+      LOG_INFO("Enabling DMP...");
+      ConfigureSampling();
 
       // enable Arduino interrupt detection
-      Serial.println(F("Enabling interrupt detection (Arduino external interrupt 0)..."));
+      LOG_INFO("Enabling interrupt detection (Arduino external interrupt 0)...");
       enableInterrupt(IMU_INT_PIN, DmpDataReady, RISING);
 
       // set our DMP Ready flag so the main loop() function knows it's okay to use it
-      Serial.println(F("DMP ready! Waiting for first interrupt..."));
-      mDmpReady = true;
+      LOG_INFO("DMP ready! Waiting for first interrupt...");
+      mServiceTime = micros();
+      mImuReady = true;
 
       // get expected DMP packet size for later comparison
       mPacketSize = mpu.dmpGetFIFOPacketSize();
@@ -79,70 +364,331 @@ void IMU::SetupIMU()
       // 1 = initial memory load failed
       // 2 = DMP configuration updates failed
       // (if it's going to break, usually the code will be 1)
-      Serial.print(F("DMP Initialization failed (code "));
-      Serial.print(devStatus);
-      Serial.println(F(")"));
+      LOG_ERROR("DMP Initialization failed (code %u)", devStatus);
+   }
+#endif
+}
+
+void IMU::ConfigureSampling()
+{
+#if (IMU_ATTITUDE == IMU_ATTITUDE_MAHONY)
+   mpu.setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+   mpu.setDLPFMode(MPU6050_DLPF_BW_188);
+   mpu.setRate(0);
+   mpu.setIntEnabled(1 << MPU6050_INTERRUPT_DATA_RDY_BIT);
+#else
+   mpu.setDMPEnabled(true);
+
+#if (IMU_FIFO_FAST_PATH == 1)
+   // 50 us interrupt pulses that never wait for INT_STATUS to be read, and any
+   // read clears the status so it never needs reading at all
+   mpu.setInterruptLatch(false);
+   mpu.setInterruptLatchClear(true);
+#endif
+
+   // Enable low pass filtering of readings
+   mpu.setDLPFMode(MPU6050_DLPF_BW_42);
+#endif
+}
+
+bool IMU::CheckBus(const I2CdevError error)
+{
+   if (error == I2CDEV_OK)
+   {
+      mBusFailures = 0;
+      return true;
+   }
+
+   mStatus.busErrorCount++;
+   mStatus.lastBusError = error;
+   mBusFailures++;
+   if (mBusFailures >= IMU_BUS_FAILURE_LIMIT)
+   {
+      RecoverBus();
+   }
+   return false;
+}
+
+void IMU::RecoverBus()
+{
+   bool recovered;
+
+   mBusFailures = 0;
+
+   // a sensor that keeps failing is left alone so the loop keeps its timing
+   if (mRecoveries >= IMU_RECOVERY_LIMIT)
+   {
+      mImuReady = false;
+      mStatus.sensorLost = true;
+      LOG_ERROR("IMU lost, giving up");
+      return;
+   }
+   mRecoveries++;
+   mStatus.recoveryCount++;
+
+#if I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE
+   // free a slave holding SDA, then restart the TWI module from scratch
+   Fastwire::reset();
+   Fastwire::clearBus();
+   Fastwire::setup(I2C_CLOCK_KHZ, true);
+#endif
+
+#if (IMU_ATTITUDE == IMU_ATTITUDE_MAHONY)
+   mpu.initialize();
+   ConfigureSampling();
+   recovered = mpu.testConnection();
+#else
+   // warm first: a firmware upload stalls the loop for far too long with the
+   // motors running, so it waits until a failed attempt has disarmed them
+   if (mStatus.recoveryFailed)
+   {
+      LOG_WARN("Reloading DMP firmware");
+      recovered = (mpu.dmpInitialize() == 0);
+   }
+   else
+   {
+      recovered = (mpu.dmpWarmInitialize() == 0);
+   }
+   if (recovered)
+   {
+      ConfigureSampling();
+   }
+#endif
+
+   // whatever was queued before the failure is gone or untrustworthy
+   mFifoCount = 0;
+   DropPackets();
+   mServiceTime = micros();
+
+   mStatus.recoveryFailed = !recovered;
+   if (recovered)
+   {
+      LOG_WARN("I2C bus recovered (%u recoveries)", mStatus.recoveryCount);
+   }
+   else
+   {
+      LOG_ERROR("I2C bus recovery failed");
+   }
+}
+
+bool IMU::ReadMahony(float &yaw, float &pitch, float &roll,
+                     float &yawRate, float &pitchRate, float &rollRate)
+{
+   int16_t ax, ay, az;     // raw accelerometer
+   int16_t gx, gy, gz;     // raw gyro
+   Quaternion q;           // [w, x, y, z]         quaternion container
+   unsigned long sampleTime;
+
+   // one update per raw sample
+   if (!mpuInterrupt)
+   {
+      return false;
+   }
+   ServiceInterrupt();
+
+   // integrate over the time between edges rather than between reads
+   sampleTime = LatestTime();
+   mpu.getMotion6(&ax, &ay, &az, &gx, &gy, &gz);
+   if (!CheckBus(I2Cdev::lastError))
+   {
+      return false;
    }
+   mFilter.Update(ax, ay, az, gx, gy, gz, sampleTime - mLastSampleTime);
+   mLastSampleTime = sampleTime;
+   mStatus.sampleTime = sampleTime;
+
+   GyroToBodyRates(gx, gy, gz, yawRate, pitchRate, rollRate);
+
+   q = mFilter.GetQuaternion();
+   ToYawPitchRoll(q, yaw, pitch, roll);
+   return true;
+}
+
+void IMU::ToYawPitchRoll(Quaternion &q, float &yaw, float &pitch, float &roll)
+{
+   VectorFloat gravity;    // [x, y, z]            gravity vector
+   float ypr[3];           // [yaw, pitch, roll]   yaw/pitch/roll container and gravity vector
+
+   mpu.dmpGetGravity(&gravity, &q);
+   mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
+
+   yaw = ypr[0] * 180/M_PI;
+   pitch = ypr[2] * 180/M_PI;
+   roll = ypr[1] * 180/M_PI;
 }
 
 void IMU::ReadIMU(float &yaw, float &pitch, float &roll) 
+{
+   float yawRate;
+   float pitchRate;
+   float rollRate;
+
+   ReadIMU(yaw, pitch, roll, yawRate, pitchRate, rollRate);
+}
+
+void IMU::ReadIMU(float &yaw, float &pitch, float &roll,
+                  float &yawRate, float &pitchRate, float &rollRate) 
+{
+   unsigned long sampleTime;
+
+   ReadIMU(yaw, pitch, roll, yawRate, pitchRate, rollRate, sampleTime);
+}
+
+bool IMU::ReadIMU(float &yaw, float &pitch, float &roll,
+                  float &yawRate, float &pitchRate, float &rollRate,
+                  unsigned long &sampleTime) 
 {
    uint8_t mpuIntStatus;   // holds actual interrupt status byte from MPU
+   bool overflow;          // FIFO lost data
+#if (IMU_FIFO_DRAIN == 0)
    uint8_t fifoBuffer[64]; // FIFO storage buffer
+#endif
+   const uint8_t *packet;  // DMP packet to parse
+   bool updated = false;   // set once the readings come from a new sample
    Quaternion q;           // [w, x, y, z]         quaternion container
-   VectorFloat gravity;    // [x, y, z]            gravity vector
-   float ypr[3];           // [yaw, pitch, roll]   yaw/pitch/roll container and gravity vector
+   int16_t gyro[3];        // [x, y, z]            DMP gyro container
+
+   // unchanged until a new sample updates the attitude
+   sampleTime = mStatus.sampleTime;
 
     // if programming failed, don't try to do anything
-    if (!mDmpReady) 
+    if (!mImuReady) 
     {
-      return;
+      return updated;
     }
 
+   // a sensor that stops interrupting fails once per stalled interval
+   if (!mpuInterrupt && (micros() - mServiceTime > IMU_STALL_TIMEOUT_US))
+   {
+      mServiceTime = micros();
+      CheckBus(I2CDEV_ERR_TIMEOUT);
+      return updated;
+   }
+
+#if (IMU_ATTITUDE == IMU_ATTITUDE_MAHONY)
+   updated = ReadMahony(yaw, pitch, roll, yawRate, pitchRate, rollRate);
+   if (updated)
+   {
+      mRecoveries = 0;
+   }
+   sampleTime = mStatus.sampleTime;
+   return updated;
+#endif
+
    // wait for MPU interrupt or extra packet(s) available
    if (!mpuInterrupt && (mFifoCount < mPacketSize)) 
    {
       // Do nothing
-      return;
+      return updated;
    }
 
    // reset interrupt flag and get INT_STATUS byte
-   mpuInterrupt = false;
-   mpuIntStatus = mpu.getIntStatus();
+   if (mpuInterrupt)
+   {
+      ServiceInterrupt();
+   }
+#if (IMU_FIFO_FAST_PATH == 1)
+   // the pulsed interrupt re-arms without an INT_STATUS read, and the FIFO
+   // count shows packets and overflow
+   mpuIntStatus = 0x00;
+#else
+   if (!CheckBus(mpu.getIntStatus(&mpuIntStatus)))
+   {
+      return updated;
+   }
+#endif
+
+   // get current FIFO count, nothing queued can be trusted if that fails
+   if (!CheckBus(mpu.getFIFOCount(&mFifoCount)))
+   {
+      mFifoCount = 0;
+      return updated;
+   }
 
-   // get current FIFO count
-   mFifoCount = mpu.getFIFOCount();
+#if (IMU_FIFO_FAST_PATH == 1)
+   // no room for another packet means one has been (or is being) lost
+   overflow = (mFifoCount > FIFO_SIZE - mPacketSize);
+#else
+   overflow = (mpuIntStatus & 0x10) || (mFifoCount == FIFO_SIZE);
+#endif
 
    // check for overflow (this should never happen unless our code is too inefficient)
-   if ((mpuIntStatus & 0x10) || (mFifoCount == 1024)) 
+   if (overflow) 
    {
       // reset so we can continue cleanly
       mpu.resetFIFO();
-      Serial.println(F("FIFO overflow!"));
+      mStatus.overflowCount++;
+      DropPackets();
+      LOG_WARN("FIFO overflow! (%u so far)", mStatus.overflowCount);
    } 
-   // otherwise, check for DMP data ready interrupt (this should happen frequently)
-   else if (mpuIntStatus & 0x02) 
+   // otherwise, check for DMP data ready interrupt or a packet left over from last
+   // time (the fast path never waits, a partial packet is read next interrupt)
+   else if ((mpuIntStatus & 0x02) || (mFifoCount >= mPacketSize)) 
    {
-      // wait for correct available data length, should be a VERY short wait
-      while (mFifoCount < mPacketSize) 
+      // wait for correct available data length, should be a VERY short wait,
+      // but bounded so a confused sensor cannot hold up the loop
+      for (uint8_t i = 0; (mFifoCount < mPacketSize) && (i < FIFO_WAIT_READS); i++)
       {
-         mFifoCount = mpu.getFIFOCount();
+         if (!CheckBus(mpu.getFIFOCount(&mFifoCount)))
+         {
+            mFifoCount = 0;
+            return updated;
+         }
+      }
+      if (mFifoCount < mPacketSize)
+      {
+         return updated;
       }
 
+#if (IMU_FIFO_DRAIN == 1)
+      // skip straight to the newest packet so a late loop never runs on old data
+      packet = ReadNewestPacket();
+      if (packet == NULL)
+      {
+         return updated;
+      }
+#else
       // read a packet from FIFO
-      mpu.getFIFOBytes(fifoBuffer, mPacketSize);
+      if (!CheckBus(mpu.getFIFOBytes(fifoBuffer, mPacketSize)))
+      {
+         mFifoCount = 0;
+         return updated;
+      }
+      packet = fifoBuffer;
 
       // track FIFO count here in case there is > 1 packet available
       // (this lets us immediately read more without waiting for an interrupt)
       mFifoCount -= mPacketSize;
+#endif
+
+      mStatus.sampleTime = TakePacketTime();
+      sampleTime = mStatus.sampleTime;
+      updated = true;
+      mRecoveries = 0;
 
       // display Euler angles in degrees
-      mpu.dmpGetQuaternion(&q, fifoBuffer);
-      mpu.dmpGetGravity(&gravity, &q);
-      mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
+      mpu.dmpGetQuaternion(&q, packet);
+      ToYawPitchRoll(q, yaw, pitch, roll);
+
+#if (IMU_LOG_RAW == 1)
+      // raw sample next to the DMP solution for offline filter comparison
+      mpu.getMotion6(&mRawSample.accel[0], &mRawSample.accel[1], &mRawSample.accel[2],
+                     &mRawSample.gyro[0], &mRawSample.gyro[1], &mRawSample.gyro[2]);
+      if (CheckBus(I2Cdev::lastError))
+      {
+         mRawSample.time    = mStatus.sampleTime;
+         mRawSample.quat[0] = q.w;
+         mRawSample.quat[1] = q.x;
+         mRawSample.quat[2] = q.y;
+         mRawSample.quat[3] = q.z;
+         mRawReady = true;
+      }
+#endif
 
-      yaw = ypr[0] * 180/M_PI;
-      pitch = ypr[2] * 180/M_PI;
-      roll = ypr[1] * (-180/M_PI); // invert roll channel
+      // the DMP packet gyro is from the same sample as the quaternion
+      mpu.dmpGetGyro(gyro, packet);
+      GyroToBodyRates(gyro[0], gyro[1], gyro[2], yawRate, pitchRate, rollRate);
    }
+
+   return updated;
 }
\ No newline at end of file
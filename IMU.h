@@ -1,7 +1,86 @@
 #ifndef IMU_H
 #define IMU_H
 
+#include "I2Cdev.h"
+#include "helper_3dmath.h"
+
+// MPU6050 carries the DMP packet members only when this is defined; it must
+// match IMU.cpp (which includes MotionApps) in every file that sees class IMU
+#define MPU6050_INCLUDE_DMP_MOTIONAPPS20
 #include "MPU6050.h"
+#include "Mahony.h"
+
+// Attitude sources. The DMP runs on the sample rate and 42 Hz low pass filter
+// dmpInitialize() sets, which hold the raw gyro to the same rate and group
+// delay, so a fast inner rate loop needs IMU_ATTITUDE_MAHONY (1 kHz samples,
+// 188 Hz low pass).
+#define IMU_ATTITUDE_DMP      0  // InvenSense DMP quaternion read from the FIFO
+#define IMU_ATTITUDE_MAHONY   1  // Mahony filter on raw 1 kHz gyro/accel samples
+
+#define IMU_ATTITUDE IMU_ATTITUDE_DMP
+
+// Set to 1 to reuse a DMP that kept power through an MCU reset (brownout,
+// watchdog) instead of resetting the sensor and uploading the firmware again
+#define IMU_WARM_START 1
+
+// Set to 1 to print DMP initialization time and peak heap use at boot, e.g. to
+// compare MPU6050_DMP_FAST_UPLOAD against the original upload
+#define IMU_BOOT_BENCHMARK 0
+
+// Set to 1 to discard stale DMP packets when the loop falls behind so only the
+// newest queued packet is parsed. Set to 0 to read one packet per call.
+#define IMU_FIFO_DRAIN 1
+
+// Set to 1 to skip the INT_STATUS read for each DMP interrupt. The interrupt
+// is pulsed so it needs no acknowledge, and overflow is detected from the FIFO
+// count, leaving one FIFO count read and one FIFO burst per packet.
+#ifndef IMU_FIFO_FAST_PATH
+#define IMU_FIFO_FAST_PATH 1
+#endif
+
+// Set to 1 to keep the raw sample read alongside each DMP quaternion for
+// TakeRawSample(), which the sketch sends as telemetry for host/mahony_bench
+#ifndef IMU_LOG_RAW
+#define IMU_LOG_RAW 0
+#endif
+
+// Number of data ready timestamps buffered between reads (power of 2)
+const uint8_t IMU_TIME_RING_SIZE = 8;
+
+// Consecutive failed sensor transfers (or stalled intervals) before the I2C
+// bus is recovered
+const uint8_t IMU_BUS_FAILURE_LIMIT = 3;
+
+// Recoveries in a row without a new sample before the sensor is given up on
+const uint8_t IMU_RECOVERY_LIMIT = 5;
+
+// Longest gap without a data ready interrupt before the sensor counts as
+// stalled (us), well above the slowest DMP packet interval
+const unsigned long IMU_STALL_TIMEOUT_US = 50000;
+
+// IMU sample timing and health
+typedef struct
+{
+   unsigned long sampleTime;     // time the sample behind the last reading was taken (us)
+   unsigned int coalescedCount;  // data ready edges handled together with a later edge
+   unsigned int skippedCount;    // DMP packets whose timestamp or data was dropped
+   unsigned int overflowCount;   // number of FIFO overflows
+   unsigned int drainedCount;    // stale DMP packets discarded to reach the newest
+   unsigned int busErrorCount;   // failed sensor transfers and stalled intervals
+   unsigned int recoveryCount;   // I2C bus recoveries attempted
+   I2CdevError lastBusError;     // reason for the most recent failure
+   bool recoveryFailed;          // the last recovery left the sensor unusable
+   bool sensorLost;              // recovery gave up, ReadIMU no longer reports
+} ImuStatus;
+
+// Raw sample read alongside a DMP packet (IMU_LOG_RAW)
+typedef struct
+{
+   unsigned long time;   // sample time (us)
+   int16_t accel[3];     // sensor frame x, y, z
+   int16_t gyro[3];
+   float quat[4];        // DMP quaternion w, x, y, z
+} ImuRawSample;
 
 class IMU
 {
@@ -18,20 +97,120 @@ class IMU
     */
    void ReadIMU(float &yaw, float &pitch, float &roll);
 
+   /*
+    * Main IMU loop reading yaw, pitch, and roll along with body rates in
+    * degrees/second. With IMU_ATTITUDE_MAHONY the rates update with each raw
+    * sample, otherwise they update with each DMP packet.
+    */
+   void ReadIMU(float &yaw, float &pitch, float &roll,
+                float &yawRate, float &pitchRate, float &rollRate);
+
+   /*
+    * As above, also returning the time (us) the sample behind the reading was
+    * taken. The time is latched by the data ready ISR: for DMP packets it is
+    * the edge that announced the packet, for raw samples the latest edge.
+    * Returns true when the attitude was updated from a new sample.
+    */
+   bool ReadIMU(float &yaw, float &pitch, float &roll,
+                float &yawRate, float &pitchRate, float &rollRate,
+                unsigned long &sampleTime);
+
+   /*
+    * Returns true when a data ready interrupt or a queued packet is waiting,
+    * i.e. the next ReadIMU call has work to do.
+    */
+   bool DataReady() const;
+
+   inline const ImuStatus &GetStatus() const { return mStatus; }
+
+#if (IMU_LOG_RAW == 1)
+   /*
+    * Returns true, once per DMP packet read, with the raw sample read
+    * alongside it.
+    */
+   bool TakeRawSample(ImuRawSample &sample);
+#endif
+
  private:
     // ISR for IMU feedback
    static void DmpDataReady();
 
+   // Applies the raw sampling or DMP output configuration after a
+   // (re)initialization
+   void ConfigureSampling();
+
+   // Tracks the outcome of a sensor transfer. Returns true on success; after
+   // IMU_BUS_FAILURE_LIMIT failures in a row the bus is recovered.
+   bool CheckBus(const I2CdevError error);
+
+   // Clocks a stuck slave off the bus, restarts the TWI module and warm
+   // re-initializes the sensor, or reloads the DMP once a warm start has
+   // failed. Gives up after IMU_RECOVERY_LIMIT attempts.
+   void RecoverBus();
+
+   // Fuses one raw sample into the Mahony filter and reports its attitude.
+   // Returns false if no sample was ready or it could not be read.
+   bool ReadMahony(float &yaw, float &pitch, float &roll,
+                   float &yawRate, float &pitchRate, float &rollRate);
+
+   // Clears the interrupt flag and counts edges merged into this service
+   void ServiceInterrupt();
+
+   // Returns the time of the oldest unread DMP packet (one edge per packet)
+   unsigned long TakePacketTime();
+
+   // Returns the time of the newest data ready edge
+   unsigned long LatestTime() const;
+
+   // Drops the timestamps of packets discarded by a FIFO reset
+   void DropPackets();
+
+   // Advances past the timestamps of packets drained unread
+   void SkipPackets(const uint8_t count);
+
+   // Reads every complete queued packet in one burst and returns the newest,
+   // or NULL if the backlog was too long to read and the FIFO was reset
+   const uint8_t *ReadNewestPacket();
+
+   // Converts a quaternion to quadcopter yaw (nose right), pitch (nose up), and
+   // roll (left side down) in degrees
+   void ToYawPitchRoll(Quaternion &q, float &yaw, float &pitch, float &roll);
+
    MPU6050 mpu;
 
    // Count of all bytes currently in FIFO. This persists across IMU loop to handle overflow.
    uint16_t mFifoCount;
 
-   // set true if DMP init was successful
-   bool mDmpReady;
+   // set true once the attitude source (DMP or raw sampling) is initialized
+   bool mImuReady;
    
    // expected DMP packet size (default is 42 bytes)
    uint16_t mPacketSize;
+
+   // raw sample attitude filter
+   MahonyFilter mFilter;
+
+   // time of the last raw sample (us)
+   unsigned long mLastSampleTime;
+
+   // ring positions of the last serviced edge and the next unread packet
+   uint8_t mServicedHead;
+   uint8_t mPacketTail;
+
+   // time the last data ready interrupt was serviced (us), for stall detection
+   unsigned long mServiceTime;
+
+   // failed transfers since the last success, recoveries since the last sample
+   uint8_t mBusFailures;
+   uint8_t mRecoveries;
+
+   ImuStatus mStatus;
+
+#if (IMU_LOG_RAW == 1)
+   // raw sample for the last DMP packet, until taken
+   ImuRawSample mRawSample;
+   bool mRawReady;
+#endif
 };
 
 #endif /* IMU_H */
\ No newline at end of file
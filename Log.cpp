@@ -0,0 +1,66 @@
+#include <Arduino.h>
+
+#include "Log.h"
+
+static LogSink logSink = NULL;
+
+void LogSetSink(LogSink sink)
+{
+   logSink = sink;
+}
+
+LogRecord::LogRecord(const uint16_t id) :
+   mLength(LOG_HEADER),
+   mFull(false)
+{
+   const uint32_t now = micros();
+
+   // little endian, as the telemetry payloads
+   memcpy(&mRecord[0], &now, sizeof(now));
+   memcpy(&mRecord[4], &id, sizeof(id));
+}
+
+void LogRecord::Put(const long value)
+{
+   // zig-zag: 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+   const int32_t n = (int32_t)value;
+   uint32_t zigzag = ((uint32_t)n << 1) ^ (uint32_t)(n >> 31);
+   uint8_t bytes[5];
+   uint8_t length = 0;
+
+   while (zigzag >= 0x80)
+   {
+      bytes[length++] = (uint8_t)zigzag | 0x80;
+      zigzag >>= 7;
+   }
+   bytes[length++] = (uint8_t)zigzag;
+
+   Append(bytes, length);
+}
+
+void LogRecord::Put(const double value)
+{
+   const float f = value;
+
+   Append((const uint8_t *)&f, sizeof(f));
+}
+
+void LogRecord::Append(const uint8_t *bytes, const uint8_t length)
+{
+   // whole arguments, in order, so the decoder can tell where they stop
+   if (mFull || (mLength + length > LOG_MAX_RECORD))
+   {
+      mFull = true;
+      return;
+   }
+   memcpy(&mRecord[mLength], bytes, length);
+   mLength += length;
+}
+
+void LogRecord::Send()
+{
+   if (logSink != NULL)
+   {
+      logSink(mRecord, mLength);
+   }
+}
@@ -0,0 +1,146 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+
+// Log levels, in rising severity
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF   4
+
+// Sites below this level are compiled out, arguments and all
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Largest record, so one fits a telemetry payload
+const uint8_t LOG_MAX_RECORD = 32;
+
+// Record layout: time, site id, arguments
+const uint8_t LOG_HEADER = 6;   // uint32_t micros(), uint16_t id
+
+/*
+ * Site id: 16 bit FNV-1a of the level and the format string, folded. Built
+ * at compile time, so the string itself is never stored on the target;
+ * host/log_strings computes the same ids from the sources to rebuild the
+ * table (and fails on a collision).
+ */
+constexpr uint32_t LogHash(const char *s, const uint32_t hash)
+{
+   return (*s == '\0') ? hash : LogHash(s + 1, (hash ^ (uint8_t)*s) * 16777619UL);
+}
+
+constexpr uint16_t LogFold(const uint32_t hash)
+{
+   return (uint16_t)(hash ^ (hash >> 16));
+}
+
+constexpr uint16_t LogId(const uint8_t level, const char *format)
+{
+   return LogFold(LogHash(format, (2166136261UL ^ level) * 16777619UL));
+}
+
+// Makes an id a template argument, so it must be worked out by the compiler
+template<uint16_t ID>
+struct LogSite
+{
+   static const uint16_t id = ID;
+};
+
+/*
+ * Receives each record, e.g. to frame it for the ground station.
+ */
+typedef void (*LogSink)(const uint8_t *record, const uint8_t length);
+
+/*
+ * Sends records to sink; until one is set they are discarded.
+ */
+void LogSetSink(LogSink sink);
+
+/*
+ * One record being built.
+ *
+ * Integers are sent as zig-zag varints (as the blackbox) whatever their type,
+ * floating point values as 4 byte floats; the decoder takes the types from
+ * the format's conversions (%d %i %u %x %X %c, and %f %e %g). Arguments that
+ * do not fit are left off and show as missing.
+ */
+class LogRecord
+{
+ public:
+   explicit LogRecord(const uint16_t id);
+
+   void Put(const long value);
+   void Put(const unsigned long value) { Put((long)value); }
+   void Put(const int value)           { Put((long)value); }
+   void Put(const unsigned int value)  { Put((long)value); }
+   void Put(const double value);
+
+   /*
+    * Hands the record to the sink.
+    */
+   void Send();
+
+ private:
+   // Adds an argument's bytes if they fit, and none after one that did not
+   void Append(const uint8_t *bytes, const uint8_t length);
+
+   uint8_t mRecord[LOG_MAX_RECORD];
+   uint8_t mLength;
+   bool mFull;      // an argument was left off
+};
+
+inline void LogWrite(const uint16_t id)
+{
+   LogRecord(id).Send();
+}
+
+template<typename... Args>
+void LogWrite(const uint16_t id, const Args... args)
+{
+   LogRecord record(id);
+   const int put[] = { (record.Put(args), 0)... };
+
+   (void)put;
+   record.Send();
+}
+
+/*
+ * Deferred formatting log, after Rust's defmt.
+ *
+ *   LOG_WARN("FIFO overflow, %u so far", count);
+ *
+ * The format must be a string literal. Only its id and the arguments are
+ * sent, and host/telemetry_decode formats the text from the table that
+ * host/log_strings extracts from the sources. The format is printf's without
+ * %s (strings must be in the format).
+ */
+#define LOG_AT(level, format, ...) LogWrite(LogSite<LogId(level, format)>::id, ##__VA_ARGS__)
+
+#if (LOG_LEVEL <= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if (LOG_LEVEL <= LOG_LEVEL_INFO)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if (LOG_LEVEL <= LOG_LEVEL_WARN)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if (LOG_LEVEL <= LOG_LEVEL_ERROR)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#endif /* LOG_H */
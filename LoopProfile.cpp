@@ -0,0 +1,103 @@
+#include <Arduino.h>
+
+#include "LoopProfile.h"
+
+#if (LOOP_PROFILE == 1)
+
+LoopProfile loopProfile;
+
+// Probe names, in LoopProbe order
+static const char PROBE_NAMES[] PROGMEM =
+   "loop,receiver,imu,pid_yaw,pid_pitch,pid_roll,motors,servo_refresh";
+
+LoopProfile::LoopProfile()
+{
+   Reset();
+}
+
+void LoopProfile::Begin()
+{
+#if defined(__AVR__)
+   // normal mode, no outputs or interrupts, F_CPU / 8
+   TCCR5A = 0;
+   TCCR5B = _BV(CS51);
+   TCCR5C = 0;
+   TIMSK5 = 0;
+#endif
+}
+
+void LoopProfile::Record(const LoopProbe probe, const uint16_t ticks)
+{
+   LoopProbeStats &stats = mStats[probe];
+   uint8_t bucket = 0;
+
+   for (uint16_t t = ticks; t != 0; t >>= 1)
+   {
+      bucket++;
+   }
+
+   if ((stats.count == 0) || (ticks < stats.minTicks))
+   {
+      stats.minTicks = ticks;
+   }
+   if (ticks > stats.maxTicks)
+   {
+      stats.maxTicks = ticks;
+   }
+   stats.count++;
+   stats.totalTicks += ticks;
+   if (stats.buckets[bucket] != 0xFFFF)
+   {
+      stats.buckets[bucket]++;
+   }
+}
+
+void LoopProfile::Reset()
+{
+   memset(mStats, 0, sizeof(mStats));
+}
+
+void LoopProfile::Dump(Print &out) const
+{
+   uint8_t name = 0;
+
+   out.println(F("probe,count,min_us,mean_us,max_us,log2_ticks"));
+   for (uint8_t i = 0; i < PROBES; i++)
+   {
+      const LoopProbeStats &stats = mStats[i];
+      const float mean = (stats.count > 0) ? (float)stats.totalTicks / stats.count : 0.0;
+      int8_t last = LOOP_PROFILE_BUCKETS - 1;
+      char c;
+
+      while (((c = pgm_read_byte(&PROBE_NAMES[name++])) != ',') && (c != '\0'))
+      {
+         out.print(c);
+      }
+      out.print(F(","));
+      out.print(stats.count);
+      out.print(F(","));
+      out.print((float)stats.minTicks / LOOP_PROFILE_TICKS_PER_US, 1);
+      out.print(F(","));
+      out.print(mean / LOOP_PROFILE_TICKS_PER_US, 1);
+      out.print(F(","));
+      out.print((float)stats.maxTicks / LOOP_PROFILE_TICKS_PER_US, 1);
+      out.print(F(","));
+
+      // counts of 0, 1, 2-3, 4-7, ... ticks
+      while ((last > 0) && (stats.buckets[last] == 0))
+      {
+         last--;
+      }
+      for (int8_t k = 0; k <= last; k++)
+      {
+         if (k > 0)
+         {
+            out.print(F(" "));
+         }
+         out.print(stats.buckets[k]);
+      }
+      out.println();
+   }
+}
+
+#endif
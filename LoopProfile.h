@@ -0,0 +1,124 @@
+#ifndef LOOPPROFILE_H
+#define LOOPPROFILE_H
+
+#include <Arduino.h>
+
+// Set to 1 to time the loop's tasks (see LoopProfile below). At 0 the
+// timers compile to nothing and Timer 5 is left alone.
+#ifndef LOOP_PROFILE
+#define LOOP_PROFILE 0
+#endif
+
+// Period of the profile dump
+const unsigned long LOOP_PROFILE_PERIOD_MS = 5000;
+
+// Timer ticks per microsecond: Timer 5 counts F_CPU / 8, 8 cycles a tick
+const uint8_t LOOP_PROFILE_TICKS_PER_US = 2;
+
+// Histogram buckets: 0 ticks, then one per power of 2 up to 65535
+const uint8_t LOOP_PROFILE_BUCKETS = 17;
+
+// Timed tasks
+enum LoopProbe
+{
+   PROBE_LOOP = 0,         // the whole loop() pass
+   PROBE_RECEIVER,         // receiver.ReadReceiver
+   PROBE_IMU,              // imu.ReadIMU
+   PROBE_PID_YAW,
+   PROBE_PID_PITCH,
+   PROBE_PID_ROLL,
+   PROBE_MOTORS,           // motors.controlMotors
+   PROBE_SERVO_REFRESH,    // SoftwareServo::refresh
+   PROBES
+};
+
+// One probe's timings, in ticks
+typedef struct
+{
+   unsigned long count;
+   unsigned long totalTicks;                  // for the mean
+   uint16_t minTicks;
+   uint16_t maxTicks;
+   uint16_t buckets[LOOP_PROFILE_BUCKETS];    // k: 2^(k-1) to 2^k - 1 ticks, saturating
+} LoopProbeStats;
+
+/*
+ * Per task execution times.
+ *
+ * Each probe keeps its count, min, mean and max and a log2 histogram in a
+ * fixed table, filled by LoopTimer scopes (LOOP_TIMER below). Times come from
+ * Timer 5 running free at F_CPU / 8, 0.5 us a tick on the Mega, so a span
+ * must be under 32 ms; interrupts that land inside a scope count towards
+ * it. On the host the tick follows the shim's clock, so only modelled time
+ * (bus transfers, servo pulses) shows. Dump() prints the table as CSV.
+ */
+class LoopProfile
+{
+ public:
+   LoopProfile();
+
+   /*
+    * Starts the timer.
+    */
+   void Begin();
+
+   /*
+    * The free running tick count.
+    */
+   static inline uint16_t Now()
+   {
+#if defined(__AVR__)
+      return TCNT5;
+#else
+      return (uint16_t)(micros() * LOOP_PROFILE_TICKS_PER_US);
+#endif
+   }
+
+   /*
+    * Adds one timing of probe.
+    */
+   void Record(const LoopProbe probe, const uint16_t ticks);
+
+   inline const LoopProbeStats &Get(const LoopProbe probe) const { return mStats[probe]; }
+
+   /*
+    * Clears every probe.
+    */
+   void Reset();
+
+   /*
+    * Prints a line per probe: name, count, min, mean and max (us), then the
+    * histogram counts up to the last nonzero bucket.
+    */
+   void Dump(Print &out) const;
+
+ private:
+   LoopProbeStats mStats[PROBES];
+};
+
+extern LoopProfile loopProfile;
+
+/*
+ * Times its own scope into a probe.
+ */
+class LoopTimer
+{
+ public:
+   explicit LoopTimer(const LoopProbe probe) : mProbe(probe), mStart(LoopProfile::Now()) {}
+   ~LoopTimer() { loopProfile.Record(mProbe, LoopProfile::Now() - mStart); }
+
+ private:
+   const LoopProbe mProbe;
+   const uint16_t mStart;
+};
+
+// Times the rest of the enclosing scope
+#if (LOOP_PROFILE == 1)
+#define LOOP_TIMER_NAME2(line) loopTimer##line
+#define LOOP_TIMER_NAME(line) LOOP_TIMER_NAME2(line)
+#define LOOP_TIMER(probe) LoopTimer LOOP_TIMER_NAME(__LINE__)(probe)
+#else
+#define LOOP_TIMER(probe) do {} while (0)
+#endif
+
+#endif /* LOOPPROFILE_H */
@@ -35,6 +35,7 @@ THE SOFTWARE.
 */
 
 #include "MPU6050.h"
+#include "DmpStream.h"
 
 /** Default constructor, uses default I2C address.
  * @see MPU6050_DEFAULT_ADDRESS
@@ -61,6 +62,20 @@ MPU6050::MPU6050(uint8_t address) {
  * the default internal clock source.
  */
 void MPU6050::initialize() {
+    #if I2CDEV_SHADOW_CACHE == 1
+        // configuration registers only change when written, so the read half
+        // of every read-modify-write can be served from the shadow copy.
+        // Status, data, FIFO, memory and SIGNAL_PATH_RESET stay uncached.
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_XG_OFFS_TC, 3);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_SMPLRT_DIV, MPU6050_RA_I2C_SLV4_DI - MPU6050_RA_SMPLRT_DIV);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_INT_PIN_CFG, 2);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_I2C_SLV0_DO, MPU6050_RA_I2C_MST_DELAY_CTRL - MPU6050_RA_I2C_SLV0_DO + 1);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_MOT_DETECT_CTRL, 1);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_USER_CTRL, 1, 0x0F); // FIFO/I2C_MST/DMP/SIG_COND resets
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_PWR_MGMT_1, 1, 1 << MPU6050_PWR1_DEVICE_RESET_BIT);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_PWR_MGMT_2, 1);
+        I2Cdev::shadowRegisters(devAddr, MPU6050_RA_DMP_CFG_1, 2);
+    #endif
     setClockSource(MPU6050_CLOCK_PLL_XGYRO);
     setFullScaleGyroRange(MPU6050_GYRO_FS_250);
     setFullScaleAccelRange(MPU6050_ACCEL_FS_2);
@@ -1687,6 +1702,15 @@ uint8_t MPU6050::getIntStatus() {
     I2Cdev::readByte(devAddr, MPU6050_RA_INT_STATUS, buffer);
     return buffer[0];
 }
+/** Get full set of interrupt status bits, reporting bus errors.
+ * @param status Container for the interrupt status (unchanged on error)
+ * @return I2CDEV_OK or the bus error that failed the read
+ * @see getIntStatus()
+ */
+I2CdevError MPU6050::getIntStatus(uint8_t *status) {
+    if (I2Cdev::readByte(devAddr, MPU6050_RA_INT_STATUS, buffer) == 1) *status = buffer[0];
+    return I2Cdev::lastError;
+}
 /** Get Free Fall interrupt status.
  * This bit automatically sets to 1 when a Free Fall interrupt has been
  * generated. The bit clears to 0 after the register has been read.
@@ -2404,6 +2428,9 @@ void MPU6050::resetSensors() {
  */
 void MPU6050::reset() {
     I2Cdev::writeBit(devAddr, MPU6050_RA_PWR_MGMT_1, MPU6050_PWR1_DEVICE_RESET_BIT, true);
+    #if I2CDEV_SHADOW_CACHE == 1
+        I2Cdev::invalidateShadow(devAddr); // every register returns to its default
+    #endif
 }
 /** Get sleep mode status.
  * Setting the SLEEP bit in the register puts the device into very low power
@@ -2688,6 +2715,17 @@ uint16_t MPU6050::getFIFOCount() {
     I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_COUNTH, 2, buffer);
     return (((uint16_t)buffer[0]) << 8) | buffer[1];
 }
+/** Get current FIFO buffer size, reporting bus errors.
+ * @param count Container for the FIFO count (unchanged on error)
+ * @return I2CDEV_OK or the bus error that failed the read
+ * @see getFIFOCount()
+ */
+I2CdevError MPU6050::getFIFOCount(uint16_t *count) {
+    if (I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_COUNTH, 2, buffer) == 2) {
+        *count = (((uint16_t)buffer[0]) << 8) | buffer[1];
+    }
+    return I2Cdev::lastError;
+}
 
 // FIFO_R_W register
 
@@ -2720,11 +2758,18 @@ uint8_t MPU6050::getFIFOByte() {
     I2Cdev::readByte(devAddr, MPU6050_RA_FIFO_R_W, buffer);
     return buffer[0];
 }
-void MPU6050::getFIFOBytes(uint8_t *data, uint8_t length) {
+/** Read multiple bytes from FIFO buffer.
+ * @param data Buffer for the FIFO bytes (contents undefined on error)
+ * @param length Number of bytes to read
+ * @return I2CDEV_OK or the bus error that failed the read
+ */
+I2CdevError MPU6050::getFIFOBytes(uint8_t *data, uint8_t length) {
     if(length > 0){
         I2Cdev::readBytes(devAddr, MPU6050_RA_FIFO_R_W, length, data);
+        return I2Cdev::lastError;
     } else {
     	*data = 0;
+    	return I2CDEV_OK;
     }
 }
 /** Write byte to FIFO buffer.
@@ -3013,6 +3058,98 @@ void MPU6050::readMemoryBlock(uint8_t *data, uint16_t dataSize, uint8_t bank, ui
         }
     }
 }
+#if MPU6050_DMP_FAST_UPLOAD == 1
+
+// staging for PROGMEM source data and bank readback, shared by all uploads
+static uint8_t dmpChunkBuffer[MPU6050_DMP_UPLOAD_CHUNK_SIZE];
+
+// CRC-16/CCITT (polynomial 0x1021) continued over a block
+static uint16_t dmpCrc16(uint16_t crc, const uint8_t *data, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Selects bank and start address with one write (BANK_SEL and MEM_START_ADDR
+// are adjacent registers)
+static void dmpSeek(uint8_t devAddr, uint8_t bank, uint8_t address) {
+    uint8_t position[2] = { (uint8_t)(bank & 0x1F), address };
+    I2Cdev::writeBytes(devAddr, MPU6050_RA_BANK_SEL, 2, position);
+}
+
+// Reads back [bank:address, +length) and checks it against the CRC of what was written
+static bool dmpVerifyBank(uint8_t devAddr, uint8_t bank, uint8_t address, uint16_t length, uint16_t expected) {
+    uint16_t crc = 0xFFFF;
+    uint8_t chunkSize;
+
+    for (uint16_t i = 0; i < length; i += chunkSize) {
+        chunkSize = MPU6050_DMP_UPLOAD_CHUNK_SIZE;
+        if (i + chunkSize > length) chunkSize = length - i;
+
+        dmpSeek(devAddr, bank, address + i);
+        I2Cdev::readBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, dmpChunkBuffer);
+        crc = dmpCrc16(crc, dmpChunkBuffer, chunkSize);
+    }
+    return crc == expected;
+}
+
+bool MPU6050::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify, bool useProgMem) {
+    const uint8_t *chunk;
+    uint8_t chunkSize;
+    uint16_t i = 0;
+    uint16_t bankStart = 0;         // data offset where this bank's portion begins
+    uint8_t bankAddress = address;  // memory address where this bank's portion begins
+    uint16_t crc = 0xFFFF;
+    uint8_t j;
+
+    while (i < dataSize) {
+        // determine correct chunk size according to bank position and data size
+        chunkSize = MPU6050_DMP_UPLOAD_CHUNK_SIZE;
+
+        // make sure we don't go past the data size
+        if (i + chunkSize > dataSize) chunkSize = dataSize - i;
+
+        // make sure this chunk doesn't go past the bank boundary (256 bytes)
+        if (chunkSize > 256 - address) chunkSize = 256 - address;
+
+        if (useProgMem) {
+            for (j = 0; j < chunkSize; j++) dmpChunkBuffer[j] = pgm_read_byte(data + i + j);
+            chunk = dmpChunkBuffer;
+        } else {
+            chunk = data + i;
+        }
+
+        dmpSeek(devAddr, bank, address);
+        I2Cdev::writeBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, (uint8_t *)chunk);
+        if (verify) crc = dmpCrc16(crc, chunk, chunkSize);
+
+        // increase byte index by [chunkSize]
+        i += chunkSize;
+
+        // uint8_t automatically wraps to 0 at 256
+        address += chunkSize;
+
+        // one readback pass per bank once its part of the block is written
+        if (verify && (address == 0 || i == dataSize)) {
+            if (!dmpVerifyBank(devAddr, bank, bankAddress, i - bankStart, crc)) {
+                return false; // uh oh.
+            }
+            crc = 0xFFFF;
+            bankStart = i;
+            bankAddress = 0;
+        }
+
+        if (address == 0) bank++;
+    }
+    return true;
+}
+
+#else
+
 bool MPU6050::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify, bool useProgMem) {
     setMemoryBank(bank);
     setMemoryStartAddress(address);
@@ -3089,16 +3226,50 @@ bool MPU6050::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t b
     if (useProgMem) free(progBuffer);
     return true;
 }
+
+#endif /* MPU6050_DMP_FAST_UPLOAD */
+
 bool MPU6050::writeProgMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify) {
     return writeMemoryBlock(data, dataSize, bank, address, verify, true);
 }
+/** Write a run length coded PROGMEM block (see DmpStream.h) to DMP memory.
+ * Decodes one upload chunk at a time so no buffer the size of the image is
+ * needed; chunks never cross a bank.
+ * @param packed Packed data in PROGMEM
+ * @param dataSize Decoded size in bytes
+ */
+bool MPU6050::writePackedMemoryBlock(const uint8_t *packed, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify) {
+    DmpRleStream stream(packed);
+    uint8_t chunk[MPU6050_DMP_UPLOAD_CHUNK_SIZE];
+    uint8_t chunkSize;
+    uint8_t j;
+
+    for (uint16_t i = 0; i < dataSize; i += chunkSize) {
+        chunkSize = MPU6050_DMP_UPLOAD_CHUNK_SIZE;
+        if (i + chunkSize > dataSize) chunkSize = dataSize - i;
+        if (chunkSize > 256 - address) chunkSize = 256 - address;
+
+        for (j = 0; j < chunkSize; j++) chunk[j] = stream.Read();
+        if (!writeMemoryBlock(chunk, chunkSize, bank, address, verify, false)) {
+            return false;
+        }
+
+        // uint8_t automatically wraps to 0 at 256
+        address += chunkSize;
+        if (address == 0) bank++;
+    }
+    return true;
+}
 bool MPU6050::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem) {
     uint8_t *progBuffer = 0;
 	uint8_t success, special;
-    uint16_t i, j;
+    uint16_t i;
+#if MPU6050_DMP_FAST_UPLOAD == 0
+    uint16_t j;
     if (useProgMem) {
         progBuffer = (uint8_t *)malloc(8); // assume 8-byte blocks, realloc later if necessary
     }
+#endif
 
     // config set data is a long string of blocks with the following structure:
     // [bank] [offset] [length] [byte[0], byte[1], ..., byte[length]]
@@ -3124,12 +3295,18 @@ bool MPU6050::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, b
             Serial.print(", length=");
             Serial.println(length);*/
             if (useProgMem) {
+#if MPU6050_DMP_FAST_UPLOAD == 1
+                // straight from flash through the static upload buffer
+                success = writeMemoryBlock(data + i, length, bank, offset, true, true);
+#else
                 if (sizeof(progBuffer) < length) progBuffer = (uint8_t *)realloc(progBuffer, length);
                 for (j = 0; j < length; j++) progBuffer[j] = pgm_read_byte(data + i + j);
+                success = writeMemoryBlock(progBuffer, length, bank, offset, true);
+#endif
             } else {
                 progBuffer = (uint8_t *)data + i;
+                success = writeMemoryBlock(progBuffer, length, bank, offset, true);
             }
-            success = writeMemoryBlock(progBuffer, length, bank, offset, true);
             i += length;
         } else {
             // special instruction
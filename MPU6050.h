@@ -431,6 +431,28 @@ THE SOFTWARE.
 #define MPU6050_DMP_MEMORY_BANK_SIZE    256
 #define MPU6050_DMP_MEMORY_CHUNK_SIZE   16
 
+// Set to 1 to upload DMP memory in large chunks through a static buffer and
+// verify each bank with one readback pass and a CRC. Set to 0 for the original
+// 16 byte write and readback per chunk with malloc'd buffers.
+#ifndef MPU6050_DMP_FAST_UPLOAD
+#define MPU6050_DMP_FAST_UPLOAD         1
+#endif
+
+// Set to 1 to upload the DMP firmware from the run length coded image in
+// MPU6050_DMPPacked.h (regenerate with host/dmp_compress) instead of dmpMemory[]
+#ifndef MPU6050_DMP_COMPRESSED
+#define MPU6050_DMP_COMPRESSED          1
+#endif
+
+// Fastwire (and the host bus) has no transfer buffer so chunks are limited
+// only by 8 bit lengths, other backends keep the chunk size their buffers
+// were sized for
+#if (I2CDEV_IMPLEMENTATION == I2CDEV_BUILTIN_FASTWIRE) || (I2CDEV_IMPLEMENTATION == I2CDEV_HOST)
+#define MPU6050_DMP_UPLOAD_CHUNK_SIZE   128
+#else
+#define MPU6050_DMP_UPLOAD_CHUNK_SIZE   MPU6050_DMP_MEMORY_CHUNK_SIZE
+#endif
+
 // note: DMP code memory blocks defined at end of header file
 
 class MPU6050 {
@@ -612,6 +634,7 @@ class MPU6050 {
 
         // INT_STATUS register
         uint8_t getIntStatus();
+        I2CdevError getIntStatus(uint8_t *status);
         bool getIntFreefallStatus();
         bool getIntMotionStatus();
         bool getIntZeroMotionStatus();
@@ -711,11 +734,12 @@ class MPU6050 {
 
         // FIFO_COUNT_* registers
         uint16_t getFIFOCount();
+        I2CdevError getFIFOCount(uint16_t *count);
 
         // FIFO_R_W register
         uint8_t getFIFOByte();
         void setFIFOByte(uint8_t data);
-        void getFIFOBytes(uint8_t *data, uint8_t length);
+        I2CdevError getFIFOBytes(uint8_t *data, uint8_t length);
 
         // WHO_AM_I register
         uint8_t getDeviceID();
@@ -808,6 +832,7 @@ class MPU6050 {
         void readMemoryBlock(uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0);
         bool writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true, bool useProgMem=false);
         bool writeProgMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true);
+        bool writePackedMemoryBlock(const uint8_t *packed, uint16_t dataSize, uint8_t bank=0, uint8_t address=0, bool verify=true);
 
         bool writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem=false);
         bool writeProgDMPConfigurationSet(const uint8_t *data, uint16_t dataSize);
@@ -826,6 +851,8 @@ class MPU6050 {
             uint16_t dmpPacketSize;
 
             uint8_t dmpInitialize();
+            uint8_t dmpWarmInitialize();
+            bool dmpIsLoaded();
             bool dmpPacketAvailable();
 
             uint8_t dmpSetFIFORate(uint8_t fifoRate);
@@ -127,6 +127,11 @@ THE SOFTWARE.
  |  24  25  26  27  28  29  30  31  32  33  34  35  36  37  38  39  40  41                          |
  * ================================================================================================ */
 
+#if MPU6050_DMP_COMPRESSED == 1
+// dmpMemory[] below, run length coded
+#include "MPU6050_DMPPacked.h"
+#include "DmpStream.h"
+#else
 // this block of memory gets written to the MPU on start-up, and it seems
 // to be volatile memory, so it has to be done each time (it only takes ~1
 // second though)
@@ -268,6 +273,7 @@ const unsigned char dmpMemory[MPU6050_DMP_CODE_SIZE] PROGMEM = {
     0x98, 0xF1, 0xA3, 0xA3, 0xA3, 0xA3, 0x97, 0xA3, 0xA3, 0xA3, 0xA3, 0xF3, 0x9B, 0xA3, 0xA3, 0xDC,
     0xB9, 0xA7, 0xF1, 0x26, 0x26, 0x26, 0xD8, 0xD8, 0xFF
 };
+#endif /* MPU6050_DMP_COMPRESSED */
 
 // thanks to Noah Zerkin for piecing this stuff together!
 const unsigned char dmpConfig[MPU6050_DMP_CONFIG_SIZE] PROGMEM = {
@@ -381,7 +387,11 @@ uint8_t MPU6050::dmpInitialize() {
     DEBUG_PRINT(F("Writing DMP code to MPU memory banks ("));
     DEBUG_PRINT(MPU6050_DMP_CODE_SIZE);
     DEBUG_PRINTLN(F(" bytes)"));
+#if MPU6050_DMP_COMPRESSED == 1
+    if (writePackedMemoryBlock(dmpMemoryPacked, MPU6050_DMP_CODE_SIZE)) {
+#else
     if (writeProgMemoryBlock(dmpMemory, MPU6050_DMP_CODE_SIZE)) {
+#endif
         DEBUG_PRINTLN(F("Success! DMP code written and verified."));
 
         // write DMP configuration
@@ -543,6 +553,104 @@ uint8_t MPU6050::dmpInitialize() {
     return 0; // success
 }
 
+// first DMP program bank; everything below it is DMP data that changes at
+// runtime (program start is 0x0300, see setDMPConfig1/2 above)
+#define MPU6050_DMP_PROGRAM_BANK    3
+
+// Applies the dmpConfig writes that land in [bank:address, +length) to a copy
+// of dmpMemory so it matches what dmpInitialize left in the chip.
+static void dmpApplyConfig(uint8_t *data, uint8_t length, uint8_t bank, uint8_t address) {
+    uint16_t i = 0;
+    while (i < MPU6050_DMP_CONFIG_SIZE) {
+        uint8_t blockBank = pgm_read_byte(dmpConfig + i++);
+        uint8_t blockOffset = pgm_read_byte(dmpConfig + i++);
+        uint8_t blockLength = pgm_read_byte(dmpConfig + i++);
+
+        if (blockLength == 0) {
+            // special instruction, one byte of payload and nothing written to memory
+            i++;
+            continue;
+        }
+
+        if (blockBank == bank) {
+            for (uint8_t j = 0; j < blockLength; j++) {
+                uint16_t offset = blockOffset + j;
+                if (offset >= address && offset < address + length) {
+                    data[offset - address] = pgm_read_byte(dmpConfig + i + j);
+                }
+            }
+        }
+        i += blockLength;
+    }
+}
+
+/** Check whether the DMP program is still loaded and running.
+ * A sensor that kept power through an MCU reset still holds the program and
+ * configuration, one that lost power comes back asleep with the DMP disabled.
+ * Compares the program banks against the image (with dmpConfig applied) one
+ * chunk at a time and stops at the first difference.
+ * @return True if dmpWarmInitialize() can be used instead of dmpInitialize()
+ */
+bool MPU6050::dmpIsLoaded() {
+    uint8_t expected[MPU6050_DMP_MEMORY_CHUNK_SIZE];
+    uint8_t actual[MPU6050_DMP_MEMORY_CHUNK_SIZE];
+    uint16_t address;
+    uint8_t length, j;
+
+    if (getSleepEnabled() || !getDMPEnabled()) return false;
+
+#if MPU6050_DMP_COMPRESSED == 1
+    // the image only decodes front to back
+    DmpRleStream image(dmpMemoryPacked);
+    image.Skip(MPU6050_DMP_PROGRAM_BANK * 256);
+#endif
+
+    for (address = MPU6050_DMP_PROGRAM_BANK * 256; address < MPU6050_DMP_CODE_SIZE; address += length) {
+        // chunks never cross a bank since 256 is a multiple of the chunk size
+        length = MPU6050_DMP_MEMORY_CHUNK_SIZE;
+        if (address + length > MPU6050_DMP_CODE_SIZE) length = MPU6050_DMP_CODE_SIZE - address;
+
+#if MPU6050_DMP_COMPRESSED == 1
+        for (j = 0; j < length; j++) expected[j] = image.Read();
+#else
+        for (j = 0; j < length; j++) expected[j] = pgm_read_byte(dmpMemory + address + j);
+#endif
+        dmpApplyConfig(expected, length, address >> 8, address & 0xFF);
+
+        readMemoryBlock(actual, length, address >> 8, address & 0xFF);
+        if (memcmp(expected, actual, length) != 0) {
+            DEBUG_PRINT(F("DMP program differs at 0x"));
+            DEBUG_PRINTLNF(address, HEX);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Restart FIFO output from a DMP that is already loaded and running.
+ * Skips the device reset, program upload and verification of dmpInitialize()
+ * so an MCU reset costs milliseconds of attitude rather than seconds. The DMP
+ * keeps its state, only the FIFO is restarted on a packet boundary.
+ * @return 0 on success, 1 if the DMP program is not loaded
+ * @see dmpIsLoaded()
+ */
+uint8_t MPU6050::dmpWarmInitialize() {
+    #if I2CDEV_SHADOW_CACHE == 1
+        // the registers may have been reset behind our back (sensor brownout)
+        I2Cdev::invalidateShadow(devAddr);
+    #endif
+    if (!dmpIsLoaded()) return 1;
+
+    DEBUG_PRINTLN(F("DMP program intact, restarting FIFO..."));
+    setIntEnabled(0x12);
+    setFIFOEnabled(true);
+    resetFIFO();
+    getIntStatus();
+
+    dmpPacketSize = 42;
+    return 0; // success
+}
+
 bool MPU6050::dmpPacketAvailable() {
     return getFIFOCount() >= dmpGetFIFOPacketSize();
 }
@@ -0,0 +1,248 @@
+// Mahony complementary filter for Quadcopter attitude estimation.
+// Based on Mahony et al., "Nonlinear Complementary Filters on the Special
+// Orthogonal Group" (IMU variant without magnetometer).
+
+#include "Mahony.h"
+
+// Largest sample gap integrated in one step (us); longer gaps are clipped
+const unsigned long MAX_DT_US = 100000UL;
+
+#if (MAHONY_FIXED_POINT == 1)
+
+const int32_t Q30_ONE  = 1L << 30;
+const int32_t Q30_HALF = 1L << 29;
+
+// Q30 product of two Q30 values
+static inline int32_t MulQ30(const int32_t a, const int32_t b)
+{
+   return (int32_t)(((int64_t)a * b) >> 30);
+}
+
+// Integer square root (floor) of a 32-bit value
+static uint32_t ISqrt(uint32_t value)
+{
+   uint32_t root = 0;
+   uint32_t bit = 1UL << 30;
+
+   while (bit > value)
+   {
+      bit >>= 2;
+   }
+
+   while (bit != 0)
+   {
+      if (value >= root + bit)
+      {
+         value -= root + bit;
+         root = (root >> 1) + bit;
+      }
+      else
+      {
+         root >>= 1;
+      }
+      bit >>= 2;
+   }
+
+   return root;
+}
+
+MahonyFilter::MahonyFilter(const float kp, const float ki, const float gyroScale) :
+   mKp((int32_t)(kp * 65536.0)),
+   mKi((int32_t)(ki * 65536.0)),
+   mGyroScale((int32_t)(gyroScale * 16777216.0))
+{
+   Reset();
+}
+
+void MahonyFilter::Reset()
+{
+   mQ[0] = Q30_ONE;
+   mQ[1] = 0;
+   mQ[2] = 0;
+   mQ[3] = 0;
+   mIntegral[0] = 0;
+   mIntegral[1] = 0;
+   mIntegral[2] = 0;
+}
+
+void MahonyFilter::Update(const int16_t ax, const int16_t ay, const int16_t az,
+                          const int16_t gx, const int16_t gy, const int16_t gz,
+                          const unsigned long dtUs)
+{
+   int32_t rate[3];     // corrected body rate, rad/s Q24
+   int32_t half[3];     // half rotation angle over the step, Q30
+   int32_t halfV[3];    // half of the estimated gravity direction, Q30
+   int32_t halfE[3];    // half of the accel/gravity error, Q30
+   int32_t acc[3];      // unit accel vector, Q30
+   uint32_t halfDt;     // dt / 2 in seconds, Q32
+   uint32_t norm;
+   int32_t recip;
+   int32_t qa, qb, qc;
+   int32_t mag2;
+   int32_t scale;
+
+   // 2^32 / 2e6 = 2147.48 ~ 8590 / 4
+   halfDt = ((uint32_t)((dtUs < MAX_DT_US) ? dtUs : MAX_DT_US) * 8590UL) >> 2;
+
+   rate[0] = gx * mGyroScale;
+   rate[1] = gy * mGyroScale;
+   rate[2] = gz * mGyroScale;
+
+   // accel feedback is only valid with a nonzero reading
+   norm = ISqrt((uint32_t)((int32_t)ax * ax) + (uint32_t)((int32_t)ay * ay) + (uint32_t)((int32_t)az * az));
+   if (norm != 0)
+   {
+      // |a| <= norm so every component stays within Q30
+      recip = (int32_t)((uint32_t)Q30_ONE / norm);
+      acc[0] = ax * recip;
+      acc[1] = ay * recip;
+      acc[2] = az * recip;
+
+      // gravity direction predicted by the current estimate
+      halfV[0] = MulQ30(mQ[1], mQ[3]) - MulQ30(mQ[0], mQ[2]);
+      halfV[1] = MulQ30(mQ[0], mQ[1]) + MulQ30(mQ[2], mQ[3]);
+      halfV[2] = MulQ30(mQ[0], mQ[0]) + MulQ30(mQ[3], mQ[3]) - Q30_HALF;
+
+      // error is the cross product of measured and predicted gravity
+      halfE[0] = MulQ30(acc[1], halfV[2]) - MulQ30(acc[2], halfV[1]);
+      halfE[1] = MulQ30(acc[2], halfV[0]) - MulQ30(acc[0], halfV[2]);
+      halfE[2] = MulQ30(acc[0], halfV[1]) - MulQ30(acc[1], halfV[0]);
+
+      for (int i = 0; i < 3; i++)
+      {
+         // 2 * ki * halfE integrated over dt, and 2 * kp * halfE (Q24)
+         if (mKi > 0)
+         {
+            int32_t ki = (int32_t)(((int64_t)halfE[i] * mKi) >> 21);
+            mIntegral[i] += (int32_t)(((int64_t)ki * halfDt) >> 31);
+            rate[i] += mIntegral[i];
+         }
+         rate[i] += (int32_t)(((int64_t)halfE[i] * mKp) >> 21);
+      }
+   }
+
+   // Q24 rate * Q32 time is Q56
+   half[0] = (int32_t)(((int64_t)rate[0] * halfDt) >> 26);
+   half[1] = (int32_t)(((int64_t)rate[1] * halfDt) >> 26);
+   half[2] = (int32_t)(((int64_t)rate[2] * halfDt) >> 26);
+
+   // integrate q_dot = 0.5 * q * omega
+   qa = mQ[0];
+   qb = mQ[1];
+   qc = mQ[2];
+   mQ[0] += -MulQ30(qb, half[0]) - MulQ30(qc, half[1]) - MulQ30(mQ[3], half[2]);
+   mQ[1] +=  MulQ30(qa, half[0]) + MulQ30(qc, half[2]) - MulQ30(mQ[3], half[1]);
+   mQ[2] +=  MulQ30(qa, half[1]) - MulQ30(qb, half[2]) + MulQ30(mQ[3], half[0]);
+   mQ[3] +=  MulQ30(qa, half[2]) + MulQ30(qb, half[1]) - MulQ30(qc, half[0]);
+
+   // first order renormalization, (3 - |q|^2) / 2, exact enough for the
+   // small drift of a single step and avoids a square root
+   mag2 = (int32_t)((((int64_t)mQ[0] * mQ[0]) + ((int64_t)mQ[1] * mQ[1]) +
+                     ((int64_t)mQ[2] * mQ[2]) + ((int64_t)mQ[3] * mQ[3])) >> 30);
+   scale = Q30_ONE + ((Q30_ONE - mag2) >> 1);
+   for (int i = 0; i < 4; i++)
+   {
+      mQ[i] = MulQ30(mQ[i], scale);
+   }
+}
+
+Quaternion MahonyFilter::GetQuaternion() const
+{
+   return Quaternion(mQ[0] / (float)Q30_ONE, mQ[1] / (float)Q30_ONE,
+                     mQ[2] / (float)Q30_ONE, mQ[3] / (float)Q30_ONE);
+}
+
+#else
+
+MahonyFilter::MahonyFilter(const float kp, const float ki, const float gyroScale) :
+   mKp(kp),
+   mKi(ki),
+   mGyroScale(gyroScale)
+{
+   Reset();
+}
+
+void MahonyFilter::Reset()
+{
+   mQ[0] = 1.0;
+   mQ[1] = 0.0;
+   mQ[2] = 0.0;
+   mQ[3] = 0.0;
+   mIntegral[0] = 0.0;
+   mIntegral[1] = 0.0;
+   mIntegral[2] = 0.0;
+}
+
+void MahonyFilter::Update(const int16_t ax, const int16_t ay, const int16_t az,
+                          const int16_t gx, const int16_t gy, const int16_t gz,
+                          const unsigned long dtUs)
+{
+   float rate[3];       // corrected body rate, rad/s
+   float halfV[3];      // half of the estimated gravity direction
+   float halfE[3];      // half of the accel/gravity error
+   float acc[3];        // unit accel vector
+   float halfDt;        // dt / 2 in seconds
+   float recip;
+   float qa, qb, qc;
+
+   halfDt = ((dtUs < MAX_DT_US) ? dtUs : MAX_DT_US) * 0.5e-6;
+
+   rate[0] = gx * mGyroScale;
+   rate[1] = gy * mGyroScale;
+   rate[2] = gz * mGyroScale;
+
+   // accel feedback is only valid with a nonzero reading
+   if ((ax != 0) || (ay != 0) || (az != 0))
+   {
+      recip = 1.0 / sqrt(((float)ax * ax) + ((float)ay * ay) + ((float)az * az));
+      acc[0] = ax * recip;
+      acc[1] = ay * recip;
+      acc[2] = az * recip;
+
+      // gravity direction predicted by the current estimate
+      halfV[0] = (mQ[1] * mQ[3]) - (mQ[0] * mQ[2]);
+      halfV[1] = (mQ[0] * mQ[1]) + (mQ[2] * mQ[3]);
+      halfV[2] = (mQ[0] * mQ[0]) + (mQ[3] * mQ[3]) - 0.5;
+
+      // error is the cross product of measured and predicted gravity
+      halfE[0] = (acc[1] * halfV[2]) - (acc[2] * halfV[1]);
+      halfE[1] = (acc[2] * halfV[0]) - (acc[0] * halfV[2]);
+      halfE[2] = (acc[0] * halfV[1]) - (acc[1] * halfV[0]);
+
+      for (int i = 0; i < 3; i++)
+      {
+         if (mKi > 0)
+         {
+            mIntegral[i] += 2.0 * mKi * halfE[i] * (2.0 * halfDt);
+            rate[i] += mIntegral[i];
+         }
+         rate[i] += 2.0 * mKp * halfE[i];
+      }
+   }
+
+   rate[0] *= halfDt;
+   rate[1] *= halfDt;
+   rate[2] *= halfDt;
+
+   // integrate q_dot = 0.5 * q * omega
+   qa = mQ[0];
+   qb = mQ[1];
+   qc = mQ[2];
+   mQ[0] += -(qb * rate[0]) - (qc * rate[1]) - (mQ[3] * rate[2]);
+   mQ[1] +=  (qa * rate[0]) + (qc * rate[2]) - (mQ[3] * rate[1]);
+   mQ[2] +=  (qa * rate[1]) - (qb * rate[2]) + (mQ[3] * rate[0]);
+   mQ[3] +=  (qa * rate[2]) + (qb * rate[1]) - (qc * rate[0]);
+
+   recip = 1.0 / sqrt((mQ[0] * mQ[0]) + (mQ[1] * mQ[1]) + (mQ[2] * mQ[2]) + (mQ[3] * mQ[3]));
+   for (int i = 0; i < 4; i++)
+   {
+      mQ[i] *= recip;
+   }
+}
+
+Quaternion MahonyFilter::GetQuaternion() const
+{
+   return Quaternion(mQ[0], mQ[1], mQ[2], mQ[3]);
+}
+
+#endif /* MAHONY_FIXED_POINT */
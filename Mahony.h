@@ -0,0 +1,63 @@
+#ifndef MAHONY_H
+#define MAHONY_H
+
+#include <stdint.h>
+#include <math.h>
+
+#include "helper_3dmath.h"
+
+// Set to 1 to run the filter in Q30 fixed point instead of float
+#ifndef MAHONY_FIXED_POINT
+#define MAHONY_FIXED_POINT 0
+#endif
+
+// Default gains (proportional and integral feedback of the accel error)
+const float MAHONY_KP = 1.0;
+const float MAHONY_KI = 0.02;
+
+// Complementary (Mahony) attitude filter fusing raw MPU6050 gyro and accel
+// samples into a quaternion using the same convention as the DMP.
+class MahonyFilter
+{
+ public:
+   /*
+    * kp and ki weight the accelerometer correction. gyroScale converts raw
+    * gyro LSB to rad/s (pi / 180 / 16.4 for the +/- 2000 deg/sec range).
+    */
+   MahonyFilter(const float kp, const float ki, const float gyroScale);
+
+   /*
+    * Resets attitude to level and clears the gyro bias estimate.
+    */
+   void Reset();
+
+   /*
+    * Fuses one raw sample as returned by MPU6050::getMotion6.
+    * dtUs is the time since the previous sample in microseconds.
+    */
+   void Update(const int16_t ax, const int16_t ay, const int16_t az,
+               const int16_t gx, const int16_t gy, const int16_t gz,
+               const unsigned long dtUs);
+
+   /*
+    * Returns the current orientation estimate.
+    */
+   Quaternion GetQuaternion() const;
+
+ private:
+#if (MAHONY_FIXED_POINT == 1)
+   int32_t mQ[4];          // orientation [w, x, y, z], Q30
+   int32_t mIntegral[3];   // integral feedback (gyro bias), rad/s Q24
+   int32_t mKp;            // proportional gain, Q16
+   int32_t mKi;            // integral gain, Q16
+   int32_t mGyroScale;     // rad/s per LSB, Q24
+#else
+   float mQ[4];            // orientation [w, x, y, z]
+   float mIntegral[3];     // integral feedback (gyro bias), rad/s
+   float mKp;              // proportional gain
+   float mKi;              // integral gain
+   float mGyroScale;       // rad/s per LSB
+#endif
+};
+
+#endif /* MAHONY_H */
@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include <EnableInterrupt.h>
 
+#include "Log.h"
 #include "motors.h"
 #include "pid.h"
 #include "pinmap.h"
@@ -19,18 +20,36 @@ typedef struct
    unsigned long ticksStart;  // Number of timer ticks present at the last interrupt.
    unsigned long ticksHigh;   // Number of timer ticks while HIGH.
    unsigned long ticksLow;    // Number of timer ticks while LOW.
+   unsigned char frameCount;  // Number of complete pulses received (wraps).
+   unsigned int glitchCount;  // Number of pulses rejected for an invalid width.
 } pwmTickCount;
 
-const unsigned int PWM_IN_NUM    = 5;     // Number of input PWM signals.
-const unsigned int STALE_THRESH  = 65000UL; // Threshold in us for last reception
+const unsigned long STALE_THRESH = 65000UL; // Threshold in us for last reception
+
+// valid RC pulse width (us), anything else is treated as a glitch
+const unsigned long PULSE_MIN_US = 800UL;
+const unsigned long PULSE_MAX_US = 2200UL;
+
+// failsafe escalation times, measured from when the link first went stale (us)
+const unsigned long FAILSAFE_LEVEL_US  = 500000UL;
+const unsigned long FAILSAFE_DISARM_US = 2000000UL;
+
+// throttle limit while leveling in failsafe
+const int FAILSAFE_THROTTLE_DEG  = 60;
 
 // command value limits (duty cycle)
 const int DUTY_LOWER_VAL         = 0;
 const int DUTY_BASE_VAL          = 50;
 const int DUTY_UPPER_VAL         = 100;
+const int DUTY_RANGE_MARGIN      = 10;    // allowed overshoot before counting out of range
 
-const int REC_STEPA              = 5;     // Step value used to bin commands
-const int REC_STEPB              = 2;     // Used to bin with REC_STEPA
+// command shaping (stick deadband is a fraction of half stick travel)
+const float STICK_DEADBAND       = 0.02;
+const float STICK_EXPO           = 0.3;
+
+// bounds on the measured RC frame interval used for interpolation (us)
+const unsigned long FRAME_MIN_US = 5000UL;
+const unsigned long FRAME_MAX_US = 50000UL;
 
 // Protects critical section
 static volatile bool mIsrDataInUse[PWM_IN_NUM];
@@ -38,6 +57,12 @@ static volatile bool mIsrDataInUse[PWM_IN_NUM];
 // Tracks each timer data for each PWM input.
 static volatile pwmTickCount mPwmLastCount[PWM_IN_NUM];
 
+// Maps a stick value (-1 to 1) linearly onto the range [atLow, atHigh]
+static float MapStick(const float stick, const float atLow, const float atHigh)
+{
+   return atLow + ((stick + 1.0) * 0.5) * (atHigh - atLow);
+}
+
 // Array offset for the specified PIN
 static unsigned int PinIndex(const unsigned int pin)
 {
@@ -58,25 +83,107 @@ static unsigned int PinIndex(const unsigned int pin)
    }
 }
 
-Channel::Channel(const unsigned int pin, const int error) :
+Channel::Channel(const unsigned int pin, const int error, const float deadband, const float expo) :
    mPin(pin),
-   mError(error)
+   mError(error),
+   mDeadband(deadband),
+   mExpo(expo),
+   mStart(0.0),
+   mTarget(0.0),
+   mFrameTime(0),
+   mFrameInterval(0),
+   mFrameCount(0)
+{
+}
+
+float Channel::Shape(const float stick) const
+{
+   float value = constrain(stick, -1.0, 1.0);
+   float magnitude = fabs(value);
+
+   // remove deadband around center and rescale so full travel is preserved
+   if (magnitude <= mDeadband)
+   {
+      return 0.0;
+   }
+   magnitude = (magnitude - mDeadband) / (1.0 - mDeadband);
+
+   // blend linear and cubic response
+   magnitude = ((1.0 - mExpo) * magnitude) + (mExpo * magnitude * magnitude * magnitude);
+
+   return (value < 0) ? -magnitude : magnitude;
+}
+
+void Channel::NewFrame(const float value, const unsigned long now, const unsigned long interval)
+{
+   // start the ramp from wherever the command currently is to avoid steps
+   mStart         = Interpolate(now);
+   mTarget        = value;
+   mFrameTime     = now;
+   mFrameInterval = constrain(interval, FRAME_MIN_US, FRAME_MAX_US);
+}
+
+float Channel::Interpolate(const unsigned long now) const
+{
+   unsigned long elapsed = now - mFrameTime;
+
+   // the ramp of a frame latched after now has not started
+   if ((long)elapsed <= 0)
+   {
+      return mStart;
+   }
+
+   if ((mFrameInterval == 0) || (elapsed >= mFrameInterval))
+   {
+      return mTarget;
+   }
+
+   return mStart + ((mTarget - mStart) * elapsed) / mFrameInterval;
+}
+
+bool Channel::CheckFrame(const unsigned char frameCount)
 {
+   if (frameCount == mFrameCount)
+   {
+      return false;
+   }
+
+   mFrameCount = frameCount;
+   return true;
 }
 
 Receiver::Receiver() :
-   mYaw(REC_CHAN_4_PIN, 0),
-   mPitch(REC_CHAN_2_PIN, 0),
-   mRoll(REC_CHAN_1_PIN, 0),
-   mThrottle(REC_CHAN_3_PIN, 0),
-   mArm(REC_CHAN_5_PIN, 0)
+   //                         error, deadband,       expo
+   mYaw(REC_CHAN_4_PIN,      0,     STICK_DEADBAND, STICK_EXPO),
+   mPitch(REC_CHAN_2_PIN,    0,     STICK_DEADBAND, STICK_EXPO),
+   mRoll(REC_CHAN_1_PIN,     0,     STICK_DEADBAND, STICK_EXPO),
+   mThrottle(REC_CHAN_3_PIN, 0,     0.0,            0.0),
+   mArm(REC_CHAN_5_PIN,      0,     0.0,            0.0),
+   mStaleSince(0),
+   mHoldYaw(BASE_VAL_DEG),
+   mHoldPitch(BASE_VAL_DEG),
+   mHoldRoll(BASE_VAL_DEG),
+   mHoldThrottle(MIN_THROTTLE_DEG),
+   mHoldArm(0)
 {
+   // start disarmed until the arm switch is seen low on a live link
+   mStatus.state = FAILSAFE_DISARM;
+   mStatus.failsafeCount = 0;
+
    for (unsigned int i = 0; i < PWM_IN_NUM; i++)
    {
       mPwmLastCount[i].ticksStart = 0;
       mPwmLastCount[i].ticksHigh = 0;
       mPwmLastCount[i].ticksLow = 0;
+      mPwmLastCount[i].frameCount = 0;
+      mPwmLastCount[i].glitchCount = 0;
       mIsrDataInUse[i] = false;
+
+      mStatus.stale[i] = true;
+      mStatus.lastEdge[i] = 0;
+      mStatus.staleCount[i] = 0;
+      mStatus.glitchCount[i] = 0;
+      mStatus.rangeCount[i] = 0;
    }
 }
    
@@ -107,8 +214,17 @@ void Receiver::PwmInIsr(const unsigned int pin)
       }
       else
       {  
-         //get ticks while HIGH
-         mPwmLastCount[pinIndex].ticksHigh = tickNow - mPwmLastCount[pinIndex].ticksStart;
+         //get ticks while HIGH, which completes a frame unless the width is invalid
+         unsigned long ticksHigh = tickNow - mPwmLastCount[pinIndex].ticksStart;
+         if ((ticksHigh < PULSE_MIN_US) || (ticksHigh > PULSE_MAX_US))
+         {
+            mPwmLastCount[pinIndex].glitchCount++;
+         }
+         else
+         {
+            mPwmLastCount[pinIndex].ticksHigh = ticksHigh;
+            mPwmLastCount[pinIndex].frameCount++;
+         }
       }
    }
 
@@ -161,85 +277,186 @@ void Receiver::SetupReceiver()
 
 #if (REC_DEBUG == 1)
 void Receiver::PrintDebug(const unsigned int chanNum, 
-                          const unsigned int &dutyCycle, 
+                          const float &stick, 
                           const unsigned long &lastLow, 
                           const unsigned long &lastHigh)
 {
-   char buf[256];
-   snprintf(buf, sizeof(buf), "  Chan %u: %u%% %luus period",
-                              chanNum, dutyCycle, lastLow + lastHigh);
-   Serial.println(buf);
+   LOG_INFO("  Chan %u: %.2f %luus period", chanNum, stick, lastLow + lastHigh);
 }
 #endif
 
-void Receiver::ReadReceiver(int &yaw, int &pitch, int &roll, int &throttle, int &arm)
+bool Receiver::UpdateChannel(Channel &chan, const unsigned long now)
 {
-   unsigned long lastHigh[PWM_IN_NUM];
-   unsigned long lastLow[PWM_IN_NUM];
-   unsigned int dutyCycle[PWM_IN_NUM];
-   int modulus;
+   const unsigned int i = PinIndex(chan.GetPin());
+   unsigned long lastHigh;
+   unsigned long lastLow;
+   unsigned long lastEdge;
+   unsigned char frameCount;
+   bool stale;
+   float duty;
+   float stick;
 
-   for (unsigned int i = 0; i < PWM_IN_NUM; i++)
+   // Critical section
+   mIsrDataInUse[i] = true;
+   lastHigh = mPwmLastCount[i].ticksHigh;
+   lastLow = mPwmLastCount[i].ticksLow;
+   lastEdge = mPwmLastCount[i].ticksStart;
+   frameCount = mPwmLastCount[i].frameCount;
+   mStatus.glitchCount[i] = mPwmLastCount[i].glitchCount;
+   mIsrDataInUse[i] = false;
+
+   // check channel for last update time to ensure we are actively receiving data;
+   // an edge that landed after now was read is newer than now, not stale
+   stale = ((now - lastEdge) > STALE_THRESH) && ((lastEdge - now) > STALE_THRESH);
+   if (stale && !mStatus.stale[i])
    {
-      // Critical section
-      mIsrDataInUse[i] = true;
-      lastHigh[i] = mPwmLastCount[i].ticksHigh;
-      lastLow[i] = mPwmLastCount[i].ticksLow;
-      mIsrDataInUse[i] = false;
+      mStatus.staleCount[i]++;
    }
-   
-   // check command for last update time to ensure we are actively receiving data
-   // Note: must use an external interrupt pin
-   if (abs(micros() - mPwmLastCount[PinIndex(REC_CHAN_1_PIN)].ticksStart) > STALE_THRESH)
+   mStatus.stale[i] = stale;
+   mStatus.lastEdge[i] = lastEdge;
+
+   // only latch complete frames once
+   if (stale || !chan.CheckFrame(frameCount) || ((lastHigh + lastLow) == 0))
    {
-      // ERROR
-      yaw      = BASE_VAL_DEG;
-      pitch    = BASE_VAL_DEG;
-      roll     = BASE_VAL_DEG;
-      throttle = MIN_THROTTLE_DEG;
-      arm      = 0;
-      
-      Serial.println(F("Receiver values stale, using default"));
+      return !stale;
    }
-   else
+
+   // calculate duty cycle based on last high count vs total number of ticks in period
+   // note that this shifts value by a factor of 10 to normalize between 50% and 100%
+   duty = (lastHigh * 1000.0) / (lastHigh + lastLow);
+
+   // normalize duty cycle around 50% and account for error
+   duty = ((duty - DUTY_BASE_VAL) * 2) + chan.GetError();
+
+   if ((duty < (DUTY_LOWER_VAL - DUTY_RANGE_MARGIN)) || (duty > (DUTY_UPPER_VAL + DUTY_RANGE_MARGIN)))
    {
-      for (unsigned int i = 0; i < PWM_IN_NUM; i++)
-      {
-         // calculate duty cycle based on last high count vs total number of ticks in period
-         // note that this shifts value by a factor of 10 to normalize between 50% and 100%
-         dutyCycle[i] = (lastHigh[i] * 1000) / (lastHigh[i] + lastLow [i]);
+      mStatus.rangeCount[i]++;
+   }
+
+   // shape as a stick value from -1 to 1
+   stick = chan.Shape((duty / DUTY_BASE_VAL) - 1.0);
+   chan.NewFrame(stick, now, lastHigh + lastLow);
 
-         // normalize duty cycle around 50%
-         dutyCycle[i] = (dutyCycle[i] - DUTY_BASE_VAL) * 2;
+#if(REC_DEBUG == 1)
+   PrintDebug(i + 1, stick, lastLow, lastHigh);
+#endif
+
+   return true;
+}
 
-         // use incremental stepping for receiver commands to reduce jitter
-         modulus = dutyCycle[i] % REC_STEPA;
-         if (modulus > REC_STEPB)
+void Receiver::UpdateFailsafe(const bool fresh, const int arm, const unsigned long now)
+{
+   switch (mStatus.state)
+   {
+      case FAILSAFE_OK:
+         if (!fresh)
          {
-            dutyCycle[i] += (REC_STEPA - modulus);
+            mStaleSince = now;
+            mStatus.failsafeCount++;
+            mStatus.state = FAILSAFE_HOLD;
          }
-         else
+         break;
+
+      case FAILSAFE_HOLD:
+      case FAILSAFE_LEVEL:
+         if (fresh)
+         {
+            mStatus.state = FAILSAFE_OK;
+         }
+         else if ((now - mStaleSince) > FAILSAFE_DISARM_US)
+         {
+            mStatus.state = FAILSAFE_DISARM;
+         }
+         else if ((now - mStaleSince) > FAILSAFE_LEVEL_US)
          {
-            dutyCycle[i] -= modulus;
+            mStatus.state = FAILSAFE_LEVEL;
          }
+         break;
 
-#if(REC_DEBUG == 1)
-         PrintDebug(i + 1, dutyCycle[i], lastLow[i], lastHigh[i]);
-#endif
-      }
-      
-      // account for error then convert to degrees (-45 to 45)
-      yaw      = map(dutyCycle[PinIndex(mYaw.GetPin())]   + mYaw.GetError(),   DUTY_LOWER_VAL, DUTY_UPPER_VAL, YAW_UPPER_LIMIT,   YAW_LOWER_LIMIT);
-      pitch    = map(dutyCycle[PinIndex(mPitch.GetPin())] + mPitch.GetError(), DUTY_LOWER_VAL, DUTY_UPPER_VAL, PITCH_UPPER_LIMIT, PITCH_LOWER_LIMIT);
-      roll     = map(dutyCycle[PinIndex(mRoll.GetPin())]  + mRoll.GetError(),  DUTY_LOWER_VAL, DUTY_UPPER_VAL, ROLL_UPPER_LIMIT,  ROLL_LOWER_LIMIT);
-
-      // do not convert to degrees
-      throttle = map(dutyCycle[PinIndex(mThrottle.GetPin())] + mThrottle.GetError(), DUTY_LOWER_VAL, DUTY_UPPER_VAL, MIN_THROTTLE_DEG, MAX_THROTTLE_DEG);
-      arm      = dutyCycle[PinIndex(mArm.GetPin())] + mArm.GetError();
-
-      yaw      = constrain(yaw, YAW_LOWER_LIMIT, YAW_UPPER_LIMIT);
-      pitch    = constrain(pitch, PITCH_LOWER_LIMIT, PITCH_UPPER_LIMIT);
-      roll     = constrain(roll, ROLL_LOWER_LIMIT, ROLL_UPPER_LIMIT);
-      throttle = constrain(throttle, MIN_THROTTLE_DEG, MAX_THROTTLE_DEG);
+      case FAILSAFE_DISARM:
+      default:
+         // never re-arm straight out of failsafe; the switch must be reset first
+         if (fresh && (arm < DUTY_BASE_VAL))
+         {
+            mStatus.state = FAILSAFE_OK;
+         }
+         break;
+   }
+}
+
+void Receiver::ForceDisarm()
+{
+   if (mStatus.state != FAILSAFE_DISARM)
+   {
+      mStatus.failsafeCount++;
+      mStatus.state = FAILSAFE_DISARM;
+   }
+}
+
+void Receiver::ReadReceiver(float &yaw, float &pitch, float &roll, int &throttle, int &arm)
+{
+   unsigned long now = micros();
+   bool fresh = true;
+
+   // every channel must be fresh for the link to be healthy
+   fresh = UpdateChannel(mYaw, now)      && fresh;
+   fresh = UpdateChannel(mPitch, now)    && fresh;
+   fresh = UpdateChannel(mRoll, now)     && fresh;
+   fresh = UpdateChannel(mThrottle, now) && fresh;
+   fresh = UpdateChannel(mArm, now)      && fresh;
+
+   // convert to degrees (-45 to 45)
+   yaw      = MapStick(mYaw.Interpolate(now),   YAW_UPPER_LIMIT,   YAW_LOWER_LIMIT);
+   pitch    = MapStick(mPitch.Interpolate(now), PITCH_UPPER_LIMIT, PITCH_LOWER_LIMIT);
+   roll     = MapStick(mRoll.Interpolate(now),  ROLL_UPPER_LIMIT,  ROLL_LOWER_LIMIT);
+
+   // do not convert to degrees
+   throttle = MapStick(mThrottle.Interpolate(now), MIN_THROTTLE_DEG, MAX_THROTTLE_DEG);
+
+   // arm is a switch, so use the latest frame directly
+   arm      = MapStick(mArm.GetTarget(), DUTY_LOWER_VAL, DUTY_UPPER_VAL);
+
+   yaw      = constrain(yaw, YAW_LOWER_LIMIT, YAW_UPPER_LIMIT);
+   pitch    = constrain(pitch, PITCH_LOWER_LIMIT, PITCH_UPPER_LIMIT);
+   roll     = constrain(roll, ROLL_LOWER_LIMIT, ROLL_UPPER_LIMIT);
+   throttle = constrain(throttle, MIN_THROTTLE_DEG, MAX_THROTTLE_DEG);
+
+   UpdateFailsafe(fresh, arm, now);
+
+   switch (mStatus.state)
+   {
+      case FAILSAFE_OK:
+         // remember the last good commands in case the link drops
+         mHoldYaw      = yaw;
+         mHoldPitch    = pitch;
+         mHoldRoll     = roll;
+         mHoldThrottle = throttle;
+         mHoldArm      = arm;
+         break;
+
+      case FAILSAFE_HOLD:
+         yaw      = mHoldYaw;
+         pitch    = mHoldPitch;
+         roll     = mHoldRoll;
+         throttle = mHoldThrottle;
+         arm      = mHoldArm;
+         break;
+
+      case FAILSAFE_LEVEL:
+         yaw      = BASE_VAL_DEG;
+         pitch    = BASE_VAL_DEG;
+         roll     = BASE_VAL_DEG;
+         throttle = min(mHoldThrottle, FAILSAFE_THROTTLE_DEG);
+         arm      = mHoldArm;
+         break;
+
+      case FAILSAFE_DISARM:
+      default:
+         yaw      = BASE_VAL_DEG;
+         pitch    = BASE_VAL_DEG;
+         roll     = BASE_VAL_DEG;
+         throttle = MIN_THROTTLE_DEG;
+         arm      = 0;
+         break;
    }
 }
\ No newline at end of file
@@ -3,18 +3,71 @@
 
 const int BASE_VAL_DEG = 0;     // Center command value (degrees)
 
+const unsigned int PWM_IN_NUM = 5;  // Number of input PWM signals.
+
+// Tiered failsafe states, entered in order as the receiver link stays stale
+enum FailsafeState
+{
+   FAILSAFE_OK     = 0,   // all channels fresh, commands pass through
+   FAILSAFE_HOLD   = 1,   // a channel went stale, hold the last good commands
+   FAILSAFE_LEVEL  = 2,   // still stale, level out and limit throttle
+   FAILSAFE_DISARM = 3    // link lost, disarm until the arm switch is reset
+};
+
+// Receiver health, indexed by receiver channel (1-5 at offsets 0-4)
+typedef struct
+{
+   unsigned char state;                   // current FailsafeState
+   unsigned int failsafeCount;            // number of times failsafe was entered
+   bool stale[PWM_IN_NUM];                // true while the channel is stale
+   unsigned long lastEdge[PWM_IN_NUM];    // time of last edge on the channel (us)
+   unsigned int staleCount[PWM_IN_NUM];   // number of times the channel went stale
+   unsigned int glitchCount[PWM_IN_NUM];  // pulses rejected for an invalid width
+   unsigned int rangeCount[PWM_IN_NUM];   // frames outside the expected duty range
+} ReceiverStatus;
+
 // Encapsulates a receiver channel
 class Channel
 {
  public:
-   Channel(const unsigned int pin, const int error);
+   Channel(const unsigned int pin, const int error, const float deadband, const float expo);
    
    inline unsigned int GetPin()   const { return mPin; }
    inline int GetError()          const { return mError; }
+   inline float GetTarget()       const { return mTarget; }
+
+   /*
+    * Applies deadband and expo to a stick value normalized from -1 to 1.
+    */
+   float Shape(const float stick) const;
+
+   /*
+    * Latches a new RC frame as the interpolation target. The command ramps
+    * from its current value to the target over one frame interval (us).
+    */
+   void NewFrame(const float value, const unsigned long now, const unsigned long interval);
+
+   /*
+    * Returns the interpolated command at the given time (us).
+    */
+   float Interpolate(const unsigned long now) const;
+
+   /*
+    * Returns true once for each new ISR frame count.
+    */
+   bool CheckFrame(const unsigned char frameCount);
    
  private:
    unsigned int mPin;   // input pin associated with channel
    int mError;          // Correctional value to achieve neutral base command
+   float mDeadband;     // Stick deadband around center (fraction of half stick)
+   float mExpo;         // Expo blend, 0 is linear and 1 is fully cubic
+
+   float mStart;                 // Command value when the last frame arrived
+   float mTarget;                // Command value of the last frame
+   unsigned long mFrameTime;     // Time the last frame was latched (us)
+   unsigned long mFrameInterval; // Measured RC frame interval (us)
+   unsigned char mFrameCount;    // Last ISR frame count seen for this channel
 };
 
 class Receiver
@@ -29,11 +82,25 @@ class Receiver
 
    /*
     * Main Receiver loop reading yaw, pitch, roll, throttle, and arm commands.
+    * Commands are interpolated between RC frames so they may be read at the
+    * control rate without stepping.
     * YPR values range from -45 to 45
     * Throttle values range from MIN_THROTTLE_DEG to MAX_THROTTLE_DEG
     * ARM values range from 0 to 100
     */
-   void ReadReceiver(int &yaw, int &pitch, int &roll, int &throttle, int &arm);
+   void ReadReceiver(float &yaw, float &pitch, float &roll, int &throttle, int &arm);
+
+   /*
+    * Returns link health counters as of the last ReadReceiver call.
+    */
+   inline const ReceiverStatus &GetStatus() const { return mStatus; }
+
+   /*
+    * Drops straight to FAILSAFE_DISARM, for a fault elsewhere that makes
+    * flying unsafe. As after a lost link, the arm switch must be reset on a
+    * live link to leave it.
+    */
+   void ForceDisarm();
 
  private:
    // Main ISR for PWM calculation
@@ -47,8 +114,16 @@ class Receiver
    static void PwmIn4Isr();
    static void PwmIn5Isr();
 
+   // Converts the latest pulse of a channel to a shaped stick value (-1 to 1)
+   // and latches it if a new frame has arrived since the last read.
+   // Returns false if the channel is stale.
+   bool UpdateChannel(Channel &chan, const unsigned long now);
+
+   // Advances the failsafe state machine
+   void UpdateFailsafe(const bool fresh, const int arm, const unsigned long now);
+
    void PrintDebug(const unsigned int chanNum, 
-                   const unsigned int &dutyCycle, 
+                   const float &stick, 
                    const unsigned long &lastLow, 
                    const unsigned long &lastHigh);
 
@@ -57,6 +132,16 @@ class Receiver
    Channel mRoll;
    Channel mThrottle;
    Channel mArm;
+
+   ReceiverStatus mStatus;
+   unsigned long mStaleSince;   // time the link first went stale (us)
+
+   // last commands received while the link was healthy
+   float mHoldYaw;
+   float mHoldPitch;
+   float mHoldRoll;
+   int mHoldThrottle;
+   int mHoldArm;
 };
 
 #endif /* RECEIVER_H */
\ No newline at end of file
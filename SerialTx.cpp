@@ -0,0 +1,98 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "SerialTx.h"
+
+SerialTx serialTx;
+
+#if defined(__AVR__)
+ISR(USART2_UDRE_vect)
+{
+   serialTx.DataRegisterEmpty();
+}
+#else
+static void HostUdre()
+{
+   serialTx.DataRegisterEmpty();
+}
+#endif
+
+SerialTx::SerialTx() :
+   mQueue(mBuffer, SERIAL_TX_RING_SIZE),
+   mSent(0)
+{
+}
+
+void SerialTx::begin(const unsigned long baud)
+{
+#if defined(__AVR__)
+   // double speed mode, as the core does, for the smaller baud error
+   UCSR2A = _BV(U2X2);
+   UBRR2 = ((F_CPU / 4 / baud) - 1) / 2;
+   UCSR2C = _BV(UCSZ21) | _BV(UCSZ20);
+   UCSR2B = _BV(TXEN2);
+#else
+   Serial2.begin(baud);
+   HostUartAttach(Serial2, HostUdre);
+#endif
+}
+
+size_t SerialTx::write(uint8_t c)
+{
+   return write(&c, 1);
+}
+
+size_t SerialTx::write(const uint8_t *buffer, size_t size)
+{
+   if ((size > SERIAL_TX_RING_SIZE) || !mQueue.Push(buffer, (uint16_t)size))
+   {
+      return 0;
+   }
+
+   // the ISR may turn the interrupt off between the read and the write of
+   // UCSR2B; this turns it back on, and it turns itself off again if the
+   // ring is already empty
+#if defined(__AVR__)
+   UCSR2B |= _BV(UDRIE2);
+#else
+   HostUartEnable(Serial2, true);
+#endif
+   return size;
+}
+
+void SerialTx::DataRegisterEmpty()
+{
+   const uint8_t *data;
+
+   if (mQueue.Peek(data) == 0)
+   {
+#if defined(__AVR__)
+      UCSR2B &= ~_BV(UDRIE2);
+#else
+      HostUartEnable(Serial2, false);
+#endif
+      return;
+   }
+#if defined(__AVR__)
+   UDR2 = *data;
+#else
+   Serial2.write(*data);
+#endif
+   mQueue.Pop(1);
+   mSent++;
+}
+
+SerialTxStatus SerialTx::GetStatus() const
+{
+   SerialTxStatus status;
+
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+   {
+      status.bytes = mSent;
+   }
+
+   status.dropped = mQueue.GetDropped();
+   status.droppedBytes = mQueue.GetDroppedBytes();
+   status.peakUsed = mQueue.GetPeak();
+   return status;
+}
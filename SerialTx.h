@@ -0,0 +1,72 @@
+#ifndef SERIALTX_H
+#define SERIALTX_H
+
+#include <Arduino.h>
+
+#include "TxQueue.h"
+
+// Bytes queued for the port (power of 2)
+const uint16_t SERIAL_TX_RING_SIZE = 1024;
+
+// Output health
+typedef struct
+{
+   unsigned long bytes;          // bytes sent
+   unsigned long dropped;        // writes refused for lack of room
+   unsigned long droppedBytes;   // bytes in them
+   uint16_t peakUsed;            // highest ring use seen (bytes)
+} SerialTxStatus;
+
+/*
+ * Transmit only driver for USART2 (Serial2, pins 16/17; Serial1 and Serial3
+ * share pins with receiver channels) that never waits.
+ *
+ * Writes go into a TxQueue ring whole or not at all, so a record is never cut
+ * short, and a write that does not fit is dropped and counted instead of
+ * blocking. The data register empty interrupt moves the ring to the UART a
+ * byte at a time and turns itself off once the ring is empty; a write turns it
+ * back on. USART0 stays with the core's Serial, which claims its interrupts,
+ * so do not use Serial2 alongside this.
+ */
+class SerialTx : public Print
+{
+ public:
+   SerialTx();
+
+   /*
+    * Sets the UART up for baud, 8N1, transmit only.
+    */
+   void begin(const unsigned long baud);
+
+   /*
+    * Queues the bytes if they all fit. Returns the bytes queued: all or 0.
+    */
+   size_t write(uint8_t c);
+   size_t write(const uint8_t *buffer, size_t size);
+   using Print::write;
+
+   /*
+    * Space for a write that will not be dropped.
+    */
+   inline int availableForWrite() const { return mQueue.Free(); }
+
+   /*
+    * Sends the next byte, from the data register empty ISR.
+    */
+   void DataRegisterEmpty();
+
+   /*
+    * Returns the counters, copied with interrupts held off.
+    */
+   SerialTxStatus GetStatus() const;
+
+ private:
+   uint8_t mBuffer[SERIAL_TX_RING_SIZE];
+   TxQueue mQueue;
+
+   volatile unsigned long mSent;   // bytes sent (ISR)
+};
+
+extern SerialTx serialTx;
+
+#endif /* SERIALTX_H */
@@ -0,0 +1,66 @@
+#include <Arduino.h>
+
+#include "Telemetry.h"
+
+Telemetry::Telemetry() :
+   mQueue(mBuffer, TELEMETRY_QUEUE_SIZE),
+   mSequence(0),
+   mOversize(0)
+{
+   memset(mPeriod, 0, sizeof(mPeriod));
+   memset(mLastSent, 0, sizeof(mLastSent));
+
+   mPeriod[TELEMETRY_ATTITUDE] = TELEMETRY_ATTITUDE_MS;
+   mPeriod[TELEMETRY_RC]       = TELEMETRY_RC_MS;
+   mPeriod[TELEMETRY_MOTORS]   = TELEMETRY_MOTORS_MS;
+   mPeriod[TELEMETRY_STATUS]   = TELEMETRY_STATUS_MS;
+}
+
+void Telemetry::SetPeriod(const TelemetryId id, const uint16_t periodMs)
+{
+   mPeriod[id] = periodMs;
+}
+
+bool Telemetry::Due(const TelemetryId id, const unsigned long nowMs)
+{
+   if ((mPeriod[id] == 0) || (nowMs - mLastSent[id] < mPeriod[id]))
+   {
+      return false;
+   }
+   mLastSent[id] = nowMs;
+   return true;
+}
+
+void Telemetry::Send(const TelemetryId id, const void *payload, const uint8_t length)
+{
+   uint8_t frame[TELEMETRY_HEADER + TELEMETRY_MAX_PAYLOAD + 1];
+   uint8_t crc = 0;
+
+   if (length > TELEMETRY_MAX_PAYLOAD)
+   {
+      mOversize++;
+      mSequence++;
+      return;
+   }
+
+   frame[0] = TELEMETRY_SYNC1;
+   frame[1] = TELEMETRY_SYNC2;
+   frame[2] = mSequence;
+   frame[3] = id;
+   frame[4] = length;
+   memcpy(&frame[TELEMETRY_HEADER], payload, length);
+   for (uint8_t i = 2; i < TELEMETRY_HEADER + length; i++)
+   {
+      crc = TelemetryCrc(crc, frame[i]);
+   }
+   frame[TELEMETRY_HEADER + length] = crc;
+
+   // a dropped frame still uses its number, so the gap shows
+   mQueue.Push(frame, TELEMETRY_HEADER + length + 1);
+   mSequence++;
+}
+
+void Telemetry::Service()
+{
+   mQueue.Drain(TELEMETRY_SERIAL);
+}
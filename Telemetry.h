@@ -0,0 +1,161 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#include "TxQueue.h"
+
+// Set to 1 to stream periodic binary telemetry (see Telemetry below); the
+// link carries the log (Log.h) either way
+#ifndef TELEMETRY
+#define TELEMETRY 1
+#endif
+
+// The USB port, shared with the sketch's remaining text messages
+#define TELEMETRY_SERIAL Serial
+
+// Bytes queued for the port (power of 2)
+const uint16_t TELEMETRY_QUEUE_SIZE = 256;
+
+// Frame layout: '$' 'T' sequence id length payload crc
+const uint8_t TELEMETRY_SYNC1 = '$';
+const uint8_t TELEMETRY_SYNC2 = 'T';
+const uint8_t TELEMETRY_HEADER = 5;        // sync, sync, sequence, id, length
+const uint8_t TELEMETRY_MAX_PAYLOAD = 32;
+
+// Message ids
+enum TelemetryId
+{
+   TELEMETRY_ATTITUDE = 1,
+   TELEMETRY_RC       = 2,
+   TELEMETRY_MOTORS   = 3,
+   TELEMETRY_STATUS   = 4,
+   TELEMETRY_LOG      = 5,   // a Log.h record, of any length
+   TELEMETRY_RAW_IMU  = 6,   // raw sample per DMP packet (IMU_LOG_RAW)
+   TELEMETRY_IDS
+};
+
+// Default send periods (ms), 0 never sends
+const uint16_t TELEMETRY_ATTITUDE_MS = 20;
+const uint16_t TELEMETRY_RC_MS       = 50;
+const uint16_t TELEMETRY_MOTORS_MS   = 20;
+const uint16_t TELEMETRY_STATUS_MS   = 1000;
+
+// Payloads, little endian as on the AVR. Angles are in tenths of a degree,
+// rates in degrees/second, motors in servo degrees.
+typedef struct __attribute__((packed))
+{
+   uint32_t timeUs;     // IMU sample time
+   int16_t yaw;
+   int16_t pitch;
+   int16_t roll;
+   int16_t yawRate;
+   int16_t pitchRate;
+   int16_t rollRate;
+} TelemetryAttitude;
+
+typedef struct __attribute__((packed))
+{
+   uint32_t timeUs;
+   int16_t yaw;
+   int16_t pitch;
+   int16_t roll;
+   uint8_t throttle;
+   uint8_t arm;         // percent
+} TelemetryRc;
+
+typedef struct __attribute__((packed))
+{
+   uint32_t timeUs;
+   int16_t yawPid;      // PID outputs
+   int16_t pitchPid;
+   int16_t rollPid;
+   uint8_t motor[4];
+} TelemetryMotors;
+
+typedef struct __attribute__((packed))
+{
+   uint32_t timeUs;     // IMU sample time
+   int16_t accel[3];    // raw sensor frame x, y, z
+   int16_t gyro[3];
+   float quat[4];       // DMP quaternion w, x, y, z
+} TelemetryRawImu;
+
+typedef struct __attribute__((packed))
+{
+   uint32_t timeUs;
+   uint8_t failsafe;          // receiver FailsafeState
+   uint16_t failsafeCount;
+   uint32_t blackboxDropped;  // blackbox frames dropped
+   uint32_t telemetryDropped; // telemetry messages dropped
+} TelemetryStatus;
+
+/*
+ * CRC-8/DVB-S2 (as MSP v2), over sequence, id, length and payload.
+ */
+inline uint8_t TelemetryCrc(uint8_t crc, const uint8_t byte)
+{
+   crc ^= byte;
+   for (uint8_t bit = 0; bit < 8; bit++)
+   {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0xD5) : (uint8_t)(crc << 1);
+   }
+   return crc;
+}
+
+/*
+ * Binary telemetry in place of formatted text.
+ *
+ * Each message is a packed struct sent in a frame:
+ *   '$' 'T', sequence, id, payload length, payload, CRC-8/DVB-S2
+ * The sequence counts every frame queued so a receiver can tell how many were
+ * lost. Each message id has its own send period. Frames go into a TxQueue
+ * that Service() drains as the port has room, so sending never blocks; a
+ * frame that does not fit is dropped and counted. Service() may leave part of
+ * a frame queued, so text printed straight to the same port must wait until
+ * Idle(); it then falls between frames and the receiver's resync skips it.
+ */
+class Telemetry
+{
+ public:
+   Telemetry();
+
+   /*
+    * Sets the period (ms) of a message id, 0 to stop sending it.
+    */
+   void SetPeriod(const TelemetryId id, const uint16_t periodMs);
+
+   /*
+    * Returns true, at most once per period, when id is due to be sent.
+    */
+   bool Due(const TelemetryId id, const unsigned long nowMs);
+
+   /*
+    * Queues a message; dropped (and counted) if the queue has no room or
+    * the payload is longer than TELEMETRY_MAX_PAYLOAD.
+    */
+   void Send(const TelemetryId id, const void *payload, const uint8_t length);
+
+   /*
+    * Moves queued bytes to the port, as many as it takes without waiting.
+    */
+   void Service();
+
+   /*
+    * Returns true when nothing is queued, so no frame is part way out.
+    */
+   inline bool Idle() const { return mQueue.Used() == 0; }
+
+   inline unsigned long GetDropped() const { return mQueue.GetDropped() + mOversize; }
+
+ private:
+   uint8_t mBuffer[TELEMETRY_QUEUE_SIZE];
+   TxQueue mQueue;
+
+   uint8_t mSequence;                        // next frame's sequence number
+   unsigned long mOversize;                  // messages refused for length
+   uint16_t mPeriod[TELEMETRY_IDS];          // send period per id (ms)
+   unsigned long mLastSent[TELEMETRY_IDS];   // time each id was last due (ms)
+};
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,100 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#include "TxQueue.h"
+
+TxQueue::TxQueue(uint8_t * const buffer, const uint16_t size) :
+   mBuffer(buffer),
+   mMask(size - 1),
+   mHead(0),
+   mTail(0),
+   mDropped(0),
+   mDroppedBytes(0),
+   mPeak(0)
+{
+}
+
+uint16_t TxQueue::Used() const
+{
+   uint16_t tail;
+
+   // restore, not enable: a caller may already have interrupts off
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+   {
+      tail = mTail;
+   }
+
+   return (mHead - tail) & mMask;
+}
+
+bool TxQueue::Push(const uint8_t * const data, const uint16_t length)
+{
+   uint16_t head = mHead;
+   uint16_t used;
+
+   if (length > Free())
+   {
+      mDropped++;
+      mDroppedBytes += length;
+      return false;
+   }
+   for (uint16_t i = 0; i < length; i++)
+   {
+      mBuffer[head] = data[i];
+      head = (head + 1) & mMask;
+   }
+   // publish only once the bytes are in place
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+   {
+      mHead = head;
+   }
+
+   used = Used();
+   if (used > mPeak)
+   {
+      mPeak = used;
+   }
+   return true;
+}
+
+uint16_t TxQueue::Peek(const uint8_t *&data) const
+{
+   const uint16_t tail = mTail;
+   const uint16_t used = (mHead - tail) & mMask;
+   const uint16_t run = (mMask + 1) - tail;
+
+   data = &mBuffer[tail];
+   return (used < run) ? used : run;
+}
+
+void TxQueue::Pop(const uint16_t length)
+{
+   mTail = (mTail + length) & mMask;
+}
+
+uint16_t TxQueue::Drain(HardwareSerial &port)
+{
+   int room = port.availableForWrite();
+   uint16_t sent = 0;
+
+   // at most two runs, either side of the end of the buffer
+   while (room > 0)
+   {
+      const uint8_t *data;
+      uint16_t length = Peek(data);
+
+      if (length == 0)
+      {
+         break;
+      }
+      if (length > (uint16_t)room)
+      {
+         length = room;
+      }
+      port.write(data, length);
+      Pop(length);
+      sent += length;
+      room -= length;
+   }
+   return sent;
+}
@@ -0,0 +1,69 @@
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <Arduino.h>
+
+/*
+ * Byte queue between code in the control loop that produces a stream and
+ * whatever transmits it, so that neither waits on the other. Whole records
+ * are queued or dropped (and counted), never cut short, so the stream stays
+ * decodable when the transmitter falls behind. One producer and one
+ * consumer; each index is written by only one of them. The consumer may be
+ * an ISR: Peek() and Pop() are safe in one, and the producer side holds off
+ * interrupts around the indices, which take two instructions to read or write
+ * on the AVR.
+ */
+class TxQueue
+{
+ public:
+   /*
+    * Queues in buffer, of size bytes (a power of 2).
+    */
+   TxQueue(uint8_t * const buffer, const uint16_t size);
+
+   /*
+    * Bytes queued. Not for use in an ISR.
+    */
+   uint16_t Used() const;
+
+   // one byte is kept empty so a full queue is not mistaken for an empty one
+   inline uint16_t Free() const { return mMask - Used(); }
+
+   /*
+    * Queues length bytes if they all fit. Returns false, and counts a drop,
+    * if not.
+    */
+   bool Push(const uint8_t * const data, const uint16_t length);
+
+   /*
+    * Returns the bytes queued contiguously at the front, data set to them.
+    */
+   uint16_t Peek(const uint8_t *&data) const;
+
+   /*
+    * Removes length bytes, at most Peek()'s, from the front.
+    */
+   void Pop(const uint16_t length);
+
+   /*
+    * Moves as many bytes to port as it takes without waiting. Returns the
+    * bytes moved.
+    */
+   uint16_t Drain(HardwareSerial &port);
+
+   inline unsigned long GetDropped() const      { return mDropped; }
+   inline unsigned long GetDroppedBytes() const { return mDroppedBytes; }
+   inline uint16_t GetPeak() const              { return mPeak; }
+
+ private:
+   uint8_t * const mBuffer;
+   const uint16_t mMask;
+   volatile uint16_t mHead;   // next byte written (producer)
+   volatile uint16_t mTail;   // next byte sent (consumer)
+
+   unsigned long mDropped;       // pushes refused for lack of room
+   unsigned long mDroppedBytes;  // bytes in them
+   uint16_t mPeak;               // highest use seen (bytes)
+};
+
+#endif /* TXQUEUE_H */
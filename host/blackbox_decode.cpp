@@ -0,0 +1,873 @@
+// Decoder and flight analysis for the sketch's blackbox stream (Blackbox.h),
+// as captured from its serial port (quad_sil -b) or read off its flash.
+//
+// The log is memory mapped and cut into CHUNK_BYTES chunks, each decoded by
+// a worker thread. A chunk starts at the first keyframe (or stream header)
+// at or after its nominal offset, found by decoding candidates: a 'K' byte
+// counts as a keyframe only if it and the SYNC_FRAMES frames after it decode
+// cleanly and the deltas between them are consistent (the pass counter steps
+// by one, time_us by loop_us). A chunk runs to where the next one starts, so
+// every frame is decoded exactly once. Chunks are written and merged in file
+// order as they complete, at most a window of them held at once, and the
+// pages behind are dropped, so logs of any size decode in bounded memory.
+//
+// The same resync recovers from anything else mid stream: erased flash past
+// the end of a session, a new session's header, or corruption. The bytes
+// skipped are reported.
+//
+// Analysis, over every decoded frame:
+//   - loop time (loop_us) percentiles and a log2 histogram
+//   - gaps in the pass counter, i.e. frames lost to a full ring
+//   - while armed (arm_pct over ARMED_PCT): PID output and tracking error
+//     (command less attitude) per axis, and motors at their output limits
+//
+// usage: blackbox_decode [-c out.csv] [-d dir] [-j workers] log.bbl
+//   -c  writes every frame as CSV, one column per field
+//   -d  writes each field as a raw little endian int32 column, dir/<name>.i32
+//   -j  workers (default: every core)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Blackbox.h"
+#include "motors.h"
+
+namespace
+{
+
+const size_t CHUNK_BYTES = 4 << 20;
+
+// frames that must decode after a candidate keyframe for it to count
+const int SYNC_FRAMES = 8;
+
+// chunks decoded ahead of the one being written, per worker
+const size_t WINDOW_PER_WORKER = 2;
+
+// loop times histogrammed to the microsecond up to here, longer ones clamp
+const size_t LOOP_HIST_US = 65536;
+
+// the sketch's ARM_PERCENT
+const int32_t ARMED_PCT = 50;
+
+const size_t MAX_FIELDS = 255;
+const int AXES = 3;
+const char *const AXIS_NAMES[AXES] = { "yaw", "pitch", "roll" };
+
+// Field layout from the stream header, with the indices analysis needs
+// (-1 when a field is absent)
+struct Layout
+{
+   std::vector<std::string> names;
+   int iteration;
+   int time;
+   int loop;
+   int arm;
+   int command[AXES];
+   int attitude[AXES];
+   int pid[AXES];
+   int motors[MOTORS_NUM];
+};
+
+struct Summary
+{
+   unsigned long long count;
+   double sum;
+   double squares;
+   double min;
+   double max;
+
+   void Add(const double value)
+   {
+      min = (count == 0) ? value : std::min(min, value);
+      max = (count == 0) ? value : std::max(max, value);
+      count++;
+      sum += value;
+      squares += value * value;
+   }
+
+   void Merge(const Summary &other)
+   {
+      if (other.count != 0)
+      {
+         min = (count == 0) ? other.min : std::min(min, other.min);
+         max = (count == 0) ? other.max : std::max(max, other.max);
+      }
+      count += other.count;
+      sum += other.sum;
+      squares += other.squares;
+   }
+
+   double Mean() const { return (count != 0) ? sum / count : 0; }
+   double Rms() const  { return (count != 0) ? sqrt(squares / count) : 0; }
+};
+
+struct Stats
+{
+   unsigned long long frames;
+   unsigned long long keyframes;
+   unsigned long long sessions;   // stream headers
+   unsigned long long skipped;    // bytes outside any frame
+   unsigned long long gaps;       // breaks in the pass counter
+   unsigned long long lost;       // passes missing in them
+   unsigned long long armed;
+   unsigned long long saturated;  // armed frames with any motor at a limit
+   unsigned long long motorLow[MOTORS_NUM];
+   unsigned long long motorHigh[MOTORS_NUM];
+   Summary pid[AXES];
+   Summary error[AXES];
+   std::vector<unsigned long long> loopHist;
+
+   // pass counters at the ends of the frames seen, to join chunks
+   bool haveIteration;
+   uint32_t firstIteration;
+   uint32_t lastIteration;
+
+   Stats() :
+      frames(0), keyframes(0), sessions(0), skipped(0), gaps(0), lost(0), armed(0), saturated(0),
+      loopHist(LOOP_HIST_US, 0), haveIteration(false), firstIteration(0), lastIteration(0)
+   {
+      memset(motorLow, 0, sizeof(motorLow));
+      memset(motorHigh, 0, sizeof(motorHigh));
+      memset(pid, 0, sizeof(pid));
+      memset(error, 0, sizeof(error));
+   }
+
+   // Counts a pass counter step; a counter going back is a new session
+   void Iteration(const uint32_t iteration)
+   {
+      if (!haveIteration)
+      {
+         firstIteration = iteration;
+         haveIteration = true;
+      }
+      else if (iteration - lastIteration - 1 < 0x80000000UL)
+      {
+         if (iteration != lastIteration + 1)
+         {
+            gaps++;
+            lost += iteration - lastIteration - 1;
+         }
+      }
+      lastIteration = iteration;
+   }
+
+   // Adds the stats of the frames that follow these
+   void Merge(const Stats &next)
+   {
+      frames += next.frames;
+      keyframes += next.keyframes;
+      sessions += next.sessions;
+      skipped += next.skipped;
+      gaps += next.gaps;
+      lost += next.lost;
+      armed += next.armed;
+      saturated += next.saturated;
+      for (int m = 0; m < MOTORS_NUM; m++)
+      {
+         motorLow[m] += next.motorLow[m];
+         motorHigh[m] += next.motorHigh[m];
+      }
+      for (int a = 0; a < AXES; a++)
+      {
+         pid[a].Merge(next.pid[a]);
+         error[a].Merge(next.error[a]);
+      }
+      for (size_t i = 0; i < LOOP_HIST_US; i++)
+      {
+         loopHist[i] += next.loopHist[i];
+      }
+      if (next.haveIteration)
+      {
+         // the step across the join
+         if (haveIteration)
+         {
+            const uint32_t last = next.lastIteration;
+
+            Iteration(next.firstIteration);
+            lastIteration = last;
+         }
+         else
+         {
+            haveIteration = true;
+            firstIteration = next.firstIteration;
+            lastIteration = next.lastIteration;
+         }
+      }
+   }
+};
+
+// What a worker produces for one chunk
+struct Chunk
+{
+   Stats stats;
+   std::string csv;
+   std::vector<int32_t> columns;   // frame major, fields per frame
+};
+
+struct Options
+{
+   bool csv;
+   bool columns;
+};
+
+const uint8_t *logData = NULL;
+size_t logSize = 0;
+Layout layout;
+
+// Looks a field up by name
+int FieldIndex(const char *name)
+{
+   for (size_t i = 0; i < layout.names.size(); i++)
+   {
+      if (layout.names[i] == name)
+      {
+         return i;
+      }
+   }
+   return -1;
+}
+
+// Parses a stream header at pos into names; returns the byte after it, or 0
+// if there is none there
+size_t ParseHeader(const size_t pos, std::vector<std::string> &names)
+{
+   size_t p = pos + sizeof(BLACKBOX_MAGIC) + 1;
+   std::string name;
+
+   if ((p > logSize) || (memcmp(&logData[pos], BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC)) != 0))
+   {
+      return 0;
+   }
+   names.clear();
+   for (; (p < logSize) && (logData[p] != '\0'); p++)
+   {
+      if (logData[p] == ',')
+      {
+         names.push_back(name);
+         name.clear();
+      }
+      else
+      {
+         name += (char)logData[p];
+      }
+   }
+   names.push_back(name);
+   if ((p >= logSize) || (names.size() != logData[pos + sizeof(BLACKBOX_MAGIC)]))
+   {
+      return 0;
+   }
+   return p + 1;
+}
+
+bool IsHeader(const size_t pos)
+{
+   return (pos + sizeof(BLACKBOX_MAGIC) <= logSize) &&
+          (memcmp(&logData[pos], BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC)) == 0);
+}
+
+// Decodes the frame at pos into values (deltas applied to them); returns the
+// byte after it, or 0 if it is not a whole, well formed frame
+size_t DecodeFrame(size_t pos, int32_t *values)
+{
+   const bool key = (logData[pos] == BLACKBOX_KEYFRAME);
+   const size_t fields = layout.names.size();
+
+   pos++;
+   for (size_t f = 0; f < fields; f++)
+   {
+      uint32_t zigzag = 0;
+      int shift = 0;
+      uint8_t byte;
+
+      do
+      {
+         // a 32 bit value takes at most 5 bytes
+         if ((pos >= logSize) || (shift > 28))
+         {
+            return 0;
+         }
+         byte = logData[pos++];
+         zigzag |= (uint32_t)(byte & 0x7F) << shift;
+         shift += 7;
+      } while (byte & 0x80);
+
+      const int32_t value = (int32_t)((zigzag >> 1) ^ (0U - (zigzag & 1)));
+      values[f] = key ? value : (int32_t)((uint32_t)values[f] + (uint32_t)value);
+   }
+   return pos;
+}
+
+// True if pos starts a keyframe that the frames after it agree with
+bool IsKeyframe(const size_t pos)
+{
+   int32_t values[MAX_FIELDS];
+   int32_t previous[MAX_FIELDS];
+   size_t p;
+
+   if ((logData[pos] != BLACKBOX_KEYFRAME) || ((p = DecodeFrame(pos, values)) == 0))
+   {
+      return false;
+   }
+   for (int n = 0; n < SYNC_FRAMES; n++)
+   {
+      // the end of the log, erased flash or a new session end the run early
+      if ((p >= logSize) || (logData[p] == 0xFF) || IsHeader(p))
+      {
+         return true;
+      }
+
+      const bool key = (logData[p] == BLACKBOX_KEYFRAME);
+
+      if (!key && (logData[p] != BLACKBOX_DELTA))
+      {
+         return false;
+      }
+      memcpy(previous, values, layout.names.size() * sizeof(int32_t));
+      if ((p = DecodeFrame(p, values)) == 0)
+      {
+         return false;
+      }
+      if (layout.iteration >= 0)
+      {
+         const uint32_t step = (uint32_t)values[layout.iteration] - (uint32_t)previous[layout.iteration];
+
+         // a keyframe may follow dropped frames, never earlier ones
+         if (key ? ((step == 0) || (step >= 0x80000000UL)) : (step != 1))
+         {
+            return false;
+         }
+      }
+      if (!key && (layout.time >= 0) && (layout.loop >= 0) &&
+          ((uint32_t)values[layout.time] - (uint32_t)previous[layout.time] != (uint32_t)values[layout.loop]))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// First keyframe or stream header at or after pos, logSize if none
+size_t FindSync(size_t pos)
+{
+   for (; pos < logSize; pos++)
+   {
+      if (IsHeader(pos) || IsKeyframe(pos))
+      {
+         return pos;
+      }
+   }
+   return logSize;
+}
+
+// Appends value to a CSV line
+void AppendInt(std::string &out, const int32_t value)
+{
+   char digits[12];
+   char *end = digits + sizeof(digits);
+   char *p = end;
+   uint32_t magnitude = (value < 0) ? 0U - (uint32_t)value : (uint32_t)value;
+
+   do
+   {
+      *--p = '0' + (magnitude % 10);
+      magnitude /= 10;
+   } while (magnitude != 0);
+   if (value < 0)
+   {
+      *--p = '-';
+   }
+   out.append(p, end - p);
+}
+
+// Analyses and outputs one decoded frame
+void Frame(const int32_t *values, const bool key, const Options &options, Chunk &chunk)
+{
+   Stats &stats = chunk.stats;
+   const size_t fields = layout.names.size();
+
+   stats.frames++;
+   if (key)
+   {
+      stats.keyframes++;
+   }
+   if (layout.iteration >= 0)
+   {
+      stats.Iteration(values[layout.iteration]);
+   }
+   if (layout.loop >= 0)
+   {
+      stats.loopHist[std::min((uint32_t)values[layout.loop], (uint32_t)(LOOP_HIST_US - 1))]++;
+   }
+
+   if ((layout.arm >= 0) && (values[layout.arm] > ARMED_PCT))
+   {
+      bool saturated = false;
+
+      stats.armed++;
+      for (int a = 0; a < AXES; a++)
+      {
+         if (layout.pid[a] >= 0)
+         {
+            stats.pid[a].Add(values[layout.pid[a]] * 0.1);
+         }
+         if ((layout.command[a] >= 0) && (layout.attitude[a] >= 0))
+         {
+            double error = (values[layout.command[a]] - values[layout.attitude[a]]) * 0.1;
+
+            // yaw is a heading
+            error = (error > 180.0) ? error - 360.0 : ((error < -180.0) ? error + 360.0 : error);
+            stats.error[a].Add(error);
+         }
+      }
+      for (int m = 0; m < MOTORS_NUM; m++)
+      {
+         if (layout.motors[m] < 0)
+         {
+            continue;
+         }
+         if (values[layout.motors[m]] <= MIN_THROTTLE_DEG)
+         {
+            stats.motorLow[m]++;
+            saturated = true;
+         }
+         else if (values[layout.motors[m]] >= MAX_THROTTLE_DEG)
+         {
+            stats.motorHigh[m]++;
+            saturated = true;
+         }
+      }
+      if (saturated)
+      {
+         stats.saturated++;
+      }
+   }
+
+   if (options.csv)
+   {
+      for (size_t f = 0; f < fields; f++)
+      {
+         if (f != 0)
+         {
+            chunk.csv += ',';
+         }
+         AppendInt(chunk.csv, values[f]);
+      }
+      chunk.csv += '\n';
+   }
+   if (options.columns)
+   {
+      chunk.columns.insert(chunk.columns.end(), values, values + fields);
+   }
+}
+
+// Decodes the frames starting in [begin, end)
+void Decode(const size_t begin, const size_t end, const Options &options, Chunk &chunk)
+{
+   int32_t values[MAX_FIELDS];
+   std::vector<std::string> names;
+   bool haveFrame = false;
+   size_t pos = begin;
+
+   while (pos < end)
+   {
+      const uint8_t type = logData[pos];
+      size_t next = 0;
+
+      if ((type == BLACKBOX_KEYFRAME) || ((type == BLACKBOX_DELTA) && haveFrame))
+      {
+         next = DecodeFrame(pos, values);
+
+         // a frame cut short (the end of a capture) runs into the header
+         // of the session after it
+         const uint8_t *magic = (next == 0) ? NULL :
+                                (const uint8_t *)memchr(&logData[pos + 1], BLACKBOX_MAGIC[0], next - pos - 1);
+
+         if ((magic != NULL) && IsHeader(magic - logData))
+         {
+            chunk.stats.skipped += (magic - logData) - pos;
+            next = magic - logData;
+            haveFrame = false;
+         }
+         else if (next != 0)
+         {
+            Frame(values, type == BLACKBOX_KEYFRAME, options, chunk);
+            haveFrame = true;
+         }
+      }
+      else if ((next = ParseHeader(pos, names)) != 0)
+      {
+         if (names != layout.names)
+         {
+            // its frames cannot be told from the first session's
+            fprintf(stderr, "session at byte %zu logs different fields from the first\n", pos);
+            exit(2);
+         }
+         chunk.stats.sessions++;
+         haveFrame = false;
+      }
+
+      if (next == 0)
+      {
+         // lost: resync on the next keyframe or header
+         next = std::min(FindSync(pos + 1), end);
+         chunk.stats.skipped += next - pos;
+         haveFrame = false;
+      }
+      pos = next;
+   }
+}
+
+// Writes the columns of a chunk onto the end of each field's file
+bool WriteColumns(const std::vector<FILE *> &files, const std::vector<int32_t> &columns)
+{
+   const size_t fields = files.size();
+   const size_t frames = columns.size() / fields;
+   std::vector<int32_t> column(frames);
+
+   for (size_t f = 0; f < fields; f++)
+   {
+      for (size_t i = 0; i < frames; i++)
+      {
+         column[i] = columns[i * fields + f];
+      }
+      if (fwrite(column.data(), sizeof(int32_t), frames, files[f]) != frames)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Loop time below which fraction of the frames fall (us)
+size_t Percentile(const std::vector<unsigned long long> &hist, const unsigned long long total, const double fraction)
+{
+   unsigned long long seen = 0;
+
+   for (size_t i = 0; i < hist.size(); i++)
+   {
+      seen += hist[i];
+      if (seen >= fraction * total)
+      {
+         return i;
+      }
+   }
+   return hist.size() - 1;
+}
+
+void Report(const Stats &stats, const double seconds, const unsigned int workers)
+{
+   unsigned long long bucket = 0;
+   size_t bucketStart = 0;
+   size_t longest = 0;
+   const double armed = (stats.armed != 0) ? stats.armed : 1;
+
+   printf("decoded %.1f MB in %.3f s (%.0f MB/s, %u workers)\n",
+          logSize / 1e6, seconds, logSize / 1e6 / seconds, workers);
+   printf("%llu frames (%llu keyframes), %llu sessions, %llu gaps losing %llu frames, %llu bytes skipped\n",
+          stats.frames, stats.keyframes, stats.sessions, stats.gaps, stats.lost, stats.skipped);
+   if (stats.frames == 0)
+   {
+      return;
+   }
+
+   if (layout.loop >= 0)
+   {
+      for (size_t i = 0; i < LOOP_HIST_US; i++)
+      {
+         if (stats.loopHist[i] != 0)
+         {
+            longest = i;
+         }
+      }
+      printf("loop_us p50 %zu, p90 %zu, p99 %zu, p99.9 %zu, max %s%zu\n",
+             Percentile(stats.loopHist, stats.frames, 0.5), Percentile(stats.loopHist, stats.frames, 0.9),
+             Percentile(stats.loopHist, stats.frames, 0.99), Percentile(stats.loopHist, stats.frames, 0.999),
+             (longest == LOOP_HIST_US - 1) ? ">=" : "", longest);
+      printf("loop_us,frames,pct\n");
+      for (size_t i = 0; i < LOOP_HIST_US; i++)
+      {
+         bucket += stats.loopHist[i];
+         // buckets [0,1) [1,2) [2,4) [4,8) ...
+         if (((i + 1) & i) == 0 || (i == LOOP_HIST_US - 1))
+         {
+            if (bucket != 0)
+            {
+               printf("%zu-%zu,%llu,%.2f\n", bucketStart, i, bucket, 100.0 * bucket / stats.frames);
+            }
+            bucket = 0;
+            bucketStart = i + 1;
+         }
+      }
+   }
+
+   printf("%llu frames armed\n", stats.armed);
+   if (stats.armed == 0)
+   {
+      return;
+   }
+   printf("axis,pid_mean_deg,pid_rms_deg,pid_min_deg,pid_max_deg,error_mean_deg,error_rms_deg,error_max_deg\n");
+   for (int a = 0; a < AXES; a++)
+   {
+      const Summary &pid = stats.pid[a];
+      const Summary &error = stats.error[a];
+
+      printf("%s,%.2f,%.2f,%.1f,%.1f,%.2f,%.2f,%.1f\n", AXIS_NAMES[a], pid.Mean(), pid.Rms(), pid.min, pid.max,
+             error.Mean(), error.Rms(), std::max(fabs(error.min), fabs(error.max)));
+   }
+   printf("motor,low_pct,high_pct\n");
+   for (int m = 0; m < MOTORS_NUM; m++)
+   {
+      printf("%d,%.2f,%.2f\n", m + 1, 100.0 * stats.motorLow[m] / armed, 100.0 * stats.motorHigh[m] / armed);
+   }
+   printf("saturated %.2f%% of armed frames\n", 100.0 * stats.saturated / armed);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   const char *csvPath = NULL;
+   const char *columnDir = NULL;
+   unsigned int workers = std::thread::hardware_concurrency();
+   Options options = { false, false };
+   FILE *csv = NULL;
+   std::vector<FILE *> columnFiles;
+   struct stat info;
+   size_t headerEnd;
+   int fd;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "c:d:j:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'c':
+            csvPath = optarg;
+            break;
+         case 'd':
+            columnDir = optarg;
+            break;
+         case 'j':
+            workers = strtoul(optarg, NULL, 10);
+            break;
+         default:
+            optind = argc;
+            break;
+      }
+   }
+   if (optind != argc - 1)
+   {
+      fprintf(stderr, "usage: %s [-c out.csv] [-d dir] [-j workers] log.bbl\n", argv[0]);
+      return 2;
+   }
+   workers = std::max(workers, 1U);
+
+   fd = open(argv[optind], O_RDONLY);
+   if ((fd < 0) || (fstat(fd, &info) != 0))
+   {
+      perror(argv[optind]);
+      return 2;
+   }
+   logSize = info.st_size;
+   logData = (logSize != 0) ? (const uint8_t *)mmap(NULL, logSize, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+   close(fd);
+   if (logData == MAP_FAILED)
+   {
+      perror(argv[optind]);
+      return 2;
+   }
+   if ((logData == NULL) || ((headerEnd = ParseHeader(0, layout.names)) == 0) ||
+       (layout.names.size() > MAX_FIELDS))
+   {
+      fprintf(stderr, "%s: no blackbox header\n", argv[optind]);
+      return 2;
+   }
+
+   layout.iteration = FieldIndex("iteration");
+   layout.time = FieldIndex("time_us");
+   layout.loop = FieldIndex("loop_us");
+   layout.arm = FieldIndex("arm_pct");
+   for (int a = 0; a < AXES; a++)
+   {
+      layout.command[a] = FieldIndex((std::string(AXIS_NAMES[a]) + "_cmd_ddeg").c_str());
+      layout.attitude[a] = FieldIndex((std::string(AXIS_NAMES[a]) + "_ddeg").c_str());
+      layout.pid[a] = FieldIndex((std::string(AXIS_NAMES[a]) + "_pid_ddeg").c_str());
+   }
+   for (int m = 0; m < MOTORS_NUM; m++)
+   {
+      layout.motors[m] = FieldIndex(("motor" + std::to_string(m + 1) + "_deg").c_str());
+   }
+
+   if (csvPath != NULL)
+   {
+      csv = fopen(csvPath, "w");
+      if (csv == NULL)
+      {
+         perror(csvPath);
+         return 2;
+      }
+      for (size_t f = 0; f < layout.names.size(); f++)
+      {
+         fprintf(csv, "%s%s", (f != 0) ? "," : "", layout.names[f].c_str());
+      }
+      fprintf(csv, "\n");
+      options.csv = true;
+   }
+   if (columnDir != NULL)
+   {
+      for (size_t f = 0; f < layout.names.size(); f++)
+      {
+         const std::string path = std::string(columnDir) + "/" + layout.names[f] + ".i32";
+         FILE *file = fopen(path.c_str(), "wb");
+
+         if (file == NULL)
+         {
+            perror(path.c_str());
+            return 2;
+         }
+         columnFiles.push_back(file);
+      }
+      options.columns = true;
+   }
+
+   const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+   // chunk starts: the first frame after the header, then the first sync
+   // point past each nominal boundary; the last entry is the end
+   const size_t chunks = (logSize - headerEnd + CHUNK_BYTES - 1) / CHUNK_BYTES;
+   std::vector<size_t> starts(chunks + 1, logSize);
+   std::vector<std::thread> threads;
+
+   starts[0] = headerEnd;
+   for (unsigned int w = 0; w < workers; w++)
+   {
+      threads.push_back(std::thread([&starts, chunks, headerEnd, workers, w]()
+      {
+         for (size_t i = 1 + w; i < chunks; i += workers)
+         {
+            starts[i] = FindSync(headerEnd + i * CHUNK_BYTES);
+         }
+      }));
+   }
+   for (std::thread &thread : threads)
+   {
+      thread.join();
+   }
+   threads.clear();
+
+   // decode in parallel, a window of chunks ahead of the one being written
+   std::mutex lock;
+   std::condition_variable changed;
+   std::vector<std::unique_ptr<Chunk>> results(chunks);
+   const size_t window = workers * WINDOW_PER_WORKER;
+   size_t claimed = 0;
+   size_t written = 0;
+   const size_t page = sysconf(_SC_PAGESIZE);
+   size_t released = 0;
+   Stats total;
+   bool ok = true;
+
+   total.sessions = 1;
+   for (unsigned int w = 0; w < workers; w++)
+   {
+      threads.push_back(std::thread([&]()
+      {
+         for (;;)
+         {
+            std::unique_ptr<Chunk> chunk(new Chunk);
+            size_t i;
+            {
+               std::unique_lock<std::mutex> guard(lock);
+
+               changed.wait(guard, [&]() { return (claimed >= chunks) || (claimed < written + window); });
+               if (claimed >= chunks)
+               {
+                  return;
+               }
+               i = claimed++;
+            }
+            Decode(starts[i], starts[i + 1], options, *chunk);
+            {
+               std::lock_guard<std::mutex> guard(lock);
+
+               results[i] = std::move(chunk);
+            }
+            changed.notify_all();
+         }
+      }));
+   }
+
+   for (size_t i = 0; i < chunks; i++)
+   {
+      std::unique_ptr<Chunk> chunk;
+      {
+         std::unique_lock<std::mutex> guard(lock);
+
+         changed.wait(guard, [&]() { return results[i] != nullptr; });
+         chunk = std::move(results[i]);
+      }
+
+      if ((csv != NULL) && (fwrite(chunk->csv.data(), 1, chunk->csv.size(), csv) != chunk->csv.size()))
+      {
+         ok = false;
+      }
+      if (options.columns && !WriteColumns(columnFiles, chunk->columns))
+      {
+         ok = false;
+      }
+      total.Merge(chunk->stats);
+      chunk.reset();
+
+      // the pages before the next chunk are done with
+      const size_t release = starts[i + 1] / page * page;
+
+      if (release > released)
+      {
+         madvise((void *)(logData + released), release - released, MADV_DONTNEED);
+         released = release;
+      }
+      {
+         std::lock_guard<std::mutex> guard(lock);
+
+         written = i + 1;
+      }
+      changed.notify_all();
+   }
+   for (std::thread &thread : threads)
+   {
+      thread.join();
+   }
+
+   if ((csv != NULL) && (fclose(csv) != 0))
+   {
+      ok = false;
+   }
+   for (FILE *file : columnFiles)
+   {
+      ok = (fclose(file) == 0) && ok;
+   }
+   munmap((void *)logData, logSize);
+
+   Report(total, std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count(), workers);
+   if (!ok)
+   {
+      fprintf(stderr, "write failed\n");
+      return 2;
+   }
+   return 0;
+}
@@ -0,0 +1,203 @@
+// Build-time compressor for the DMP firmware image.
+//
+// Reads the dmpMemory[] array out of MPU6050_6Axis_MotionApps20.h, run length
+// codes it for DmpRleStream and writes MPU6050_DMPPacked.h. The output is
+// decoded again with DmpRleStream and compared before anything is written.
+//
+// usage: dmp_compress <MPU6050_6Axis_MotionApps20.h> <MPU6050_DMPPacked.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DmpStream.h"
+
+namespace
+{
+
+const char *const ARRAY_NAME = "dmpMemory";
+const int BYTES_PER_LINE = 16;
+
+// Pulls the hex bytes of "const unsigned char <name>[...] PROGMEM = { ... };"
+bool ExtractArray(const std::string &source, const std::string &name,
+                  std::vector<uint8_t> &bytes)
+{
+   size_t start = source.find("const unsigned char " + name + "[");
+   size_t open;
+   size_t close;
+
+   if (start == std::string::npos)
+   {
+      return false;
+   }
+   open = source.find('{', start);
+   close = source.find("};", open);
+   if ((open == std::string::npos) || (close == std::string::npos))
+   {
+      return false;
+   }
+
+   for (size_t i = open; i < close; i++)
+   {
+      // skip line comments, they hold bank labels and notes
+      if ((source[i] == '/') && (source[i + 1] == '/'))
+      {
+         i = source.find('\n', i);
+         continue;
+      }
+      if ((source[i] == '0') && ((source[i + 1] == 'x') || (source[i + 1] == 'X')))
+      {
+         bytes.push_back((uint8_t)std::strtoul(source.c_str() + i, NULL, 16));
+         i += 3;
+      }
+   }
+   return true;
+}
+
+std::vector<uint8_t> Compress(const std::vector<uint8_t> &data)
+{
+   std::vector<uint8_t> packed;
+   std::vector<uint8_t> literal;
+   size_t i = 0;
+
+   while (i < data.size())
+   {
+      size_t run = 1;
+      bool zeros = (data[i] == 0);
+
+      while ((i + run < data.size()) && (data[i + run] == data[i]))
+      {
+         run++;
+      }
+
+      // two zeros already pay for a token; other values need three
+      if ((zeros && (run >= 2)) || (!zeros && (run >= DMP_RLE_REPEAT_MIN)) ||
+          (literal.size() == DMP_RLE_LITERAL_MAX))
+      {
+         if (!literal.empty())
+         {
+            packed.push_back(DMP_RLE_LITERAL + literal.size() - 1);
+            packed.insert(packed.end(), literal.begin(), literal.end());
+            literal.clear();
+         }
+      }
+
+      if (zeros && (run >= 2))
+      {
+         run = (run > DMP_RLE_ZEROS_MAX) ? DMP_RLE_ZEROS_MAX : run;
+         packed.push_back(DMP_RLE_ZEROS + run - 1);
+         i += run;
+      }
+      else if (!zeros && (run >= DMP_RLE_REPEAT_MIN))
+      {
+         run = (run > DMP_RLE_REPEAT_MAX) ? DMP_RLE_REPEAT_MAX : run;
+         packed.push_back(DMP_RLE_REPEAT + run - DMP_RLE_REPEAT_MIN);
+         packed.push_back(data[i]);
+         i += run;
+      }
+      else
+      {
+         literal.push_back(data[i]);
+         i++;
+      }
+   }
+
+   if (!literal.empty())
+   {
+      packed.push_back(DMP_RLE_LITERAL + literal.size() - 1);
+      packed.insert(packed.end(), literal.begin(), literal.end());
+   }
+
+   return packed;
+}
+
+bool WriteHeader(const char *path, const std::vector<uint8_t> &packed, const size_t size)
+{
+   FILE *file = std::fopen(path, "w");
+
+   if (file == NULL)
+   {
+      std::perror(path);
+      return false;
+   }
+
+   std::fprintf(file,
+      "// Run length coded dmpMemory[] for DmpRleStream.\n"
+      "// Generated by host/dmp_compress from MPU6050_6Axis_MotionApps20.h, do not edit.\n"
+      "\n"
+      "#ifndef _MPU6050_DMPPACKED_H_\n"
+      "#define _MPU6050_DMPPACKED_H_\n"
+      "\n"
+      "#define MPU6050_DMP_PACKED_SIZE     %lu     // dmpMemoryPacked[], %lu bytes decoded\n"
+      "\n"
+      "const unsigned char dmpMemoryPacked[MPU6050_DMP_PACKED_SIZE] PROGMEM = {\n",
+      (unsigned long)packed.size(), (unsigned long)size);
+
+   for (size_t i = 0; i < packed.size(); i++)
+   {
+      std::fprintf(file, "%s0x%02X%s", (i % BYTES_PER_LINE == 0) ? "    " : "",
+                   packed[i], (i + 1 < packed.size()) ? "," : "");
+      std::fprintf(file, "%s", ((i % BYTES_PER_LINE == BYTES_PER_LINE - 1) ||
+                                (i + 1 == packed.size())) ? "\n" : " ");
+   }
+
+   std::fprintf(file, "};\n\n#endif /* _MPU6050_DMPPACKED_H_ */\n");
+   std::fclose(file);
+   return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+   std::vector<uint8_t> image;
+   std::vector<uint8_t> packed;
+   std::stringstream source;
+
+   if (argc != 3)
+   {
+      std::fprintf(stderr, "usage: dmp_compress <MPU6050_6Axis_MotionApps20.h> <output.h>\n");
+      return 1;
+   }
+
+   std::ifstream input(argv[1]);
+   if (!input)
+   {
+      std::perror(argv[1]);
+      return 1;
+   }
+   source << input.rdbuf();
+
+   if (!ExtractArray(source.str(), ARRAY_NAME, image) || image.empty())
+   {
+      std::fprintf(stderr, "%s: no %s[] found\n", argv[1], ARRAY_NAME);
+      return 1;
+   }
+
+   packed = Compress(image);
+
+   // the firmware decoder must give back the exact image
+   DmpRleStream stream(packed.data());
+   for (size_t i = 0; i < image.size(); i++)
+   {
+      if (stream.Read() != image[i])
+      {
+         std::fprintf(stderr, "round trip mismatch at byte %lu\n", (unsigned long)i);
+         return 1;
+      }
+   }
+
+   if (!WriteHeader(argv[2], packed, image.size()))
+   {
+      return 1;
+   }
+
+   std::printf("%s: %lu -> %lu bytes (%.1f%%)\n", ARRAY_NAME,
+               (unsigned long)image.size(), (unsigned long)packed.size(),
+               100.0 * packed.size() / image.size());
+   return 0;
+}
@@ -0,0 +1,76 @@
+// Bus errors reported by the Fastwire build of I2Cdev.
+//
+// Runs I2Cdev::readBytes through Fastwire against the TWI model and checks
+// that a clean read succeeds, then that a bad TWI status in the middle of
+// the data bytes fails the read with I2CDEV_ERR_BUS whatever its value,
+// including TW_BUS_ERROR (0x00) and the START codes that share values with
+// Fastwire's step numbers.
+//
+// usage: fastwire_errors
+
+#include <cstdio>
+#include <cstring>
+
+#include "I2Cdev.h"
+
+#if I2CDEV_IMPLEMENTATION != I2CDEV_BUILTIN_FASTWIRE
+#error "build with ARDUINO defined and -include twi_model.h"
+#endif
+
+namespace
+{
+
+const uint8_t DEVICE = 0x68;
+const uint8_t REGISTER = 0x3B;
+const uint8_t LENGTH = 6;
+const uint8_t FAIL_AT = 3;
+
+// status the TWI can report mid-read instead of a data ack or nack
+const uint8_t BAD_STATUS[] = {
+   TW_BUS_ERROR, TW_START, TW_REP_START, TW_MT_SLA_ACK, TW_MR_ARB_LOST, 0xF8
+};
+
+}
+
+int main()
+{
+   uint8_t data[LENGTH];
+   int8_t count;
+   int failures = 0;
+
+   TwiModel::Reset(DEVICE);
+   for (uint8_t i = 0; i < LENGTH; i++)
+   {
+      TwiModel::Registers()[REGISTER + i] = 0x10 + i;
+   }
+   Fastwire::setup(400, false);
+
+   count = I2Cdev::readBytes(DEVICE, REGISTER, LENGTH, data);
+   if ((count != LENGTH) || (I2Cdev::lastError != I2CDEV_OK) ||
+       (data[0] != 0x10) || (data[LENGTH - 1] != 0x10 + LENGTH - 1))
+   {
+      printf("FAIL: clean read returned %d, error %d\n", count, I2Cdev::lastError);
+      return 1;
+   }
+   printf("PASS clean read\n");
+
+   for (const uint8_t status : BAD_STATUS)
+   {
+      memset(data, 0, sizeof(data));
+      TwiModel::FailReadByte(FAIL_AT, status);
+      count = I2Cdev::readBytes(DEVICE, REGISTER, LENGTH, data);
+      if ((count == LENGTH) || (I2Cdev::lastError != I2CDEV_ERR_BUS))
+      {
+         printf("FAIL status 0x%02X at byte %u: read returned %d, error %d\n",
+                status, FAIL_AT, count, I2Cdev::lastError);
+         failures++;
+      }
+      else
+      {
+         printf("PASS status 0x%02X at byte %u\n", status, FAIL_AT);
+      }
+      // the driver does not STOP after a failed read; the next START repeats
+   }
+
+   return (failures == 0) ? 0 : 1;
+}
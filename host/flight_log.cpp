@@ -0,0 +1,186 @@
+// Flight log writer and memory mapped reader, see flight_log.h.
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flight_log.h"
+
+static_assert(sizeof(FlightLogHeader) == 16, "header layout");
+static_assert(sizeof(FlightLogRecord) == 56, "record layout");
+
+static const char FLIGHT_LOG_MAGIC[8] = "QUADLOG";
+
+FlightLogWriter::FlightLogWriter() :
+   mFile(NULL),
+   mFailed(false)
+{
+}
+
+FlightLogWriter::~FlightLogWriter()
+{
+   Close();
+}
+
+bool FlightLogWriter::Open(const char *path)
+{
+   FlightLogHeader header;
+
+   Close();
+   mFile = fopen(path, "wb");
+   if (mFile == NULL)
+   {
+      return false;
+   }
+   mFailed = false;
+
+   memcpy(header.magic, FLIGHT_LOG_MAGIC, sizeof(header.magic));
+   header.version = FLIGHT_LOG_VERSION;
+   header.recordSize = sizeof(FlightLogRecord);
+   mFailed = (fwrite(&header, sizeof(header), 1, mFile) != 1);
+   return !mFailed;
+}
+
+bool FlightLogWriter::Close()
+{
+   bool ok = !mFailed;
+
+   if (mFile != NULL)
+   {
+      ok = (fclose(mFile) == 0) && ok;
+      mFile = NULL;
+   }
+   return ok;
+}
+
+void FlightLogWriter::Edge(const uint64_t timeUs, const uint8_t pin, const uint8_t level)
+{
+   FlightLogRecord record;
+
+   memset(&record, 0, sizeof(record));
+   record.timeUs = timeUs;
+   record.type = FLIGHT_LOG_EDGE;
+   record.pin = pin;
+   record.level = level;
+   Write(record);
+}
+
+void FlightLogWriter::Packet(const uint64_t timeUs, const uint8_t *packet, const uint8_t length)
+{
+   FlightLogRecord record;
+
+   memset(&record, 0, sizeof(record));
+   record.timeUs = timeUs;
+   record.type = FLIGHT_LOG_PACKET;
+   memcpy(record.data, packet, (length < sizeof(record.data)) ? length : sizeof(record.data));
+   Write(record);
+}
+
+void FlightLogWriter::Pass(const uint64_t timeUs, const uint8_t motors[FLIGHT_LOG_MOTORS])
+{
+   FlightLogRecord record;
+
+   memset(&record, 0, sizeof(record));
+   record.timeUs = timeUs;
+   record.type = FLIGHT_LOG_PASS;
+   memcpy(record.data, motors, FLIGHT_LOG_MOTORS);
+   Write(record);
+}
+
+void FlightLogWriter::Write(const FlightLogRecord &record)
+{
+   if ((mFile != NULL) && (fwrite(&record, sizeof(record), 1, mFile) != 1))
+   {
+      mFailed = true;
+   }
+}
+
+FlightLogReader::FlightLogReader() :
+   mMap(NULL),
+   mMapSize(0),
+   mRecords(NULL),
+   mCount(0),
+   mReleased(0)
+{
+}
+
+FlightLogReader::~FlightLogReader()
+{
+   Unmap();
+}
+
+bool FlightLogReader::Open(const char *path)
+{
+   const FlightLogHeader *header;
+   struct stat info;
+   int fd;
+
+   Unmap();
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+   {
+      perror(path);
+      return false;
+   }
+   if ((fstat(fd, &info) != 0) || ((size_t)info.st_size < sizeof(FlightLogHeader)))
+   {
+      fprintf(stderr, "%s: not a flight log\n", path);
+      close(fd);
+      return false;
+   }
+
+   // the mapping holds its own reference to the file
+   mMapSize = info.st_size;
+   mMap = (uint8_t *)mmap(NULL, mMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (mMap == MAP_FAILED)
+   {
+      mMap = NULL;
+      perror(path);
+      return false;
+   }
+   madvise(mMap, mMapSize, MADV_SEQUENTIAL);
+
+   header = (const FlightLogHeader *)mMap;
+   if ((memcmp(header->magic, FLIGHT_LOG_MAGIC, sizeof(header->magic)) != 0) ||
+       (header->version != FLIGHT_LOG_VERSION) || (header->recordSize != sizeof(FlightLogRecord)))
+   {
+      fprintf(stderr, "%s: not a version %u flight log\n", path, FLIGHT_LOG_VERSION);
+      Unmap();
+      return false;
+   }
+
+   // a partial last record (a log cut short) is ignored
+   mRecords = (const FlightLogRecord *)(mMap + sizeof(FlightLogHeader));
+   mCount = (mMapSize - sizeof(FlightLogHeader)) / sizeof(FlightLogRecord);
+   mReleased = 0;
+   return true;
+}
+
+void FlightLogReader::Release(const size_t index)
+{
+   const size_t page = sysconf(_SC_PAGESIZE);
+   const size_t end = (sizeof(FlightLogHeader) + index * sizeof(FlightLogRecord)) / page * page;
+
+   if ((mMap != NULL) && (end > mReleased))
+   {
+      madvise(mMap + mReleased, end - mReleased, MADV_DONTNEED);
+      mReleased = end;
+   }
+}
+
+void FlightLogReader::Unmap()
+{
+   if (mMap != NULL)
+   {
+      munmap(mMap, mMapSize);
+   }
+   mMap = NULL;
+   mMapSize = 0;
+   mRecords = NULL;
+   mCount = 0;
+   mReleased = 0;
+}
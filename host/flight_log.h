@@ -0,0 +1,98 @@
+// Flight log of the control stack's inputs and outputs, for replay.
+//
+// A 16 byte header then fixed size records in the order things happened:
+//   EDGE    a receiver pin changed level (the Receiver ISRs' input)
+//   PACKET  the DMP queued a 42 byte FIFO packet (IMU::ReadIMU's input)
+//   PASS    loop() ran at timeUs, with the motor angles it left written
+// Times are 64 bit microseconds, so hours of flight do not wrap. Fields are in
+// host byte order (little endian on every supported host).
+//
+// Fixed size records keep the reader a plain index into a memory map: a log
+// is streamed through the page cache and the pages behind the replay are
+// dropped, so logs of any length replay in bounded memory.
+
+#ifndef HOST_FLIGHT_LOG_H
+#define HOST_FLIGHT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+const uint32_t FLIGHT_LOG_VERSION = 1;
+const int FLIGHT_LOG_MOTORS = 4;
+
+enum FlightLogType
+{
+   FLIGHT_LOG_EDGE   = 1,
+   FLIGHT_LOG_PACKET = 2,
+   FLIGHT_LOG_PASS   = 3
+};
+
+typedef struct
+{
+   char magic[8];             // "QUADLOG\0"
+   uint32_t version;
+   uint32_t recordSize;
+} FlightLogHeader;
+
+typedef struct
+{
+   uint64_t timeUs;
+   uint8_t type;              // FlightLogType
+   uint8_t pin;               // EDGE: receiver pin
+   uint8_t level;             // EDGE: level after the edge
+   uint8_t reserved;
+   uint8_t data[44];          // PACKET: the packet; PASS: motor angles 1-4
+} FlightLogRecord;
+
+class FlightLogWriter
+{
+ public:
+   FlightLogWriter();
+   ~FlightLogWriter();
+
+   // Creates path and writes the header; false on error
+   bool Open(const char *path);
+
+   // Flushes and closes; false if any write failed
+   bool Close();
+
+   void Edge(const uint64_t timeUs, const uint8_t pin, const uint8_t level);
+   void Packet(const uint64_t timeUs, const uint8_t *packet, const uint8_t length);
+   void Pass(const uint64_t timeUs, const uint8_t motors[FLIGHT_LOG_MOTORS]);
+
+ private:
+   void Write(const FlightLogRecord &record);
+
+   FILE *mFile;
+   bool mFailed;
+};
+
+class FlightLogReader
+{
+ public:
+   FlightLogReader();
+   ~FlightLogReader();
+
+   // Maps path and checks its header; prints the reason and returns false
+   // if it is not a log this reader understands
+   bool Open(const char *path);
+
+   inline size_t GetCount() const { return mCount; }
+   inline const FlightLogRecord &operator[](const size_t index) const { return mRecords[index]; }
+
+   // Drops the mapped pages wholly before record index; they are read back
+   // from the file if touched again
+   void Release(const size_t index);
+
+ private:
+   void Unmap();
+
+   uint8_t *mMap;
+   size_t mMapSize;
+   const FlightLogRecord *mRecords;
+   size_t mCount;
+   size_t mReleased;          // bytes of the map already dropped
+};
+
+#endif /* HOST_FLIGHT_LOG_H */
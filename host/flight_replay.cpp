@@ -0,0 +1,227 @@
+// Deterministic replay of a flight log through the control stack.
+//
+// The sketch runs as in quad_sil, but its inputs come from the log instead of
+// a simulation: receiver edges drive the Receiver ISRs, and DMP packets are
+// queued on the MPU6050 model (its own DMP output off) for IMU::ReadIMU, each
+// at its logged time. loop() runs at each logged pass time, or straight away
+// if the code under replay is still busy with the last pass. setup() runs
+// first, against the model, as in flight.
+//
+// After every pass the motor angles left by the mixer are compared with the
+// logged ones; replaying a log with the code that recorded it reproduces them
+// exactly. -o writes the motor commands, one line per change, for diffing
+// replays of the same log across code versions.
+//
+// The log is read through a memory map from start to end; the pages behind
+// both the input and the pass cursors are dropped as the replay moves on.
+//
+// usage: flight_replay [-o motors.csv] [-p|-r|-y kp,ki,kd] [-v] flight.log
+//   -p, -r, -y  pitch, roll and yaw gains in place of pid.h's, as the log
+//       was flown with (quad_sil -p/-r/-y)
+//   -v  shows the sketch's serial output
+//
+// Exits 1 if any pass differs from the log.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "EnableInterrupt.h"
+#include "SoftwareServo.h"
+#include "pinmap.h"
+#include "flight_log.h"
+#include "mpu6050_model.h"
+#include "sil_sketch.h"
+
+extern "C"
+{
+#include "pid.h"
+}
+
+namespace
+{
+
+const uint8_t MOTOR_PINS[FLIGHT_LOG_MOTORS] = { MOTOR_1_PIN, MOTOR_2_PIN, MOTOR_3_PIN, MOTOR_4_PIN };
+
+// passes between releases of the pages already replayed
+const size_t RELEASE_PASSES = 16384;
+
+FlightLogReader flightLog;
+Mpu6050Model sensor(IMU_INT_PIN);
+
+size_t nextInput = 0;         // next receiver edge or DMP packet record
+
+// Parses "kp,ki,kd"
+bool ParseGains(const char *arg, PidGains &gains)
+{
+   return sscanf(arg, "%f,%f,%f", &gains.kp, &gains.ki, &gains.kd) == 3;
+}
+
+// Next input record at or after index
+size_t FindInput(size_t index)
+{
+   while ((index < flightLog.GetCount()) && (flightLog[index].type == FLIGHT_LOG_PASS))
+   {
+      index++;
+   }
+   return index;
+}
+
+// Host timer: applies the inputs due, in logged order
+unsigned long Inputs(const unsigned long now)
+{
+   while ((nextInput < flightLog.GetCount()) && (flightLog[nextInput].timeUs <= now))
+   {
+      const FlightLogRecord &record = flightLog[nextInput];
+
+      if (record.type == FLIGHT_LOG_EDGE)
+      {
+         HostDrivePin(record.pin, record.level);
+      }
+      else if (record.type == FLIGHT_LOG_PACKET)
+      {
+         sensor.QueuePacket(record.data);
+      }
+      nextInput = FindInput(nextInput + 1);
+   }
+
+   // nothing left: never again
+   return (nextInput < flightLog.GetCount()) ? flightLog[nextInput].timeUs : (unsigned long)-1;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   FILE *out = NULL;
+   bool verbose = false;
+   uint8_t last[FLIGHT_LOG_MOTORS] = { 0, 0, 0, 0 };
+   unsigned long passes = 0;
+   unsigned long late = 0;
+   unsigned long mismatches = 0;
+   unsigned long long firstMismatch = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "o:p:r:vy:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'o':
+            out = fopen(optarg, "w");
+            if (out == NULL)
+            {
+               perror(optarg);
+               return 2;
+            }
+            break;
+         case 'p':
+         case 'r':
+         case 'y':
+            if (!ParseGains(optarg, (opt == 'p') ? pidPitchGains : (opt == 'r') ? pidRollGains : pidYawGains))
+            {
+               fprintf(stderr, "bad gains '%s', expected kp,ki,kd\n", optarg);
+               return 2;
+            }
+            break;
+         case 'v':
+            verbose = true;
+            break;
+         default:
+            optind = argc;
+            break;
+      }
+   }
+   if (optind != argc - 1)
+   {
+      fprintf(stderr, "usage: %s [-o motors.csv] [-p|-r|-y kp,ki,kd] [-v] flight.log\n", argv[0]);
+      return 2;
+   }
+   if (!flightLog.Open(argv[optind]))
+   {
+      return 2;
+   }
+
+   const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+   HostSerialMute(!verbose);
+   I2Cdev::hostBus = &sensor;
+   sensor.SetExternalPackets(true);
+
+   nextInput = FindInput(0);
+   if (nextInput < flightLog.GetCount())
+   {
+      HostSetTimer(Inputs, flightLog[nextInput].timeUs);
+   }
+
+   setup();
+
+   if (out != NULL)
+   {
+      fprintf(out, "t_us,m1,m2,m3,m4\n");
+   }
+
+   for (size_t i = 0; i < flightLog.GetCount(); i++)
+   {
+      const FlightLogRecord &record = flightLog[i];
+      uint8_t motors[FLIGHT_LOG_MOTORS];
+
+      if (record.type != FLIGHT_LOG_PASS)
+      {
+         continue;
+      }
+
+      if (micros() < record.timeUs)
+      {
+         HostAdvanceMicros(record.timeUs - micros());
+      }
+      else if (micros() > record.timeUs)
+      {
+         late++;
+      }
+      loop();
+      passes++;
+
+      for (int m = 0; m < FLIGHT_LOG_MOTORS; m++)
+      {
+         motors[m] = HostServoAngle(MOTOR_PINS[m]);
+      }
+      if (memcmp(motors, record.data, FLIGHT_LOG_MOTORS) != 0)
+      {
+         if (mismatches == 0)
+         {
+            firstMismatch = record.timeUs;
+         }
+         mismatches++;
+      }
+      if ((out != NULL) && ((passes == 1) || (memcmp(motors, last, FLIGHT_LOG_MOTORS) != 0)))
+      {
+         fprintf(out, "%llu,%u,%u,%u,%u\n", (unsigned long long)record.timeUs,
+                 motors[0], motors[1], motors[2], motors[3]);
+      }
+      memcpy(last, motors, FLIGHT_LOG_MOTORS);
+
+      if (passes % RELEASE_PASSES == 0)
+      {
+         flightLog.Release((i < nextInput) ? i : nextInput);
+      }
+   }
+   HostSetTimer(NULL, 0);
+
+   const double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+   if (out != NULL)
+   {
+      fclose(out);
+   }
+
+   printf("%zu records, %lu passes in %.2f s wall (%.0f passes/s), %lu late\n",
+          flightLog.GetCount(), passes, wallS, passes / wallS, late);
+   if (mismatches != 0)
+   {
+      printf("%lu passes differ from the log, first at %.6f s\n", mismatches, firstMismatch * 1e-6);
+      return 1;
+   }
+   printf("motor commands identical to the log\n");
+   return 0;
+}
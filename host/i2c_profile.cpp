@@ -0,0 +1,154 @@
+// I2C transaction profile of the MPU6050 DMP bring-up.
+//
+// Runs MPU6050::initialize() and dmpInitialize() (cold boot), then
+// dmpWarmInitialize() (warm boot), against a register file that stands in
+// for the sensor and charges 400 kHz bus time for every transfer. Prints the
+// I2Cdev profile of each phase: transfers, bytes and time per register.
+// Build with different MPU6050_DMP_* and I2CDEV_SHADOW_CACHE settings to
+// compare upload and read-modify-write optimizations.
+//
+// usage: i2c_profile
+
+#include <cstdio>
+#include <cstring>
+
+#include "MPU6050_6Axis_MotionApps20.h"
+
+#if I2CDEV_PROFILE != 1
+#error "build with -DI2CDEV_PROFILE=1"
+#endif
+
+namespace
+{
+
+const uint8_t RA_FIFO_COUNTH = 0x72;
+const uint8_t RA_FIFO_COUNTL = 0x73;
+const uint8_t RA_BANK_SEL    = 0x6D;
+const uint8_t RA_MEM_START   = 0x6E;
+const uint8_t RA_MEM_R_W     = 0x6F;
+const uint8_t RA_USER_CTRL   = 0x6A;
+const uint8_t RA_PWR_MGMT_1  = 0x6B;
+const uint8_t RA_WHO_AM_I    = 0x75;
+
+// 400 kHz: 2.5 us per bit, 9 bits per byte with ACK, plus START and STOP
+unsigned long BusMicros(const unsigned bytes)
+{
+   return (unsigned long)((bytes * 9 + 2) * 2.5);
+}
+
+// Flat register file with DMP memory banks. The FIFO always reports one
+// packet so the bring-up never waits.
+class RegisterBus : public I2CdevHostBus
+{
+ public:
+   RegisterBus()
+   {
+      memset(mRegs, 0, sizeof(mRegs));
+      memset(mMem, 0, sizeof(mMem));
+      PowerOn();
+   }
+
+   I2CdevError read(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint8_t length)
+   {
+      (void)devAddr;
+      // address, register, repeated start, address, data
+      HostAdvanceMicros(BusMicros(3 + length) + 2);
+      for (uint8_t i = 0; i < length; i++)
+      {
+         const uint8_t reg = regAddr + i;
+         if (regAddr == RA_MEM_R_W)
+         {
+            data[i] = mMem[mRegs[RA_BANK_SEL] & 7][mRegs[RA_MEM_START]++];
+         }
+         else if (reg == RA_FIFO_COUNTH)
+         {
+            data[i] = 0;
+         }
+         else if (reg == RA_FIFO_COUNTL)
+         {
+            data[i] = 42;
+         }
+         else
+         {
+            data[i] = mRegs[reg & 0x7F];
+         }
+      }
+      return I2CDEV_OK;
+   }
+
+   I2CdevError write(uint8_t devAddr, uint8_t regAddr, const uint8_t *data, uint8_t length)
+   {
+      (void)devAddr;
+      HostAdvanceMicros(BusMicros(2 + length));
+      for (uint8_t i = 0; i < length; i++)
+      {
+         const uint8_t reg = regAddr + i;
+         if (regAddr == RA_MEM_R_W)
+         {
+            mMem[mRegs[RA_BANK_SEL] & 7][mRegs[RA_MEM_START]++] = data[i];
+         }
+         else if ((reg == RA_PWR_MGMT_1) && (data[i] & 0x80))
+         {
+            PowerOn();
+         }
+         else if (reg == RA_USER_CTRL)
+         {
+            mRegs[reg] = data[i] & ~0x0F; // reset strobes self-clear
+         }
+         else
+         {
+            mRegs[reg & 0x7F] = data[i];
+         }
+      }
+      return I2CDEV_OK;
+   }
+
+ private:
+   // register defaults after power on or DEVICE_RESET, memory is kept
+   void PowerOn()
+   {
+      memset(mRegs, 0, sizeof(mRegs));
+      mRegs[RA_PWR_MGMT_1] = 0x40;
+      mRegs[RA_WHO_AM_I] = 0x68;
+   }
+
+   uint8_t mRegs[128];
+   uint8_t mMem[8][256];
+};
+
+void Phase(const char *name)
+{
+   printf("\n%s\n", name);
+   I2Cdev::profileDump();
+   I2Cdev::profileReset();
+}
+
+}
+
+int main()
+{
+   RegisterBus bus;
+   MPU6050 mpu;
+   uint8_t status;
+   unsigned long start;
+
+   I2Cdev::hostBus = &bus;
+
+   printf("fast upload %d, compressed image %d, shadow cache %d\n",
+          MPU6050_DMP_FAST_UPLOAD, MPU6050_DMP_COMPRESSED, I2CDEV_SHADOW_CACHE);
+
+   I2Cdev::profileReset();
+   start = micros();
+   mpu.initialize();
+   status = mpu.dmpInitialize();
+   mpu.setDMPEnabled(true);
+   printf("\ncold boot: status %u, %lu us (including sensor delays)\n", status, micros() - start);
+   Phase("cold boot profile");
+
+   start = micros();
+   status = mpu.dmpWarmInitialize();
+   printf("warm boot: status %u, %lu us\n", status, micros() - start);
+   Phase("warm boot profile");
+
+   return 0;
+}
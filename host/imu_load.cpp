@@ -0,0 +1,256 @@
+// Load test of IMU::SetupIMU and IMU::ReadIMU against the MPU6050 model.
+//
+// The sensor follows a scripted attitude (yaw, pitch and roll sweeping at
+// different rates). One simulated timeline runs three phases:
+//   track  - ReadIMU polled every 250 us
+//   load   - 0 to 15 ms of other work between ReadIMU calls
+//   stall  - one 400 ms stall, long enough to overflow the FIFO, then polling
+// Each reading is compared with the script at the reported sample time.
+// Fails on attitude errors, missing samples, an undetected overflow or no
+// recovery after it. Only the DMP attitude is held to these checks; Mahony
+// estimates are reported for comparison.
+//
+// usage: imu_load
+
+#include <cmath>
+#include <cstdio>
+
+#include "IMU.h"
+#include "pinmap.h"
+#include "mpu6050_model.h"
+
+namespace
+{
+
+const unsigned long POLL_US = 250;
+
+// interrupts are delivered at this resolution while the loop is busy
+const unsigned long BUSY_STEP_US = 50;
+
+const unsigned long PHASE_US = 5000000UL;
+const unsigned long LOAD_MAX_US = 15000;
+const unsigned long STALL_US = 400000UL;
+
+// largest acceptable attitude error (degrees)
+const float MAX_ERROR_DEG = 0.25;
+
+// readings come straight from DMP packets
+const bool DMP_ONLY = (IMU_ATTITUDE == IMU_ATTITUDE_DMP);
+
+// time step of the numeric body rate derivative (us)
+const unsigned long RATE_STEP_US = 100;
+
+const float DEG_TO_RAD = M_PI / 180.0;
+
+// Sensor sweeping yaw, pitch and roll sinusoidally
+class ScriptedMotion : public Mpu6050Motion
+{
+ public:
+   void Sample(const unsigned long timeUs, Quaternion &attitude, VectorFloat &rate)
+   {
+      Quaternion delta;
+
+      attitude = Attitude(timeUs);
+
+      // body rate from the rotation over a short step, q' = q * dq
+      delta = attitude.getConjugate().getProduct(Attitude(timeUs + RATE_STEP_US));
+      rate.x = 2.0 * delta.x / (RATE_STEP_US * 1e-6);
+      rate.y = 2.0 * delta.y / (RATE_STEP_US * 1e-6);
+      rate.z = 2.0 * delta.z / (RATE_STEP_US * 1e-6);
+   }
+
+   static Quaternion Attitude(const unsigned long timeUs)
+   {
+      const double t = timeUs * 1e-6;
+      const double yaw = 60.0 * DEG_TO_RAD * sin(2 * M_PI * 0.1 * t);
+      const double pitch = 30.0 * DEG_TO_RAD * sin(2 * M_PI * 0.5 * t);
+      const double roll = 20.0 * DEG_TO_RAD * sin(2 * M_PI * 0.3 * t + 1.0);
+      Quaternion qz(cos(yaw / 2), 0, 0, sin(yaw / 2));
+      Quaternion qy(cos(pitch / 2), 0, sin(pitch / 2), 0);
+      Quaternion qx(cos(roll / 2), sin(roll / 2), 0, 0);
+
+      return qz.getProduct(qy).getProduct(qx);
+   }
+};
+
+// What IMU::ReadIMU should report for attitude q (MPU6050::dmpGetGravity,
+// dmpGetYawPitchRoll and the quadcopter axis mapping)
+void Expected(const Quaternion &q, float &yaw, float &pitch, float &roll)
+{
+   const float gx = 2 * (q.x * q.z - q.w * q.y);
+   const float gy = 2 * (q.w * q.x + q.y * q.z);
+   const float gz = q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z;
+
+   yaw = atan2(2 * q.x * q.y - 2 * q.w * q.z, 2 * q.w * q.w + 2 * q.x * q.x - 1) / DEG_TO_RAD;
+   pitch = atan(gy / sqrt(gx * gx + gz * gz)) / DEG_TO_RAD;
+   roll = atan(gx / sqrt(gy * gy + gz * gz)) / DEG_TO_RAD;
+}
+
+float AngleError(const float a, const float b)
+{
+   float error = fmod(fabs(a - b), 360.0);
+
+   return (error > 180.0) ? 360.0 - error : error;
+}
+
+struct PhaseStats
+{
+   const char *name;
+   unsigned long samples;
+   unsigned long packets;
+   unsigned int overflows;
+   unsigned int drained;
+   float maxError;
+   double latencyUs;
+   unsigned long maxLatencyUs;
+};
+
+// Moves time on by us with the sensor (and its interrupts) kept current
+void Busy(Mpu6050Model &sensor, unsigned long us)
+{
+   while (us > 0)
+   {
+      const unsigned long step = (us < BUSY_STEP_US) ? us : BUSY_STEP_US;
+
+      HostAdvanceMicros(step);
+      sensor.Update();
+      us -= step;
+   }
+}
+
+// Deterministic pseudo random work time
+unsigned long WorkTime(uint32_t &seed)
+{
+   seed = seed * 1664525UL + 1013904223UL;
+   return (seed >> 8) % LOAD_MAX_US;
+}
+
+void RunPhase(IMU &imu, Mpu6050Model &sensor, PhaseStats &stats,
+              const unsigned long stallAfterUs, const bool load)
+{
+   const ImuStatus &status = imu.GetStatus();
+   const unsigned long start = micros();
+   const unsigned long packets = sensor.GetPacketCount();
+   const unsigned int overflows = status.overflowCount;
+   const unsigned int drained = status.drainedCount;
+   bool stalled = false;
+   uint32_t seed = 1;
+   float yaw, pitch, roll;
+   float yawRate, pitchRate, rollRate;
+   float expYaw, expPitch, expRoll;
+   float error;
+   unsigned long sampleTime;
+   unsigned long latency;
+
+   stats.samples = 0;
+   stats.maxError = 0;
+   stats.latencyUs = 0;
+   stats.maxLatencyUs = 0;
+
+   while (micros() - start < PHASE_US)
+   {
+      if (!stalled && (micros() - start >= stallAfterUs))
+      {
+         Busy(sensor, STALL_US);
+         stalled = true;
+      }
+      Busy(sensor, load ? WorkTime(seed) : POLL_US);
+
+      if (!imu.ReadIMU(yaw, pitch, roll, yawRate, pitchRate, rollRate, sampleTime))
+      {
+         continue;
+      }
+
+      Expected(ScriptedMotion::Attitude(sampleTime), expYaw, expPitch, expRoll);
+      error = AngleError(yaw, expYaw);
+      error = fmax(error, AngleError(pitch, expPitch));
+      error = fmax(error, AngleError(roll, expRoll));
+      stats.maxError = fmax(stats.maxError, error);
+
+      latency = micros() - sampleTime;
+      stats.latencyUs += latency;
+      if (latency > stats.maxLatencyUs)
+      {
+         stats.maxLatencyUs = latency;
+      }
+      stats.samples++;
+   }
+
+   stats.packets = sensor.GetPacketCount() - packets;
+   stats.overflows = status.overflowCount - overflows;
+   stats.drained = status.drainedCount - drained;
+   if (stats.samples > 0)
+   {
+      stats.latencyUs /= stats.samples;
+   }
+}
+
+}
+
+int main()
+{
+   Mpu6050Model sensor(IMU_INT_PIN);
+   ScriptedMotion motion;
+   IMU imu;
+   PhaseStats phases[3] = { { "track" }, { "load" }, { "stall" } };
+   int failures = 0;
+
+   I2Cdev::hostBus = &sensor;
+   sensor.SetMotion(&motion);
+   imu.SetupIMU();
+
+   RunPhase(imu, sensor, phases[0], PHASE_US, false);
+   RunPhase(imu, sensor, phases[1], PHASE_US, true);
+   RunPhase(imu, sensor, phases[2], PHASE_US / 2, false);
+
+   printf("\nfast path %d, drain %d\n", IMU_FIFO_FAST_PATH, IMU_FIFO_DRAIN);
+   printf("phase,samples,packets,overflows,drained,max_error_deg,mean_latency_us,max_latency_us\n");
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      const PhaseStats &p = phases[i];
+
+      printf("%s,%lu,%lu,%u,%u,%.3f,%.0f,%lu\n", p.name, p.samples, p.packets,
+             p.overflows, p.drained, p.maxError, p.latencyUs, p.maxLatencyUs);
+      if (DMP_ONLY && (p.maxError > MAX_ERROR_DEG))
+      {
+         printf("FAIL: %s attitude error %.3f deg\n", p.name, p.maxError);
+         failures++;
+      }
+   }
+
+   if (!DMP_ONLY)
+   {
+      return 0;
+   }
+
+   // polled every 250 us nothing may be dropped
+   if (phases[0].samples + 1 < phases[0].packets)
+   {
+      printf("FAIL: track read %lu of %lu packets\n", phases[0].samples, phases[0].packets);
+      failures++;
+   }
+   // under load every packet is read or drained
+   if (phases[1].samples + phases[1].drained + 1 < phases[1].packets)
+   {
+      printf("FAIL: load lost packets\n");
+      failures++;
+   }
+   if (phases[2].overflows == 0)
+   {
+      printf("FAIL: stall overflow not detected (%lu model overflows)\n", sensor.GetOverflowCount());
+      failures++;
+   }
+   // after the stall the second half of the phase reads at full rate again
+   if (phases[2].samples < phases[2].packets / 2)
+   {
+      printf("FAIL: no recovery after overflow\n");
+      failures++;
+   }
+   if (imu.GetStatus().busErrorCount != 0)
+   {
+      printf("FAIL: %u bus errors\n", imu.GetStatus().busErrorCount);
+      failures++;
+   }
+
+   return (failures == 0) ? 0 : 1;
+}
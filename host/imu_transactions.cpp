@@ -0,0 +1,90 @@
+// I2C transactions per attitude sample of IMU::ReadIMU.
+//
+// Brings the IMU up against the MPU6050 model, then polls ReadIMU every
+// 250 us of simulated time for a few seconds and prints the I2Cdev profile
+// of the steady state divided by the number of samples read. Fails when
+// IMU_FIFO_FAST_PATH needs more than a FIFO count read and a FIFO burst per
+// DMP packet.
+//
+// usage: imu_transactions [seconds]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "IMU.h"
+#include "pinmap.h"
+#include "mpu6050_model.h"
+
+#if I2CDEV_PROFILE != 1
+#error "build with -DI2CDEV_PROFILE=1"
+#endif
+
+namespace
+{
+
+const unsigned long POLL_US = 250;
+const unsigned FAST_PATH_TRANSFERS = 2;
+
+}
+
+int main(int argc, char **argv)
+{
+   Mpu6050Model sensor(IMU_INT_PIN);
+   IMU imu;
+   const unsigned long seconds = (argc > 1) ? strtoul(argv[1], NULL, 10) : 5;
+   const I2CdevProfileEntry *table;
+   uint8_t entries;
+   unsigned long samples = 0;
+   unsigned long transfers = 0;
+   unsigned long busUs = 0;
+   unsigned long start;
+   float yaw, pitch, roll;
+   float yawRate, pitchRate, rollRate;
+   unsigned long sampleTime;
+   double perSample;
+
+   I2Cdev::hostBus = &sensor;
+   imu.SetupIMU();
+
+   I2Cdev::profileReset();
+   start = micros();
+   while (micros() - start < seconds * 1000000UL)
+   {
+      HostAdvanceMicros(POLL_US);
+      sensor.Update();
+      if (imu.ReadIMU(yaw, pitch, roll, yawRate, pitchRate, rollRate, sampleTime))
+      {
+         samples++;
+      }
+   }
+
+   printf("\nfast path %d, drain %d\n", IMU_FIFO_FAST_PATH, IMU_FIFO_DRAIN);
+   printf("%lu samples of %lu packets in %lu s, %u overflows\n",
+          samples, sensor.GetPacketCount(), seconds, imu.GetStatus().overflowCount);
+   if (samples == 0)
+   {
+      printf("FAIL: no samples\n");
+      return 1;
+   }
+
+   printf("reg,dir,per_sample,us_per_sample\n");
+   table = I2Cdev::profileTable(&entries);
+   for (uint8_t i = 0; i < entries; i++)
+   {
+      transfers += table[i].count;
+      busUs += table[i].totalUs;
+      printf("0x%02X,%s,%.2f,%.1f\n", table[i].regAddr, table[i].write ? "w" : "r",
+             (double)table[i].count / samples, (double)table[i].totalUs / samples);
+   }
+   perSample = (double)transfers / samples;
+   printf("# %lu transfers, %.2f transfers and %.1f us bus time per sample\n",
+          transfers, perSample, (double)busUs / samples);
+
+   // one pass of slack for a packet still in flight when the run ends
+   if ((IMU_FIFO_FAST_PATH == 1) && (transfers > FAST_PATH_TRANSFERS * (samples + 1)))
+   {
+      printf("FAIL: more than %u transfers per sample\n", FAST_PATH_TRANSFERS);
+      return 1;
+   }
+   return 0;
+}
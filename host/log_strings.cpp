@@ -0,0 +1,249 @@
+// Extracts the sketch's log format strings (Log.h) into the table that
+// telemetry_decode formats log records from.
+//
+// Each LOG_DEBUG/INFO/WARN/ERROR site whose first argument is a string
+// literal (adjacent literals are joined) is found outside comments and
+// strings, and its id worked out with Log.h's own LogId(). Sites with the
+// same level and format share an id; two different ones that hash alike are
+// a collision, reported with both sites, and nothing is written. Reword one
+// of them.
+//
+// The table has a line per id:
+//   id (4 hex digits) TAB level TAB file:line TAB format
+// with backslash, tab and newline in the format escaped as in C.
+//
+// usage: log_strings [-o table] source...
+//   -o  writes the table there (default: stdout)
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "Log.h"
+
+namespace
+{
+
+const char *const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+struct Site
+{
+   uint8_t level;
+   std::string format;
+   std::string where;
+};
+
+// Reads the literal starting at s[pos] (the opening quote) into out, with
+// escapes resolved; returns the position after the closing quote
+size_t ReadLiteral(const std::string &s, size_t pos, std::string &out)
+{
+   for (pos++; (pos < s.size()) && (s[pos] != '"'); pos++)
+   {
+      if ((s[pos] != '\\') || (pos + 1 >= s.size()))
+      {
+         out += s[pos];
+         continue;
+      }
+      switch (s[++pos])
+      {
+         case 'n':  out += '\n'; break;
+         case 't':  out += '\t'; break;
+         case 'r':  out += '\r'; break;
+         case '0':  out += '\0'; break;
+         default:   out += s[pos]; break;
+      }
+   }
+   return pos + 1;
+}
+
+bool IsIdentifier(const char c)
+{
+   return isalnum((unsigned char)c) || (c == '_');
+}
+
+size_t SkipSpace(const std::string &s, size_t pos)
+{
+   while ((pos < s.size()) && isspace((unsigned char)s[pos]))
+   {
+      pos++;
+   }
+   return pos;
+}
+
+std::string Escape(const std::string &format)
+{
+   std::string out;
+
+   for (char c : format)
+   {
+      switch (c)
+      {
+         case '\\': out += "\\\\"; break;
+         case '\t': out += "\\t"; break;
+         case '\n': out += "\\n"; break;
+         default:   out += c; break;
+      }
+   }
+   return out;
+}
+
+// Finds the log sites in one source, adding them to sites; false on a
+// collision
+bool Scan(const std::string &path, const std::string &text, std::map<uint16_t, Site> &sites)
+{
+   bool ok = true;
+   int line = 1;
+
+   for (size_t pos = 0; pos < text.size(); pos++)
+   {
+      const char c = text[pos];
+
+      if (c == '\n')
+      {
+         line++;
+      }
+      else if (text.compare(pos, 2, "//") == 0)
+      {
+         pos = text.find('\n', pos) - 1;
+      }
+      else if (text.compare(pos, 2, "/*") == 0)
+      {
+         const size_t end = text.find("*/", pos + 2);
+
+         if (end == std::string::npos)
+         {
+            break;
+         }
+         for (size_t i = pos; i < end; i++)
+         {
+            line += (text[i] == '\n');
+         }
+         pos = end + 1;
+      }
+      else if ((c == '"') || (c == '\''))
+      {
+         // skip literals, so quoted text is never taken for a site
+         for (pos++; (pos < text.size()) && (text[pos] != c); pos++)
+         {
+            pos += (text[pos] == '\\');
+         }
+      }
+      else if ((text.compare(pos, 4, "LOG_") == 0) && ((pos == 0) || !IsIdentifier(text[pos - 1])))
+      {
+         size_t next = pos + 4;
+         uint8_t level;
+
+         for (level = 0; level < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); level++)
+         {
+            const size_t length = strlen(LEVEL_NAMES[level]);
+
+            if ((text.compare(next, length, LEVEL_NAMES[level]) == 0) && (text[next + length] == '('))
+            {
+               next += length + 1;
+               break;
+            }
+         }
+         next = SkipSpace(text, next);
+         if ((level == sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0])) || (text[next] != '"'))
+         {
+            // not a site, e.g. the macros' own definitions
+            continue;
+         }
+
+         Site site = { level, std::string(), path + ":" + std::to_string(line) };
+
+         while (text[next] == '"')
+         {
+            next = SkipSpace(text, ReadLiteral(text, next, site.format));
+         }
+
+         const uint16_t id = LogId(level, site.format.c_str());
+         const auto found = sites.find(id);
+
+         if (found == sites.end())
+         {
+            sites[id] = site;
+         }
+         else if ((found->second.level != level) || (found->second.format != site.format))
+         {
+            fprintf(stderr, "%s: log id %04x collides with %s, reword one\n", site.where.c_str(), id,
+                    found->second.where.c_str());
+            ok = false;
+         }
+      }
+   }
+   return ok;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   const char *out = NULL;
+   std::map<uint16_t, Site> sites;
+   bool ok = true;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "o:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'o':
+            out = optarg;
+            break;
+         default:
+            optind = argc + 1;
+            break;
+      }
+   }
+   if (optind > argc)
+   {
+      fprintf(stderr, "usage: %s [-o table] source...\n", argv[0]);
+      return 2;
+   }
+
+   for (int i = optind; i < argc; i++)
+   {
+      std::ifstream in(argv[i]);
+      std::stringstream text;
+
+      if (!in)
+      {
+         perror(argv[i]);
+         return 2;
+      }
+      text << in.rdbuf();
+      // sites are named by file, not by where the build ran from
+      const char *name = strrchr(argv[i], '/');
+
+      ok = Scan((name != NULL) ? name + 1 : argv[i], text.str(), sites) && ok;
+   }
+   if (!ok)
+   {
+      return 1;
+   }
+
+   FILE *table = (out != NULL) ? fopen(out, "w") : stdout;
+
+   if (table == NULL)
+   {
+      perror(out);
+      return 2;
+   }
+   for (const auto &entry : sites)
+   {
+      fprintf(table, "%04x\t%s\t%s\t%s\n", entry.first, LEVEL_NAMES[entry.second.level],
+              entry.second.where.c_str(), Escape(entry.second.format).c_str());
+   }
+   if (out != NULL)
+   {
+      fclose(table);
+   }
+   return 0;
+}
@@ -0,0 +1,270 @@
+// Host harness for the Mahony attitude filter.
+//
+// Replays a CSV log captured with IMU_LOG_RAW (t_us,ax,ay,az,gx,gy,gz,qw,qx,qy,qz)
+// through MahonyFilter and compares the result to the logged DMP quaternion.
+// telemetry_decode's output can be given as is: its "raw" lines are the log
+// and the other messages are skipped.
+// Without a log a synthetic flight with gyro bias and noise is generated so the
+// filter can be checked against a known attitude.
+//
+// usage: mahony_bench [log.csv] [kp] [ki]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Mahony.h"
+
+namespace
+{
+
+const double GYRO_LSB_PER_DPS = 16.4;
+const double ACCEL_LSB_PER_G = 16384.0;
+const double RAD_TO_DEG = 180.0 / M_PI;
+
+// passes over the log when timing updates
+const int TIMING_PASSES = 50;
+
+struct Sample
+{
+   unsigned long t;
+   int16_t ax, ay, az;
+   int16_t gx, gy, gz;
+   double qw, qx, qy, qz;
+};
+
+struct Stats
+{
+   double sum;
+   double sumSq;
+   double max;
+   unsigned long count;
+
+   void Add(const double value)
+   {
+      sum += value;
+      sumSq += value * value;
+      max = (std::fabs(value) > max) ? std::fabs(value) : max;
+      count++;
+   }
+
+   double Rms() const
+   {
+      return (count > 0) ? std::sqrt(sumSq / count) : 0.0;
+   }
+};
+
+// Gravity direction in the sensor frame, as MPU6050::dmpGetGravity
+void Gravity(const double w, const double x, const double y, const double z, double g[3])
+{
+   g[0] = 2 * (x * z - w * y);
+   g[1] = 2 * (w * x + y * z);
+   g[2] = w * w - x * x - y * y + z * z;
+}
+
+// Yaw, pitch, roll in radians, as MPU6050::dmpGetYawPitchRoll
+void YawPitchRoll(const double w, const double x, const double y, const double z, double ypr[3])
+{
+   double g[3];
+
+   Gravity(w, x, y, z, g);
+   ypr[0] = std::atan2(2 * x * y - 2 * w * z, 2 * w * w + 2 * x * x - 1);
+   ypr[1] = std::atan(g[0] / std::sqrt(g[1] * g[1] + g[2] * g[2]));
+   ypr[2] = std::atan(g[1] / std::sqrt(g[0] * g[0] + g[2] * g[2]));
+}
+
+double WrapDegrees(double angle)
+{
+   while (angle > 180.0)  angle -= 360.0;
+   while (angle < -180.0) angle += 360.0;
+   return angle;
+}
+
+int16_t Saturate(const double value)
+{
+   if (value > 32767.0)  return 32767;
+   if (value < -32768.0) return -32768;
+   return (int16_t)std::lround(value);
+}
+
+bool LoadLog(const char *path, std::vector<Sample> &log)
+{
+   FILE *file = std::fopen(path, "r");
+   char line[256];
+
+   if (file == NULL)
+   {
+      std::perror(path);
+      return false;
+   }
+
+   // the serial capture also holds startup messages, keep only complete rows
+   while (std::fgets(line, sizeof(line), file) != NULL)
+   {
+      Sample s;
+      int ax, ay, az, gx, gy, gz;
+      const char *fields = (std::strncmp(line, "raw,", 4) == 0) ? line + 4 : line;
+
+      if (std::sscanf(fields, "%lu,%d,%d,%d,%d,%d,%d,%lf,%lf,%lf,%lf",
+                      &s.t, &ax, &ay, &az, &gx, &gy, &gz,
+                      &s.qw, &s.qx, &s.qy, &s.qz) == 11)
+      {
+         s.ax = ax; s.ay = ay; s.az = az;
+         s.gx = gx; s.gy = gy; s.gz = gz;
+         log.push_back(s);
+      }
+   }
+
+   std::fclose(file);
+   return true;
+}
+
+// 60 s of 1 kHz samples: slow yaw sweep with pitch/roll oscillation, a
+// constant gyro bias and white noise on both sensors
+void Synthesize(std::vector<Sample> &log)
+{
+   const double rate = 1000.0;
+   const double bias[3] = {0.8, -0.5, 0.3};  // deg/sec
+   std::mt19937 rng(1);
+   std::normal_distribution<double> gyroNoise(0.0, 0.5 * GYRO_LSB_PER_DPS);
+   std::normal_distribution<double> accelNoise(0.0, 0.01 * ACCEL_LSB_PER_G);
+   double q[4] = {1.0, 0.0, 0.0, 0.0};
+
+   for (int i = 0; i < 60 * (int)rate; i++)
+   {
+      const double t = i / rate;
+      double w[3];   // true body rate, rad/s
+      double g[3];
+      double dq[4];
+      double norm;
+      Sample s;
+
+      w[0] = 0.6 * std::sin(2 * M_PI * 0.5 * t);
+      w[1] = 0.4 * std::sin(2 * M_PI * 0.3 * t + 1.0);
+      w[2] = 0.2;
+
+      Gravity(q[0], q[1], q[2], q[3], g);
+
+      s.t = (unsigned long)(t * 1e6);
+      s.ax = Saturate(g[0] * ACCEL_LSB_PER_G + accelNoise(rng));
+      s.ay = Saturate(g[1] * ACCEL_LSB_PER_G + accelNoise(rng));
+      s.az = Saturate(g[2] * ACCEL_LSB_PER_G + accelNoise(rng));
+      s.gx = Saturate((w[0] * RAD_TO_DEG + bias[0]) * GYRO_LSB_PER_DPS + gyroNoise(rng));
+      s.gy = Saturate((w[1] * RAD_TO_DEG + bias[1]) * GYRO_LSB_PER_DPS + gyroNoise(rng));
+      s.gz = Saturate((w[2] * RAD_TO_DEG + bias[2]) * GYRO_LSB_PER_DPS + gyroNoise(rng));
+      s.qw = q[0]; s.qx = q[1]; s.qy = q[2]; s.qz = q[3];
+      log.push_back(s);
+
+      // exact rotation over the step for the reference attitude
+      const double angle = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]) / rate;
+      const double c = std::cos(angle / 2);
+      const double k = (angle > 0) ? std::sin(angle / 2) / (angle * rate) : 0.0;
+      dq[0] = c; dq[1] = w[0] * k; dq[2] = w[1] * k; dq[3] = w[2] * k;
+
+      const double r0 = q[0] * dq[0] - q[1] * dq[1] - q[2] * dq[2] - q[3] * dq[3];
+      const double r1 = q[0] * dq[1] + q[1] * dq[0] + q[2] * dq[3] - q[3] * dq[2];
+      const double r2 = q[0] * dq[2] - q[1] * dq[3] + q[2] * dq[0] + q[3] * dq[1];
+      const double r3 = q[0] * dq[3] + q[1] * dq[2] - q[2] * dq[1] + q[3] * dq[0];
+      norm = std::sqrt(r0 * r0 + r1 * r1 + r2 * r2 + r3 * r3);
+      q[0] = r0 / norm; q[1] = r1 / norm; q[2] = r2 / norm; q[3] = r3 / norm;
+   }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+   std::vector<Sample> log;
+   const double kp = (argc > 2) ? std::atof(argv[2]) : MAHONY_KP;
+   const double ki = (argc > 3) ? std::atof(argv[3]) : MAHONY_KI;
+   const double gyroScale = M_PI / 180.0 / GYRO_LSB_PER_DPS;
+   MahonyFilter filter(kp, ki, gyroScale);
+   Stats tilt = {}, pitch = {}, roll = {}, yaw = {};
+   unsigned long last;
+   double yawOffset = 0.0;
+
+   if (argc > 1)
+   {
+      if (!LoadLog(argv[1], log))
+      {
+         return 1;
+      }
+   }
+   else
+   {
+      Synthesize(log);
+   }
+
+   if (log.size() < 2)
+   {
+      std::fprintf(stderr, "no samples\n");
+      return 1;
+   }
+
+   // seed from the first sample so the comparison starts aligned
+   last = log[0].t;
+   for (size_t i = 0; i < log.size(); i++)
+   {
+      const Sample &s = log[i];
+      double ref[3], est[3], gr[3], ge[3];
+      Quaternion q;
+
+      filter.Update(s.ax, s.ay, s.az, s.gx, s.gy, s.gz, s.t - last);
+      last = s.t;
+      q = filter.GetQuaternion();
+
+      YawPitchRoll(s.qw, s.qx, s.qy, s.qz, ref);
+      YawPitchRoll(q.w, q.x, q.y, q.z, est);
+      Gravity(s.qw, s.qx, s.qy, s.qz, gr);
+      Gravity(q.w, q.x, q.y, q.z, ge);
+
+      // heading is unobservable without a magnetometer, so compare yaw
+      // relative to where each estimate was after the first second
+      if (s.t - log[0].t < 1000000UL)
+      {
+         yawOffset = WrapDegrees((est[0] - ref[0]) * RAD_TO_DEG);
+         continue;
+      }
+
+      const double dot = (gr[0] * ge[0] + gr[1] * ge[1] + gr[2] * ge[2]) /
+         std::sqrt((gr[0] * gr[0] + gr[1] * gr[1] + gr[2] * gr[2]) *
+                   (ge[0] * ge[0] + ge[1] * ge[1] + ge[2] * ge[2]));
+      tilt.Add(std::acos(std::fmin(1.0, std::fmax(-1.0, dot))) * RAD_TO_DEG);
+      pitch.Add(WrapDegrees((est[2] - ref[2]) * RAD_TO_DEG));
+      roll.Add(WrapDegrees((est[1] - ref[1]) * RAD_TO_DEG));
+      yaw.Add(WrapDegrees((est[0] - ref[0]) * RAD_TO_DEG - yawOffset));
+   }
+
+   // time the update alone over repeated passes
+   auto start = std::chrono::steady_clock::now();
+   for (int pass = 0; pass < TIMING_PASSES; pass++)
+   {
+      filter.Reset();
+      last = log[0].t;
+      for (size_t i = 0; i < log.size(); i++)
+      {
+         filter.Update(log[i].ax, log[i].ay, log[i].az,
+                       log[i].gx, log[i].gy, log[i].gz, log[i].t - last);
+         last = log[i].t;
+      }
+   }
+   auto stop = std::chrono::steady_clock::now();
+   const double ns = std::chrono::duration<double, std::nano>(stop - start).count() /
+      ((double)TIMING_PASSES * log.size());
+
+   std::printf("filter:   %s, kp %.3f ki %.3f\n",
+               (MAHONY_FIXED_POINT == 1) ? "fixed point" : "float", kp, ki);
+   std::printf("samples:  %lu over %.1f s\n", (unsigned long)log.size(),
+               (log.back().t - log[0].t) / 1e6);
+   std::printf("tilt:     rms %.3f  max %.3f deg\n", tilt.Rms(), tilt.max);
+   std::printf("pitch:    rms %.3f  max %.3f deg\n", pitch.Rms(), pitch.max);
+   std::printf("roll:     rms %.3f  max %.3f deg\n", roll.Rms(), roll.max);
+   std::printf("yaw:      rms %.3f  max %.3f deg (relative)\n", yaw.Rms(), yaw.max);
+   std::printf("update:   %.1f ns\n", ns);
+
+   return 0;
+}
@@ -0,0 +1,535 @@
+// Host model of an MPU6050, see mpu6050_model.h.
+
+#include <cstring>
+
+#include "Arduino.h"
+#include "EnableInterrupt.h"
+#include "mpu6050_model.h"
+
+namespace
+{
+
+const uint8_t RA_SMPLRT_DIV       = 0x19;
+const uint8_t RA_CONFIG           = 0x1A;
+const uint8_t RA_GYRO_CONFIG      = 0x1B;
+const uint8_t RA_ACCEL_CONFIG     = 0x1C;
+const uint8_t RA_I2C_MST_STATUS   = 0x36;
+const uint8_t RA_INT_PIN_CFG      = 0x37;
+const uint8_t RA_INT_ENABLE       = 0x38;
+const uint8_t RA_INT_STATUS       = 0x3A;
+const uint8_t RA_ACCEL_XOUT_H     = 0x3B;
+const uint8_t RA_EXT_SENS_END     = 0x60;
+const uint8_t RA_SIGNAL_PATH_RST  = 0x68;
+const uint8_t RA_USER_CTRL        = 0x6A;
+const uint8_t RA_PWR_MGMT_1       = 0x6B;
+const uint8_t RA_BANK_SEL         = 0x6D;
+const uint8_t RA_MEM_START        = 0x6E;
+const uint8_t RA_MEM_R_W          = 0x6F;
+const uint8_t RA_FIFO_COUNTH      = 0x72;
+const uint8_t RA_FIFO_COUNTL      = 0x73;
+const uint8_t RA_FIFO_R_W         = 0x74;
+const uint8_t RA_WHO_AM_I         = 0x75;
+
+const uint8_t INT_PIN_CFG_LATCH   = 0x20;
+const uint8_t INT_PIN_CFG_RD_CLR  = 0x10;
+const uint8_t INT_DATA_RDY        = 0x01;
+const uint8_t INT_DMP             = 0x02;
+const uint8_t INT_FIFO_OFLOW      = 0x10;
+const uint8_t USER_CTRL_DMP_EN    = 0x80;
+const uint8_t USER_CTRL_FIFO_EN   = 0x40;
+const uint8_t USER_CTRL_DMP_RST   = 0x08;
+const uint8_t USER_CTRL_FIFO_RST  = 0x04;
+const uint8_t USER_CTRL_STROBES   = 0x0F;
+const uint8_t PWR_MGMT_1_RESET    = 0x80;
+const uint8_t PWR_MGMT_1_SLEEP    = 0x40;
+const uint8_t DLPF_CFG_MASK       = 0x07;
+const uint8_t FS_SEL_SHIFT        = 3;
+const uint8_t FS_SEL_MASK         = 0x03;
+
+// DMP FIFO rate divider (D_0_22), output is 200 Hz / (1 + divider)
+const uint8_t DMP_RATE_BANK   = 0x02;
+const uint8_t DMP_RATE_OFFSET = 0x16;
+const unsigned long DMP_BASE_PERIOD_US = 5000;
+
+// MotionApps 2.0 packet layout: Q30 quaternion, then gyro and accel as the
+// high halves of 32 bit words
+const uint8_t PACKET_GYRO  = 16;
+const uint8_t PACKET_ACCEL = 28;
+const float DMP_ACCEL_LSB_PER_G = 8192.0;
+
+// full scale sensitivity at FS_SEL / AFS_SEL 0
+const float GYRO_LSB_PER_DPS = 131.0;
+const float ACCEL_LSB_PER_G = 16384.0;
+
+// TEMP_OUT at 25 C: (25 - 36.53) * 340
+const int16_t TEMP_25C = -3920;
+
+// 400 kHz: 2.5 us per bit, 9 bits per byte with ACK, plus START and STOP
+unsigned long BusMicros(const unsigned bytes)
+{
+   return (unsigned long)((bytes * 9 + 2) * 2.5);
+}
+
+int16_t Saturate(const float value)
+{
+   if (value >= 32767.0)
+   {
+      return 32767;
+   }
+   if (value <= -32768.0)
+   {
+      return -32768;
+   }
+   return (int16_t)lround(value);
+}
+
+void PutWord(uint8_t *data, const int32_t value)
+{
+   data[0] = (uint32_t)value >> 24;
+   data[1] = (uint32_t)value >> 16;
+   data[2] = (uint32_t)value >> 8;
+   data[3] = (uint32_t)value;
+}
+
+bool Before(const unsigned long a, const unsigned long b)
+{
+   return (long)(a - b) < 0;
+}
+
+}
+
+Mpu6050Model::Mpu6050Model(const uint8_t intPin) :
+   mIntPin(intPin),
+   mConnected(true),
+   mMotion(NULL),
+   mPacketTap(NULL),
+   mExternalPackets(false),
+   mAttitudeNoise(0),
+   mGyroNoise(0),
+   mAccelNoise(0),
+   mNoiseState(1),
+   mSampleCount(0),
+   mPacketCount(0),
+   mOverflowCount(0),
+   mInterruptCount(0)
+{
+   Reset();
+}
+
+void Mpu6050Model::SetNoise(const float attitudeDeg, const float gyroDps, const float accelG,
+                            const uint32_t seed)
+{
+   mAttitudeNoise = attitudeDeg * M_PI / 180.0;
+   mGyroNoise = gyroDps;
+   mAccelNoise = accelG;
+   mNoiseState = seed | ((uint64_t)1 << 32);
+}
+
+float Mpu6050Model::Gaussian()
+{
+   double u1;
+   double u2;
+
+   // xorshift64 into Box-Muller
+   mNoiseState ^= mNoiseState << 13;
+   mNoiseState ^= mNoiseState >> 7;
+   mNoiseState ^= mNoiseState << 17;
+   u1 = ((mNoiseState >> 11) + 1.0) / 9007199254740993.0;
+   mNoiseState ^= mNoiseState << 13;
+   mNoiseState ^= mNoiseState >> 7;
+   mNoiseState ^= mNoiseState << 17;
+   u2 = (mNoiseState >> 11) / 9007199254740992.0;
+
+   return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+void Mpu6050Model::Reset()
+{
+   memset(mRegs, 0, sizeof(mRegs));
+   memset(mMem, 0, sizeof(mMem));
+   mRegs[RA_PWR_MGMT_1] = PWR_MGMT_1_SLEEP;
+   mRegs[RA_WHO_AM_I] = 0x68;
+   mFifoHead = 0;
+   mFifoCount = 0;
+   mNextSample = micros() + SamplePeriod();
+   mNextPacket = micros() + DmpPeriod();
+   mLineHigh = false;
+}
+
+bool Mpu6050Model::Awake() const
+{
+   return !(mRegs[RA_PWR_MGMT_1] & PWR_MGMT_1_SLEEP);
+}
+
+bool Mpu6050Model::DmpRunning() const
+{
+   return Awake() &&
+          ((mRegs[RA_USER_CTRL] & (USER_CTRL_DMP_EN | USER_CTRL_FIFO_EN)) ==
+           (USER_CTRL_DMP_EN | USER_CTRL_FIFO_EN));
+}
+
+unsigned long Mpu6050Model::SamplePeriod() const
+{
+   const uint8_t dlpf = mRegs[RA_CONFIG] & DLPF_CFG_MASK;
+
+   // the gyro output runs at 8 kHz only with the low pass filter off
+   const unsigned long outputHz = ((dlpf == 0) || (dlpf == 7)) ? 8000 : 1000;
+
+   return 1000000UL * (1 + mRegs[RA_SMPLRT_DIV]) / outputHz;
+}
+
+unsigned long Mpu6050Model::DmpPeriod() const
+{
+   const uint16_t divider = (mMem[DMP_RATE_BANK][DMP_RATE_OFFSET] << 8) |
+                            mMem[DMP_RATE_BANK][DMP_RATE_OFFSET + 1];
+
+   return DMP_BASE_PERIOD_US * (1 + divider);
+}
+
+void Mpu6050Model::Update()
+{
+   const unsigned long now = micros();
+   bool packet;
+   unsigned long due;
+
+   if (!mConnected)
+   {
+      return;
+   }
+   if (!Awake())
+   {
+      mNextSample = now + SamplePeriod();
+      mNextPacket = now + DmpPeriod();
+      return;
+   }
+
+   // samples and packets interleave in time order
+   for (;;)
+   {
+      packet = !mExternalPackets && DmpRunning() && Before(mNextPacket, mNextSample);
+      due = packet ? mNextPacket : mNextSample;
+      if (Before(now, due))
+      {
+         break;
+      }
+
+      if (packet)
+      {
+         PushPacket(due);
+         mNextPacket += DmpPeriod();
+      }
+      else
+      {
+         LatchSample(due);
+         mNextSample += SamplePeriod();
+      }
+   }
+
+   // the DMP starts its first interval when enabled
+   if (!DmpRunning())
+   {
+      mNextPacket = now + DmpPeriod();
+   }
+}
+
+void Mpu6050Model::Measure(const unsigned long timeUs, Quaternion &attitude,
+                           int16_t accel[3], int16_t gyro[3])
+{
+   const float accelScale = ACCEL_LSB_PER_G / (1 << ((mRegs[RA_ACCEL_CONFIG] >> FS_SEL_SHIFT) & FS_SEL_MASK));
+   const float gyroScale = GYRO_LSB_PER_DPS / (1 << ((mRegs[RA_GYRO_CONFIG] >> FS_SEL_SHIFT) & FS_SEL_MASK)) *
+                           180.0 / M_PI;
+   VectorFloat rate;
+   float gravity[3];
+
+   if (mMotion != NULL)
+   {
+      mMotion->Sample(timeUs, attitude, rate);
+   }
+
+   // small random rotation, half angle per axis
+   if (mAttitudeNoise > 0)
+   {
+      Quaternion error(1.0, 0.5 * mAttitudeNoise * Gaussian(), 0.5 * mAttitudeNoise * Gaussian(),
+                       0.5 * mAttitudeNoise * Gaussian());
+
+      error.normalize();
+      attitude = attitude.getProduct(error);
+   }
+
+   // gravity in the sensor frame, as MPU6050::dmpGetGravity reconstructs it
+   gravity[0] = 2 * (attitude.x * attitude.z - attitude.w * attitude.y);
+   gravity[1] = 2 * (attitude.w * attitude.x + attitude.y * attitude.z);
+   gravity[2] = attitude.w * attitude.w - attitude.x * attitude.x -
+                attitude.y * attitude.y + attitude.z * attitude.z;
+
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      accel[i] = Saturate((gravity[i] + mAccelNoise * Gaussian()) * accelScale);
+   }
+
+   // gyroScale is per rad/s, the noise is in deg/s
+   gyro[0] = Saturate((rate.x + mGyroNoise * Gaussian() * M_PI / 180.0) * gyroScale);
+   gyro[1] = Saturate((rate.y + mGyroNoise * Gaussian() * M_PI / 180.0) * gyroScale);
+   gyro[2] = Saturate((rate.z + mGyroNoise * Gaussian() * M_PI / 180.0) * gyroScale);
+}
+
+void Mpu6050Model::LatchSample(const unsigned long timeUs)
+{
+   Quaternion attitude;
+   int16_t accel[3];
+   int16_t gyro[3];
+   uint8_t *out = mRegs + RA_ACCEL_XOUT_H;
+
+   Measure(timeUs, attitude, accel, gyro);
+
+   // ACCEL_XOUT_H..ZOUT_L, TEMP_OUT_H/L, GYRO_XOUT_H..ZOUT_L, big endian
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      out[2 * i] = (uint16_t)accel[i] >> 8;
+      out[2 * i + 1] = accel[i] & 0xFF;
+      out[8 + 2 * i] = (uint16_t)gyro[i] >> 8;
+      out[8 + 2 * i + 1] = gyro[i] & 0xFF;
+   }
+   out[6] = (uint16_t)TEMP_25C >> 8;
+   out[7] = TEMP_25C & 0xFF;
+   mSampleCount++;
+
+   Signal(INT_DATA_RDY);
+}
+
+void Mpu6050Model::PushPacket(const unsigned long timeUs)
+{
+   uint8_t packet[PACKET_SIZE];
+   Quaternion attitude;
+   int16_t accel[3];
+   int16_t gyro[3];
+   const float dmpAccelScale = DMP_ACCEL_LSB_PER_G /
+                               (ACCEL_LSB_PER_G / (1 << ((mRegs[RA_ACCEL_CONFIG] >> FS_SEL_SHIFT) & FS_SEL_MASK)));
+
+   Measure(timeUs, attitude, accel, gyro);
+
+   memset(packet, 0, sizeof(packet));
+   PutWord(packet + 0, (int32_t)(attitude.w * 1073741824.0));
+   PutWord(packet + 4, (int32_t)(attitude.x * 1073741824.0));
+   PutWord(packet + 8, (int32_t)(attitude.y * 1073741824.0));
+   PutWord(packet + 12, (int32_t)(attitude.z * 1073741824.0));
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      PutWord(packet + PACKET_GYRO + 4 * i, (int32_t)gyro[i] << 16);
+      PutWord(packet + PACKET_ACCEL + 4 * i, (int32_t)Saturate(accel[i] * dmpAccelScale) << 16);
+   }
+
+   Enqueue(packet);
+}
+
+void Mpu6050Model::QueuePacket(const uint8_t *packet)
+{
+   if (DmpRunning())
+   {
+      Enqueue(packet);
+   }
+}
+
+void Mpu6050Model::Enqueue(const uint8_t *packet)
+{
+   bool overflow = false;
+
+   if (mPacketTap != NULL)
+   {
+      mPacketTap(packet);
+   }
+
+   for (uint8_t i = 0; i < PACKET_SIZE; i++)
+   {
+      // a full FIFO keeps the newest data
+      if (mFifoCount == FIFO_SIZE)
+      {
+         mFifoHead = (mFifoHead + 1) % FIFO_SIZE;
+         mFifoCount--;
+         overflow = true;
+      }
+      mFifo[(mFifoHead + mFifoCount) % FIFO_SIZE] = packet[i];
+      mFifoCount++;
+   }
+   mPacketCount++;
+
+   if (overflow)
+   {
+      mOverflowCount++;
+      Signal(INT_DMP | INT_FIFO_OFLOW);
+   }
+   else
+   {
+      Signal(INT_DMP);
+   }
+}
+
+void Mpu6050Model::Signal(const uint8_t status)
+{
+   mRegs[RA_INT_STATUS] |= status;
+   if (!(status & mRegs[RA_INT_ENABLE]))
+   {
+      return;
+   }
+
+   // a latched line stays high until the status is cleared, so only the
+   // first event is an edge; a pulsed line gives every event its own edge
+   if (mRegs[RA_INT_PIN_CFG] & INT_PIN_CFG_LATCH)
+   {
+      if (mLineHigh)
+      {
+         return;
+      }
+      mLineHigh = true;
+   }
+   mInterruptCount++;
+   HostRaiseInterrupt(mIntPin);
+}
+
+void Mpu6050Model::ClearStatus()
+{
+   mRegs[RA_INT_STATUS] = 0;
+   mLineHigh = false;
+}
+
+uint8_t Mpu6050Model::ReadRegister(const uint8_t reg)
+{
+   uint8_t value;
+
+   switch (reg)
+   {
+   case RA_MEM_R_W:
+      return mMem[mRegs[RA_BANK_SEL] & 7][mRegs[RA_MEM_START]++];
+
+   case RA_FIFO_COUNTH:
+      return mFifoCount >> 8;
+
+   case RA_FIFO_COUNTL:
+      return mFifoCount & 0xFF;
+
+   case RA_FIFO_R_W:
+      // an empty FIFO reads back its last byte on the real part; the
+      // driver never relies on it
+      if (mFifoCount == 0)
+      {
+         return 0;
+      }
+      value = mFifo[mFifoHead];
+      mFifoHead = (mFifoHead + 1) % FIFO_SIZE;
+      mFifoCount--;
+      return value;
+
+   case RA_INT_STATUS:
+      value = mRegs[RA_INT_STATUS];
+      ClearStatus();
+      return value;
+
+   default:
+      return mRegs[reg & 0x7F];
+   }
+}
+
+void Mpu6050Model::WriteRegister(const uint8_t reg, const uint8_t value)
+{
+   // status, sensor data and WHO_AM_I are read only
+   if ((reg == RA_I2C_MST_STATUS) || (reg == RA_WHO_AM_I) ||
+       ((reg >= RA_INT_STATUS) && (reg <= RA_EXT_SENS_END)))
+   {
+      return;
+   }
+
+   switch (reg)
+   {
+   case RA_MEM_R_W:
+      mMem[mRegs[RA_BANK_SEL] & 7][mRegs[RA_MEM_START]++] = value;
+      break;
+
+   case RA_FIFO_R_W:
+      break;
+
+   case RA_SIGNAL_PATH_RST:
+      // reset strobes only
+      break;
+
+   case RA_USER_CTRL:
+      if (value & USER_CTRL_FIFO_RST)
+      {
+         mFifoHead = 0;
+         mFifoCount = 0;
+      }
+      if (value & USER_CTRL_DMP_RST)
+      {
+         mNextPacket = micros() + DmpPeriod();
+      }
+      mRegs[reg] = value & ~USER_CTRL_STROBES;
+      break;
+
+   case RA_PWR_MGMT_1:
+      if (value & PWR_MGMT_1_RESET)
+      {
+         Reset();
+      }
+      else
+      {
+         mRegs[reg] = value;
+      }
+      break;
+
+   default:
+      mRegs[reg & 0x7F] = value;
+      break;
+   }
+}
+
+I2CdevError Mpu6050Model::read(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint8_t length)
+{
+   // FIFO and DMP memory ports do not auto-increment
+   const bool port = (regAddr == RA_FIFO_R_W) || (regAddr == RA_MEM_R_W);
+
+   (void)devAddr;
+
+   if (!mConnected)
+   {
+      HostAdvanceMicros(BusMicros(1));
+      return I2CDEV_ERR_ADDR_NACK;
+   }
+
+   // address, register, repeated start, address, data
+   HostAdvanceMicros(BusMicros(3 + length) + 2);
+   Update();
+
+   for (uint8_t i = 0; i < length; i++)
+   {
+      data[i] = ReadRegister(port ? regAddr : regAddr + i);
+   }
+
+   // any read acknowledges the interrupt when INT_RD_CLEAR is set
+   if (mRegs[RA_INT_PIN_CFG] & INT_PIN_CFG_RD_CLR)
+   {
+      ClearStatus();
+   }
+   return I2CDEV_OK;
+}
+
+I2CdevError Mpu6050Model::write(uint8_t devAddr, uint8_t regAddr, const uint8_t *data, uint8_t length)
+{
+   const bool port = (regAddr == RA_FIFO_R_W) || (regAddr == RA_MEM_R_W);
+
+   (void)devAddr;
+
+   if (!mConnected)
+   {
+      HostAdvanceMicros(BusMicros(1));
+      return I2CDEV_ERR_ADDR_NACK;
+   }
+
+   // address, register, data
+   HostAdvanceMicros(BusMicros(2 + length));
+   Update();
+
+   for (uint8_t i = 0; i < length; i++)
+   {
+      WriteRegister(port ? regAddr : regAddr + i, data[i]);
+   }
+   return I2CDEV_OK;
+}
@@ -0,0 +1,169 @@
+// Host model of an MPU6050 on the I2C bus.
+//
+// Serves the register map and the DMP memory banks through I2CdevHostBus.
+// Raw samples are latched into the sensor data registers at the rate set by
+// CONFIG and SMPLRT_DIV, and while DMP_EN and FIFO_EN are set the DMP queues
+// 42 byte MotionApps packets into a 1024 byte FIFO at 200 Hz / (1 + D_0_22).
+// A full FIFO drops its oldest bytes and sets FIFO_OFLOW (0x10) in
+// INT_STATUS. Enabled interrupts pulse, or latch, the INT pin through the
+// EnableInterrupt shim.
+//
+// Every transfer costs 400 kHz bus time on the simulated clock and the model
+// catches up with that clock on each access, so polling loops in the driver
+// see the FIFO fill as they would on the real part. Between accesses the
+// caller moves time on and calls Update(); interrupts raised during a
+// catch-up are seen at the current time, not the time they were due.
+//
+// Samples and packets follow a Mpu6050Motion: a script or a simulation that
+// supplies the sensor attitude and body rates. Without one the sensor sits
+// level and still. Optional white noise is added to each sample and packet
+// from a seeded generator, so noisy runs repeat too. For replay the DMP can
+// instead queue packets handed to it, and a tap sees every packet queued.
+//
+// Disconnect() takes the sensor off the bus for good, as a part that lost
+// power or a broken wire: transfers are not acknowledged and INT stays low.
+//
+// Not modeled: the FIFO_EN (0x23) raw sensor FIFO, the auxiliary I2C master,
+// self test, motion detection and DMP behaviour beyond its output rate.
+
+#ifndef HOST_MPU6050_MODEL_H
+#define HOST_MPU6050_MODEL_H
+
+#include "I2Cdev.h"
+#include "helper_3dmath.h"
+
+class Mpu6050Motion
+{
+ public:
+   virtual ~Mpu6050Motion() {}
+
+   /*
+    * Sensor attitude (in the DMP convention, level is identity) and body
+    * rates in rad/s at simulated time timeUs.
+    */
+   virtual void Sample(const unsigned long timeUs, Quaternion &attitude, VectorFloat &rate) = 0;
+};
+
+class Mpu6050Model : public I2CdevHostBus
+{
+ public:
+   static const uint16_t FIFO_SIZE = 1024;
+   static const uint8_t PACKET_SIZE = 42;
+
+   typedef void (*PacketTap)(const uint8_t *packet);
+
+   // intPin is the MCU pin the INT output is wired to
+   explicit Mpu6050Model(const uint8_t intPin);
+
+   I2CdevError read(uint8_t devAddr, uint8_t regAddr, uint8_t *data, uint8_t length);
+   I2CdevError write(uint8_t devAddr, uint8_t regAddr, const uint8_t *data, uint8_t length);
+
+   /*
+    * Brings the sensor up to the current simulated time, latching samples,
+    * queueing packets and raising the interrupts that came due, in order.
+    */
+   void Update();
+
+   /*
+    * Source of attitude and rates, NULL for level and still. Not owned.
+    */
+   inline void SetMotion(Mpu6050Motion *motion) { mMotion = motion; }
+
+   /*
+    * Standard deviation of the noise on the DMP attitude (deg), gyro (deg/s)
+    * and accel (g) outputs. All zero (the default) for exact readings.
+    */
+   void SetNoise(const float attitudeDeg, const float gyroDps, const float accelG,
+                 const uint32_t seed);
+
+   /*
+    * Called with each DMP packet as it is queued, NULL for none.
+    */
+   inline void SetPacketTap(PacketTap tap) { mPacketTap = tap; }
+
+   /*
+    * Stops the DMP producing packets of its own; it queues only those given
+    * to QueuePacket(), while it is running.
+    */
+   inline void SetExternalPackets(const bool external) { mExternalPackets = external; }
+   void QueuePacket(const uint8_t *packet);
+
+   inline void Disconnect() { mConnected = false; }
+
+   inline uint16_t GetFifoCount() const { return mFifoCount; }
+   inline unsigned long GetSampleCount() const { return mSampleCount; }
+   inline unsigned long GetPacketCount() const { return mPacketCount; }
+   inline unsigned long GetOverflowCount() const { return mOverflowCount; }
+   inline unsigned long GetInterruptCount() const { return mInterruptCount; }
+
+ private:
+   // Register and FIFO state after power on or DEVICE_RESET; DMP memory
+   // does not survive either
+   void Reset();
+
+   // Applies the side effects of a register write
+   void WriteRegister(const uint8_t reg, const uint8_t value);
+
+   // Returns one byte of a read, popping the FIFO for FIFO_R_W
+   uint8_t ReadRegister(const uint8_t reg);
+
+   // Raw sample interval from CONFIG and SMPLRT_DIV (us)
+   unsigned long SamplePeriod() const;
+
+   // DMP output interval from the FIFO rate divider in DMP memory (us)
+   unsigned long DmpPeriod() const;
+
+   // Sensor readings at timeUs in raw register units
+   void Measure(const unsigned long timeUs, Quaternion &attitude,
+                int16_t accel[3], int16_t gyro[3]);
+
+   // Zero mean, unit variance normal deviate
+   float Gaussian();
+
+   // Latches one raw sample into ACCEL_XOUT_H..GYRO_ZOUT_L
+   void LatchSample(const unsigned long timeUs);
+
+   // Builds one DMP packet from the motion and queues it
+   void PushPacket(const unsigned long timeUs);
+
+   // Queues a packet, dropping the oldest bytes when full, and signals it
+   void Enqueue(const uint8_t *packet);
+
+   // Sets INT_STATUS bits and drives the pin for the enabled ones
+   void Signal(const uint8_t status);
+
+   // Clears INT_STATUS and releases a latched pin
+   void ClearStatus();
+
+   bool Awake() const;
+   bool DmpRunning() const;
+
+   uint8_t mIntPin;
+   bool mConnected;
+   Mpu6050Motion *mMotion;
+   PacketTap mPacketTap;
+   bool mExternalPackets;
+
+   float mAttitudeNoise;   // rad
+   float mGyroNoise;       // deg/s
+   float mAccelNoise;      // g
+   uint64_t mNoiseState;
+
+   uint8_t mRegs[128];
+   uint8_t mMem[8][256];
+
+   uint8_t mFifo[FIFO_SIZE];
+   uint16_t mFifoHead;     // next byte read
+   uint16_t mFifoCount;
+
+   unsigned long mNextSample;    // time the next raw sample is latched (us)
+   unsigned long mNextPacket;    // time the DMP queues its next packet (us)
+   bool mLineHigh;               // latched INT output is asserted
+
+   unsigned long mSampleCount;
+   unsigned long mPacketCount;
+   unsigned long mOverflowCount;
+   unsigned long mInterruptCount;
+};
+
+#endif /* HOST_MPU6050_MODEL_H */
@@ -0,0 +1,200 @@
+// Rigid body model of the quadcopter, see quad_physics.h.
+
+#include <cmath>
+
+#include "motors.h"
+#include "quad_physics.h"
+
+namespace
+{
+
+const float GRAVITY = 9.81;
+
+// motor positions (x forward, y left) in units of arm / sqrt(2), and spin
+// seen from above (1 = counter clockwise), motors 1-4
+const float MOTOR_X[QUAD_MOTORS] = { 1, -1,  1, -1 };
+const float MOTOR_Y[QUAD_MOTORS] = { -1, 1,  1, -1 };
+const float MOTOR_SPIN[QUAD_MOTORS] = { 1, 1, -1, -1 };
+
+// sensor to body mounting: -90 degrees about z (sensor x right, y forward)
+const Quaternion MOUNT(M_SQRT1_2, 0, 0, -M_SQRT1_2);
+
+// v rotated by q
+void Rotate(const Quaternion &q, const float v[3], float out[3])
+{
+   Quaternion p(0, v[0], v[1], v[2]);
+   Quaternion r = q;
+
+   p = r.getProduct(p).getProduct(r.getConjugate());
+   out[0] = p.x;
+   out[1] = p.y;
+   out[2] = p.z;
+}
+
+}
+
+const QuadParams QUAD_DEFAULT_PARAMS =
+{
+   1.2,                       // massKg
+   0.225,                     // armM
+   { 0.012, 0.012, 0.022 },   // inertia
+   8.0,                       // maxThrustN
+   0.016,                     // torqueRatioM
+   0.05,                      // motorTauS
+   0.3,                       // dragNs
+   0.01                       // angularDragNms
+};
+
+QuadPhysics::QuadPhysics(const QuadParams &params) :
+   mParams(params),
+   mOnGround(true)
+{
+   for (int i = 0; i < 3; i++)
+   {
+      mRate[i] = 0;
+      mPosition[i] = 0;
+      mVelocity[i] = 0;
+      mTorque[i] = 0;
+      mForce[i] = 0;
+   }
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      mSpeed[i] = 0;
+      mMotorScale[i] = 1;
+   }
+}
+
+void QuadPhysics::SetMotorScale(const float scale[QUAD_MOTORS])
+{
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      mMotorScale[i] = scale[i];
+   }
+}
+
+void QuadPhysics::SetDisturbance(const float torqueNm[3], const float forceN[3])
+{
+   for (int i = 0; i < 3; i++)
+   {
+      mTorque[i] = torqueNm[i];
+      mForce[i] = forceN[i];
+   }
+}
+
+void QuadPhysics::Step(const float dtS, const uint16_t pulseUs[QUAD_MOTORS])
+{
+   const float offset = mParams.armM * M_SQRT1_2;
+   float thrust = 0;
+   float torque[3] = { 0, 0, 0 };
+   float momentum[3];
+   float force[3];
+   float body[3];
+   float command;
+   float motorThrust;
+   Quaternion delta;
+
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      // ESC endpoints are calibrated to the firmware throttle range
+      command = (pulseUs[i] <= MIN_THROTTLE_US) ? 0.0 :
+                (float)(pulseUs[i] - MIN_THROTTLE_US) / (MAX_THROTTLE_US - MIN_THROTTLE_US);
+      if (command > 1.0)
+      {
+         command = 1.0;
+      }
+      mSpeed[i] += (command - mSpeed[i]) * dtS / mParams.motorTauS;
+
+      motorThrust = mParams.maxThrustN * mMotorScale[i] * mSpeed[i] * mSpeed[i];
+      thrust += motorThrust;
+      torque[0] += MOTOR_Y[i] * offset * motorThrust;
+      torque[1] -= MOTOR_X[i] * offset * motorThrust;
+
+      // a counter clockwise rotor drags the frame clockwise
+      torque[2] -= MOTOR_SPIN[i] * mParams.torqueRatioM * motorThrust;
+   }
+
+   // I w' = torque - w x (I w)
+   for (int i = 0; i < 3; i++)
+   {
+      torque[i] += mTorque[i] - mParams.angularDragNms * mRate[i];
+      momentum[i] = mParams.inertia[i] * mRate[i];
+   }
+   torque[0] -= mRate[1] * momentum[2] - mRate[2] * momentum[1];
+   torque[1] -= mRate[2] * momentum[0] - mRate[0] * momentum[2];
+   torque[2] -= mRate[0] * momentum[1] - mRate[1] * momentum[0];
+
+   // thrust along body z, gravity and drag in the world
+   body[0] = 0;
+   body[1] = 0;
+   body[2] = thrust;
+   Rotate(mAttitude, body, force);
+   force[2] -= mParams.massKg * GRAVITY;
+   for (int i = 0; i < 3; i++)
+   {
+      force[i] += mForce[i] - mParams.dragNs * mVelocity[i];
+   }
+
+   // sitting on the ground until thrust beats weight
+   if (mOnGround && (force[2] <= 0))
+   {
+      for (int i = 0; i < 3; i++)
+      {
+         mRate[i] = 0;
+         mVelocity[i] = 0;
+      }
+      return;
+   }
+   mOnGround = false;
+
+   for (int i = 0; i < 3; i++)
+   {
+      mRate[i] += torque[i] / mParams.inertia[i] * dtS;
+      mVelocity[i] += force[i] / mParams.massKg * dtS;
+      mPosition[i] += mVelocity[i] * dtS;
+   }
+
+   // q' = q * (1, w dt / 2)
+   delta = Quaternion(1.0, 0.5 * mRate[0] * dtS, 0.5 * mRate[1] * dtS, 0.5 * mRate[2] * dtS);
+   mAttitude = mAttitude.getProduct(delta);
+   mAttitude.normalize();
+
+   if (mPosition[2] < 0)
+   {
+      mPosition[2] = 0;
+      mOnGround = true;
+      for (int i = 0; i < 3; i++)
+      {
+         mRate[i] = 0;
+         mVelocity[i] = 0;
+      }
+   }
+}
+
+void QuadPhysics::Sample(const unsigned long timeUs, Quaternion &attitude, VectorFloat &rate)
+{
+   Quaternion mount = MOUNT;
+
+   (void)timeUs;
+
+   // body rotation expressed in sensor axes, identity at power on
+   attitude = mount.getConjugate().getProduct(mAttitude).getProduct(mount);
+
+   // sensor x is body -y, sensor y is body x
+   rate.x = -mRate[1];
+   rate.y = mRate[0];
+   rate.z = mRate[2];
+}
+
+void QuadPhysics::GetYawPitchRoll(float &yaw, float &pitch, float &roll) const
+{
+   Quaternion mount = MOUNT;
+   Quaternion q = mount.getConjugate().getProduct(mAttitude).getProduct(mount);
+   const float gx = 2 * (q.x * q.z - q.w * q.y);
+   const float gy = 2 * (q.w * q.x + q.y * q.z);
+   const float gz = q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z;
+
+   // as MPU6050::dmpGetYawPitchRoll and IMU::ToYawPitchRoll
+   yaw = atan2(2 * q.x * q.y - 2 * q.w * q.z, 2 * q.w * q.w + 2 * q.x * q.x - 1) * 180.0 / M_PI;
+   pitch = atan(gy / sqrt(gx * gx + gz * gz)) * 180.0 / M_PI;
+   roll = atan(gx / sqrt(gy * gy + gz * gz)) * 180.0 / M_PI;
+}
@@ -0,0 +1,99 @@
+// Rigid body model of the quadcopter for software in the loop runs.
+//
+// Six degrees of freedom in a z-up world: body axes are x forward, y left,
+// z up. Each ESC maps its pulse linearly from MIN_THROTTLE_US (stopped) to
+// MAX_THROTTLE_US (full speed), the rotor follows with a first order lag,
+// and thrust and drag torque go with the square of rotor speed. Motors sit
+// on an X frame as in pinmap.h:
+//
+//    (3)  (1)     cw - ccw
+//       []
+//    (2)  (4)     ccw - cw
+//
+// The craft rests on flat ground at z = 0 until thrust lifts it.
+//
+// As a Mpu6050Motion it reports the attitude and rates seen by an MPU6050
+// mounted with its x axis to the right and y axis forward (the mounting
+// IMU::ToYawPitchRoll assumes), relative to the attitude at power on.
+
+#ifndef HOST_QUAD_PHYSICS_H
+#define HOST_QUAD_PHYSICS_H
+
+#include "mpu6050_model.h"
+
+const int QUAD_MOTORS = 4;
+
+typedef struct
+{
+   float massKg;
+   float armM;                // motor distance from the center
+   float inertia[3];          // principal moments of inertia (kg m^2)
+   float maxThrustN;          // per motor at full speed
+   float torqueRatioM;        // rotor drag torque per unit thrust
+   float motorTauS;           // rotor speed time constant
+   float dragNs;              // linear drag (N per m/s)
+   float angularDragNms;      // rotational drag (N m per rad/s)
+} QuadParams;
+
+// 450 size frame, 1.2 kg, thrust to weight ~2.7
+extern const QuadParams QUAD_DEFAULT_PARAMS;
+
+class QuadPhysics : public Mpu6050Motion
+{
+ public:
+   explicit QuadPhysics(const QuadParams &params);
+
+   /*
+    * Advances the state by dtS seconds with the given ESC pulse widths (us),
+    * in motor order 1-4. A pulse of 0 (no signal) stops the motor.
+    */
+   void Step(const float dtS, const uint16_t pulseUs[QUAD_MOTORS]);
+
+   /*
+    * Airframe parameters from here on, e.g. a perturbed copy of the defaults.
+    */
+   inline void SetParams(const QuadParams &params) { mParams = params; }
+
+   /*
+    * Thrust of each motor relative to maxThrustN (1 for all by default).
+    */
+   void SetMotorScale(const float scale[QUAD_MOTORS]);
+
+   /*
+    * External torque in body axes (N m) and force in the world (N), such as
+    * gusts, held until changed.
+    */
+   void SetDisturbance(const float torqueNm[3], const float forceN[3]);
+
+   /*
+    * Mpu6050Motion: the latest state, whatever timeUs; call Step() at a fine
+    * enough interval to keep it current.
+    */
+   void Sample(const unsigned long timeUs, Quaternion &attitude, VectorFloat &rate);
+
+   /*
+    * True attitude as quadcopter yaw (nose right), pitch (nose up) and roll
+    * (left side down) in degrees, the sense of IMU::ReadIMU.
+    */
+   void GetYawPitchRoll(float &yaw, float &pitch, float &roll) const;
+
+   inline const float *GetPosition() const { return mPosition; }
+   inline const float *GetVelocity() const { return mVelocity; }
+   inline float GetMotorSpeed(const int motor) const { return mSpeed[motor]; }
+   inline bool OnGround() const { return mOnGround; }
+
+ private:
+   QuadParams mParams;
+
+   Quaternion mAttitude;      // body to world
+   float mRate[3];            // body rates (rad/s)
+   float mPosition[3];        // world (m)
+   float mVelocity[3];        // world (m/s)
+   float mSpeed[QUAD_MOTORS]; // rotor speed, fraction of full
+   float mMotorScale[QUAD_MOTORS];
+   float mTorque[3];          // disturbance, body
+   float mForce[3];           // disturbance, world
+   bool mOnGround;
+};
+
+#endif /* HOST_QUAD_PHYSICS_H */
@@ -0,0 +1,757 @@
+// Software in the loop flight of the quadcopter sketch.
+//
+// The sketch (setup() and loop() as built for the board) runs against the
+// host Arduino shim. Around it:
+//   - QuadPhysics flies the airframe from the pulses SoftwareServo drives on
+//     the motor pins, stepped every PHYSICS_US
+//   - Mpu6050Model serves the IMU from the physics attitude, with noise
+//   - an RC receiver drives 20 ms PWM frames on the receiver pins, so the
+//     Receiver ISRs, failsafe and stick shaping run as they do in flight
+// Each loop() pass costs LOOP_US of simulated time on top of the time the
+// sketch spends in delays, bus transfers and servo refreshes, and all of it
+// runs as fast as the host allows.
+//
+// The flight script arms, takes off and holds about TAKEOFF_M with the
+// throttle (as a pilot would), then steps roll, pitch and yaw in turn.
+// Tracking is measured from the end of takeoff: firmware command against the
+// true attitude, and the IMU reading against the true attitude. Each step is
+// scored for overshoot and settling time, and the run for the share of
+// control passes spent saturated (a PID output or a motor at its limit). A
+// tilt past UPSET_DEG ends the run as a crash.
+//
+// With -f the flight's inputs (receiver edges, DMP packets) and each pass's
+// motor commands are logged for flight_replay. With -b the sketch's own
+// blackbox stream, as sent on its serial port, is saved. With -e what the
+// sketch sends on its USB port (telemetry and text) goes to a file, or with
+// "-e pty" to a pseudo terminal for telemetry_decode, the flight then paced
+// to real time.
+//
+// Built with LOOP_PROFILE (quad_sil_profile) the sketch's task timings
+// since its last periodic dump are printed at the end, in modelled time.
+//
+// With -k the IMU is taken off the bus that many seconds into the flight,
+// and the run checks that the sketch then stops every motor and keeps it
+// stopped to the end.
+//
+// With -u the seed also perturbs the airframe (mass, inertia, motor lag,
+// per motor thrust) and drives random gusts, for Monte Carlo runs.
+//
+// usage: quad_sil [-b blackbox.bbl] [-c] [-d seconds] [-e usb.bin|pty] [-f flight.log]
+//                 [-k seconds] [-l loop_us] [-n] [-p|-r|-y kp,ki,kd] [-s seed] [-t trace.csv]
+//                 [-u] [-v]
+//   -c  prints only a result line for batch runs (see RESULT_FIELDS)
+//   -n  noise free sensor
+//   -p, -r, -y  pitch, roll and yaw gains in place of pid.h's
+//   -t  writes a trace every TRACE_US
+//   -v  shows the sketch's serial output
+//
+// Exits 1 on a crash, or with -k if the motors are not stopped at the end.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "EnableInterrupt.h"
+#include "LoopProfile.h"
+#include "SoftwareServo.h"
+#include "motors.h"
+#include "pinmap.h"
+#include "flight_log.h"
+#include "mpu6050_model.h"
+#include "quad_physics.h"
+#include "sil_sketch.h"
+
+extern "C"
+{
+#include "pid.h"
+}
+
+namespace
+{
+
+const unsigned long PHYSICS_US = 250;
+const unsigned long DEFAULT_LOOP_US = 200;
+const unsigned long TRACE_US = 10000;
+const float DEFAULT_DURATION_S = 18.0;
+
+// receiver channels, in pin order; each pulses in its own slot of the frame
+enum
+{
+   RC_ROLL = 0,
+   RC_PITCH,
+   RC_THROTTLE,
+   RC_YAW,
+   RC_ARM,
+   RC_CHANNELS
+};
+const uint8_t RC_PINS[RC_CHANNELS] =
+{
+   REC_CHAN_1_PIN, REC_CHAN_2_PIN, REC_CHAN_3_PIN, REC_CHAN_4_PIN, REC_CHAN_5_PIN
+};
+const unsigned long RC_FRAME_US = 20000;
+const unsigned long RC_SLOT_US = 2500;
+
+const uint8_t MOTOR_PINS[QUAD_MOTORS] = { MOTOR_1_PIN, MOTOR_2_PIN, MOTOR_3_PIN, MOTOR_4_PIN };
+
+// SoftwareServo pulse resolution (us)
+const uint16_t SERVO_STEP_US = 16;
+
+// flight script (us), steps are STEP_STICK held for STEP_US
+const unsigned long ARM_US = 1000000UL;
+const unsigned long TAKEOFF_US = 2000000UL;
+const unsigned long SETTLED_US = 5000000UL;
+const unsigned long ROLL_STEP_US = 6000000UL;
+const unsigned long PITCH_STEP_US = 10000000UL;
+const unsigned long YAW_STEP_US = 14000000UL;
+const unsigned long STEP_US = 2000000UL;
+const float STEP_STICK = 0.3;
+
+// a step has settled once within this fraction of its size
+const float SETTLE_BAND = 0.1;
+
+// pilot altitude hold on the throttle stick
+const float TAKEOFF_M = 2.0;
+const float HOLD_GAIN = 0.05;       // stick per m
+const float HOLD_DAMPING = 0.05;    // stick per m/s
+
+// tilt that counts as lost control (degrees)
+const float UPSET_DEG = 60.0;
+
+const float NOISE_ATTITUDE_DEG = 0.1;
+const float NOISE_GYRO_DPS = 0.5;
+const float NOISE_ACCEL_G = 0.01;
+
+// Monte Carlo spreads (fraction of nominal) and gusts
+const float MASS_SPREAD = 0.1;
+const float INERTIA_SPREAD = 0.2;
+const float MOTOR_TAU_SPREAD = 0.2;
+const float THRUST_SPREAD = 0.05;
+const unsigned long GUST_US = 500000UL;
+const float GUST_TORQUE_NM = 0.02;
+const float GUST_YAW_TORQUE_NM = 0.004;
+const float GUST_FORCE_N = 1.0;
+
+// batch result line, yaw pitch roll order as the rest of the report
+const char * const RESULT_FIELDS =
+   "crashed,upset_s,settle_yaw_s,settle_pitch_s,settle_roll_s,"
+   "overshoot_yaw_pct,overshoot_pitch_pct,overshoot_roll_pct,saturation_pct,track_rms_deg";
+
+QuadPhysics physics(QUAD_DEFAULT_PARAMS);
+Mpu6050Model sensor(IMU_INT_PIN);
+
+unsigned long flightStart;            // end of setup(), time 0 of the script
+unsigned long nextPhysics;
+unsigned long rcRise[RC_CHANNELS];     // start of the channel's current pulse
+unsigned long rcEdge[RC_CHANNELS];     // next edge on the channel
+bool rcHigh[RC_CHANNELS];
+
+FlightLogWriter flightLog;
+
+bool gusts = false;
+uint32_t gustState;
+unsigned long nextGust;
+
+// Uniform deviate in [-1, 1) (xorshift32)
+float Spread(uint32_t &state)
+{
+   state ^= state << 13;
+   state ^= state >> 17;
+   state ^= state << 5;
+   return (state >> 8) * (2.0 / 16777216.0) - 1.0;
+}
+
+// Throttle stick that holds the default airframe in a hover
+float HoverStick()
+{
+   const QuadParams &p = QUAD_DEFAULT_PARAMS;
+   const float speed = sqrt(p.massKg * 9.81 / (QUAD_MOTORS * p.maxThrustN));
+   const float degrees = speed * MAX_THROTTLE_DEG;
+
+   return 2.0 * degrees / MAX_THROTTLE_DEG - 1.0;
+}
+
+// Stick positions (-1 to 1) the script holds at time t
+void Pilot(const unsigned long t, float stick[RC_CHANNELS])
+{
+   const float climb = (t < TAKEOFF_US) ? 0.0 : fmin(1.0, (t - TAKEOFF_US) / 2e6);
+
+   for (int i = 0; i < RC_CHANNELS; i++)
+   {
+      stick[i] = 0;
+   }
+
+   // arm switch seen low first, as the receiver requires
+   stick[RC_ARM] = (t < ARM_US) ? -1.0 : 1.0;
+   stick[RC_THROTTLE] = (t < TAKEOFF_US) ? -1.0 :
+                        HoverStick() + HOLD_GAIN * (climb * TAKEOFF_M - physics.GetPosition()[2]) -
+                        HOLD_DAMPING * physics.GetVelocity()[2];
+   stick[RC_THROTTLE] = fmax(-1.0, fmin(1.0, stick[RC_THROTTLE]));
+
+   if ((t >= ROLL_STEP_US) && (t < ROLL_STEP_US + STEP_US))
+   {
+      stick[RC_ROLL] = STEP_STICK;
+   }
+   if ((t >= PITCH_STEP_US) && (t < PITCH_STEP_US + STEP_US))
+   {
+      stick[RC_PITCH] = STEP_STICK;
+   }
+   if ((t >= YAW_STEP_US) && (t < YAW_STEP_US + STEP_US))
+   {
+      stick[RC_YAW] = STEP_STICK;
+   }
+}
+
+// Scales the default airframe by the seed's spreads
+void Perturb(uint32_t &state)
+{
+   QuadParams params = QUAD_DEFAULT_PARAMS;
+   float scale[QUAD_MOTORS];
+
+   params.massKg *= 1.0 + MASS_SPREAD * Spread(state);
+   params.motorTauS *= 1.0 + MOTOR_TAU_SPREAD * Spread(state);
+   for (int i = 0; i < 3; i++)
+   {
+      params.inertia[i] *= 1.0 + INERTIA_SPREAD * Spread(state);
+   }
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      scale[i] = 1.0 + THRUST_SPREAD * Spread(state);
+   }
+   physics.SetParams(params);
+   physics.SetMotorScale(scale);
+}
+
+// Host timer: physics steps, gusts and receiver edges, whichever is due
+unsigned long Tick(const unsigned long now)
+{
+   unsigned long next;
+   float stick[RC_CHANNELS];
+   uint16_t pulses[QUAD_MOTORS];
+
+   if (gusts && (now >= nextGust))
+   {
+      const float torque[3] = { GUST_TORQUE_NM * Spread(gustState), GUST_TORQUE_NM * Spread(gustState),
+                                GUST_YAW_TORQUE_NM * Spread(gustState) };
+      const float force[3] = { GUST_FORCE_N * Spread(gustState), GUST_FORCE_N * Spread(gustState), 0 };
+
+      physics.SetDisturbance(torque, force);
+      nextGust += GUST_US;
+   }
+
+   if (now >= nextPhysics)
+   {
+      for (int i = 0; i < QUAD_MOTORS; i++)
+      {
+         pulses[i] = HostServoPulse(MOTOR_PINS[i]);
+      }
+      physics.Step(PHYSICS_US * 1e-6, pulses);
+      sensor.Update();
+      nextPhysics += PHYSICS_US;
+   }
+
+   for (int i = 0; i < RC_CHANNELS; i++)
+   {
+      if (now < rcEdge[i])
+      {
+         continue;
+      }
+      flightLog.Edge(now, RC_PINS[i], rcHigh[i] ? LOW : HIGH);
+      if (rcHigh[i])
+      {
+         HostDrivePin(RC_PINS[i], LOW);
+         rcEdge[i] = rcRise[i] + RC_FRAME_US;
+      }
+      else
+      {
+         // 1000 to 2000 us for stick -1 to 1
+         Pilot((now > flightStart) ? now - flightStart : 0, stick);
+         HostDrivePin(RC_PINS[i], HIGH);
+         rcRise[i] = now;
+         rcEdge[i] = now + (unsigned long)(1500 + 500 * stick[i]);
+      }
+      rcHigh[i] = !rcHigh[i];
+   }
+
+   next = nextPhysics;
+   if (gusts && (nextGust < next))
+   {
+      next = nextGust;
+   }
+   for (int i = 0; i < RC_CHANNELS; i++)
+   {
+      if (rcEdge[i] < next)
+      {
+         next = rcEdge[i];
+      }
+   }
+   return next;
+}
+
+void LogPacket(const uint8_t *packet)
+{
+   flightLog.Packet(micros(), packet, Mpu6050Model::PACKET_SIZE);
+}
+
+// Parses "kp,ki,kd"
+bool ParseGains(const char *arg, PidGains &gains)
+{
+   return sscanf(arg, "%f,%f,%f", &gains.kp, &gains.ki, &gains.kd) == 3;
+}
+
+float AngleError(const float a, const float b)
+{
+   float error = fmod(a - b, 360.0);
+
+   if (error > 180.0)
+   {
+      error -= 360.0;
+   }
+   else if (error < -180.0)
+   {
+      error += 360.0;
+   }
+   return error;
+}
+
+struct AxisStats
+{
+   const char *name;
+   unsigned long stepUs;   // script time of the axis step
+   double trackSquares;    // command - truth
+   float trackMax;
+   double imuSquares;      // IMU - truth
+   float imuMax;
+   float base;             // command before the step
+   float overshoot;        // beyond the step target (percent of the step)
+   unsigned long settle;   // step start to last time outside the band (us)
+};
+
+void Accumulate(AxisStats &axis, const float cmd, const float imu, const float truth)
+{
+   const float track = AngleError(cmd, truth);
+   const float imuError = AngleError(imu, truth);
+
+   axis.trackSquares += track * track;
+   axis.trackMax = fmax(axis.trackMax, fabs(track));
+   axis.imuSquares += imuError * imuError;
+   axis.imuMax = fmax(axis.imuMax, fabs(imuError));
+}
+
+// Overshoot and settling of the step response at script time t
+void ScoreStep(AxisStats &axis, const unsigned long t, const float cmd, const float truth)
+{
+   float span;
+   float error;
+
+   if (t < axis.stepUs)
+   {
+      axis.base = cmd;
+      return;
+   }
+   if (t >= axis.stepUs + STEP_US)
+   {
+      return;
+   }
+
+   // the command is the step target once the receiver has the frame
+   span = cmd - axis.base;
+   if (fabs(span) < 1.0)
+   {
+      axis.settle = t - axis.stepUs;
+      return;
+   }
+   error = AngleError(truth, cmd);
+   axis.overshoot = fmax(axis.overshoot, 100.0 * error / span);
+   if (fabs(error) > SETTLE_BAND * fabs(span))
+   {
+      axis.settle = t - axis.stepUs;
+   }
+}
+
+// Every motor at its minimum pulse
+bool MotorsStopped()
+{
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      if (HostServoPulse(MOTOR_PINS[i]) > MIN_THROTTLE_US)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Any PID output or motor at the end of its range
+bool Saturated()
+{
+   float pid[3];
+   uint16_t pulse;
+
+   SilGetPidOutputs(pid[0], pid[1], pid[2]);
+   if ((pid[0] >= YAW_UPPER_LIMIT) || (pid[0] <= YAW_LOWER_LIMIT) ||
+       (pid[1] >= PITCH_UPPER_LIMIT) || (pid[1] <= PITCH_LOWER_LIMIT) ||
+       (pid[2] >= ROLL_UPPER_LIMIT) || (pid[2] <= ROLL_LOWER_LIMIT))
+   {
+      return true;
+   }
+   for (int i = 0; i < QUAD_MOTORS; i++)
+   {
+      pulse = HostServoPulse(MOTOR_PINS[i]);
+      if ((pulse <= MIN_THROTTLE_US) || (pulse + SERVO_STEP_US > MAX_THROTTLE_US))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+
+// Opens a pseudo terminal in raw mode for the sketch's USB port and says
+// where; writes wait while its reader falls behind
+FILE *OpenPty()
+{
+   const int fd = posix_openpt(O_RDWR | O_NOCTTY);
+   struct termios tty;
+   FILE *out;
+
+   if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0) || (tcgetattr(fd, &tty) != 0))
+   {
+      return NULL;
+   }
+   cfmakeraw(&tty);
+   tcsetattr(fd, TCSANOW, &tty);
+
+   out = fdopen(fd, "wb");
+   if (out != NULL)
+   {
+      setvbuf(out, NULL, _IONBF, 0);
+      fprintf(stderr, "USB port on %s\n", ptsname(fd));
+   }
+   return out;
+}
+}
+
+int main(int argc, char **argv)
+{
+   float duration = DEFAULT_DURATION_S;
+   unsigned long loopUs = DEFAULT_LOOP_US;
+   bool noise = true;
+   bool verbose = false;
+   bool batch = false;
+   bool perturb = false;
+   uint32_t seed = 1;
+   FILE *trace = NULL;
+   FILE *blackboxLog = NULL;
+   FILE *usb = NULL;
+   bool realTime = false;
+   AxisStats axes[3] = { { "yaw", YAW_STEP_US }, { "pitch", PITCH_STEP_US }, { "roll", ROLL_STEP_US } };
+   unsigned long samples = 0;
+   unsigned long saturated = 0;
+   unsigned long loops = 0;
+   unsigned long nextTrace = 0;
+   unsigned long end;
+   unsigned long upsetAt = 0;
+   unsigned long killUs = 0;
+   bool killed = false;
+   unsigned long stoppedAt = 0;
+   float maxAltitude = 0;
+   double trackSquares = 0;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:cd:e:f:k:l:np:r:s:t:uvy:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b':
+            blackboxLog = fopen(optarg, "wb");
+            if (blackboxLog == NULL)
+            {
+               perror(optarg);
+               return 2;
+            }
+            HostSerialCapture(Serial2, blackboxLog);
+            break;
+         case 'c':
+            batch = true;
+            break;
+         case 'd':
+            duration = atof(optarg);
+            break;
+         case 'e':
+            usb = (strcmp(optarg, "pty") == 0) ? OpenPty() : fopen(optarg, "wb");
+            if (usb == NULL)
+            {
+               perror(optarg);
+               return 2;
+            }
+            realTime = (strcmp(optarg, "pty") == 0);
+            HostSerialCapture(Serial, usb);
+            break;
+         case 'f':
+            if (!flightLog.Open(optarg))
+            {
+               perror(optarg);
+               return 2;
+            }
+            sensor.SetPacketTap(LogPacket);
+            break;
+         case 'k':
+            killUs = (unsigned long)(atof(optarg) * 1e6);
+            break;
+         case 'l':
+            loopUs = strtoul(optarg, NULL, 10);
+            break;
+         case 'n':
+            noise = false;
+            break;
+         case 'p':
+         case 'r':
+         case 'y':
+            if (!ParseGains(optarg, (opt == 'p') ? pidPitchGains : (opt == 'r') ? pidRollGains : pidYawGains))
+            {
+               fprintf(stderr, "bad gains '%s', expected kp,ki,kd\n", optarg);
+               return 2;
+            }
+            break;
+         case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+         case 't':
+            trace = fopen(optarg, "w");
+            if (trace == NULL)
+            {
+               perror(optarg);
+               return 2;
+            }
+            break;
+         case 'u':
+            perturb = true;
+            break;
+         case 'v':
+            verbose = true;
+            break;
+         default:
+            fprintf(stderr, "usage: %s [-b blackbox.bbl] [-c] [-d seconds] [-e usb.bin|pty] [-f flight.log]\n"
+                            "       [-k seconds] [-l loop_us] [-n] [-p|-r|-y kp,ki,kd] [-s seed] [-t trace.csv]\n"
+                            "       [-u] [-v]\n", argv[0]);
+            return 2;
+      }
+   }
+
+   const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+   HostSerialMute(!verbose && (usb == NULL));
+   I2Cdev::hostBus = &sensor;
+   sensor.SetMotion(&physics);
+   if (noise)
+   {
+      sensor.SetNoise(NOISE_ATTITUDE_DEG, NOISE_GYRO_DPS, NOISE_ACCEL_G, seed);
+   }
+   if (perturb)
+   {
+      // a state of 0 would stick at 0
+      gustState = seed * 2654435761UL + 1;
+      Perturb(gustState);
+   }
+
+   // the receiver is live (arm low) while the sketch sets up
+   flightStart = (unsigned long)-1;
+   nextPhysics = micros();
+   for (int i = 0; i < RC_CHANNELS; i++)
+   {
+      rcHigh[i] = false;
+      rcEdge[i] = micros() + i * RC_SLOT_US;
+   }
+   HostSetTimer(Tick, micros());
+
+   setup();
+
+   const unsigned long start = micros();
+   flightStart = start;
+   end = start + (unsigned long)(duration * 1e6);
+
+   // gusts once airborne
+   gusts = perturb;
+   nextGust = start + TAKEOFF_US + GUST_US;
+
+   if (trace != NULL)
+   {
+      fprintf(trace, "t_s,yaw_cmd,pitch_cmd,roll_cmd,throttle,arm,yaw_pid,pitch_pid,roll_pid,"
+                     "yaw,pitch,roll,yaw_imu,pitch_imu,roll_imu,z_m,m1_us,m2_us,m3_us,m4_us\n");
+   }
+
+   while ((micros() < end) && (upsetAt == 0))
+   {
+      float cmd[3], pid[3], imu[3], truth[3];
+      uint8_t motors[QUAD_MOTORS];
+      int throttle, arm;
+      unsigned long sampleTime;
+      const unsigned long passTime = micros();
+      const unsigned long t = passTime - start;
+
+      if ((killUs != 0) && !killed && (t >= killUs))
+      {
+         sensor.Disconnect();
+         killed = true;
+      }
+
+      loop();
+      for (int i = 0; i < QUAD_MOTORS; i++)
+      {
+         motors[i] = HostServoAngle(MOTOR_PINS[i]);
+      }
+      if (killed)
+      {
+         // must stay stopped once stopped
+         if (!MotorsStopped())
+         {
+            stoppedAt = 0;
+         }
+         else if (stoppedAt == 0)
+         {
+            stoppedAt = t;
+         }
+      }
+      flightLog.Pass(passTime, motors);
+      HostAdvanceMicros(loopUs);
+      loops++;
+
+      if (realTime)
+      {
+         // no faster than the wall clock
+         std::this_thread::sleep_until(wallStart + std::chrono::microseconds(micros() - start));
+      }
+
+      SilGetCommands(cmd[0], cmd[1], cmd[2], throttle, arm);
+      SilGetAttitude(imu[0], imu[1], imu[2], sampleTime);
+      physics.GetYawPitchRoll(truth[0], truth[1], truth[2]);
+      maxAltitude = fmax(maxAltitude, physics.GetPosition()[2]);
+
+      // the run ends here
+      if (!physics.OnGround() && ((fabs(truth[1]) > UPSET_DEG) || (fabs(truth[2]) > UPSET_DEG)))
+      {
+         upsetAt = t;
+      }
+
+      for (int i = 0; i < 3; i++)
+      {
+         ScoreStep(axes[i], t, cmd[i], truth[i]);
+      }
+      if (t >= SETTLED_US)
+      {
+         for (int i = 0; i < 3; i++)
+         {
+            Accumulate(axes[i], cmd[i], imu[i], truth[i]);
+         }
+         if (Saturated())
+         {
+            saturated++;
+         }
+         samples++;
+      }
+
+      if ((trace != NULL) && (t >= nextTrace))
+      {
+         SilGetPidOutputs(pid[0], pid[1], pid[2]);
+         fprintf(trace, "%.3f,%.2f,%.2f,%.2f,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%u,%u,%u,%u\n",
+                 t * 1e-6, cmd[0], cmd[1], cmd[2], throttle, arm, pid[0], pid[1], pid[2],
+                 truth[0], truth[1], truth[2], imu[0], imu[1], imu[2], physics.GetPosition()[2],
+                 HostServoPulse(MOTOR_PINS[0]), HostServoPulse(MOTOR_PINS[1]),
+                 HostServoPulse(MOTOR_PINS[2]), HostServoPulse(MOTOR_PINS[3]));
+         nextTrace += TRACE_US;
+      }
+   }
+   HostSetTimer(NULL, 0);
+   if (!flightLog.Close())
+   {
+      fprintf(stderr, "flight log write failed\n");
+      return 2;
+   }
+
+   const double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+   const float *position = physics.GetPosition();
+   const double n = (samples > 0) ? samples : 1;
+
+   if (trace != NULL)
+   {
+      fclose(trace);
+   }
+   if (blackboxLog != NULL)
+   {
+      HostSerialCapture(Serial2, NULL);
+      fclose(blackboxLog);
+   }
+   if (usb != NULL)
+   {
+      HostSerialCapture(Serial, stdout);
+      fclose(usb);
+   }
+
+   for (int i = 0; i < 3; i++)
+   {
+      trackSquares += axes[i].trackSquares;
+   }
+
+   if (batch)
+   {
+      printf("%d,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f,%.2f,%.3f\n", (upsetAt != 0) ? 1 : 0, upsetAt * 1e-6,
+             axes[0].settle * 1e-6, axes[1].settle * 1e-6, axes[2].settle * 1e-6,
+             axes[0].overshoot, axes[1].overshoot, axes[2].overshoot,
+             100.0 * saturated / n, sqrt(trackSquares / (3 * n)));
+      return ((upsetAt == 0) && (!killed || (stoppedAt != 0))) ? 0 : 1;
+   }
+
+   printf("simulated %.1f s in %.2f s wall (%.0fx real time), %lu loops, %lu packets\n",
+          (micros() - start) * 1e-6, wallS, (micros() - start) * 1e-6 / wallS, loops, sensor.GetPacketCount());
+   printf("axis,track_rms_deg,track_max_deg,imu_rms_deg,imu_max_deg,overshoot_pct,settle_s\n");
+   for (int i = 0; i < 3; i++)
+   {
+      const AxisStats &a = axes[i];
+
+      printf("%s,%.2f,%.2f,%.3f,%.3f,%.1f,%.3f\n", a.name, sqrt(a.trackSquares / n), a.trackMax,
+             sqrt(a.imuSquares / n), a.imuMax, a.overshoot, a.settle * 1e-6);
+   }
+   printf("saturated %.1f%% of control passes\n", 100.0 * saturated / n);
+   printf("max altitude %.2f m, final position %.2f,%.2f,%.2f m\n",
+          maxAltitude, position[0], position[1], position[2]);
+   if (blackboxLog != NULL)
+   {
+      const BlackboxStatus &bb = SilGetBlackboxStatus();
+
+      printf("blackbox %lu frames (%lu keyframes), %lu dropped, %lu bytes (%.0f bytes/s), ring peak %u\n",
+             bb.frames, bb.keyframes, bb.dropped, bb.bytes, bb.bytes / ((micros() - start) * 1e-6), bb.peakUsed);
+   }
+#if (LOOP_PROFILE == 1)
+   {
+      // never begun, so it writes straight out
+      HardwareSerial console(stdout);
+
+      fflush(stdout);
+      loopProfile.Dump(console);
+   }
+#endif
+   if (killed)
+   {
+      if (stoppedAt != 0)
+      {
+         printf("IMU lost at %.2f s, motors stopped %.0f ms later\n", killUs * 1e-6, (stoppedAt - killUs) * 1e-3);
+      }
+      else
+      {
+         printf("IMU lost at %.2f s, motors still running\n", killUs * 1e-6);
+      }
+   }
+   if (upsetAt != 0)
+   {
+      printf("upset at %.2f s\n", upsetAt * 1e-6);
+   }
+
+   return ((upsetAt == 0) && (!killed || (stoppedAt != 0))) ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Checks the receiver against an RC edge that lands while it is being read.
+//
+// Five channels are driven with 50 Hz PWM frames (arm switch low) until the
+// link is healthy. Then an edge is fired on the first channel read, after
+// ReadReceiver has taken the time but before it snapshots the channel, so
+// the edge is newer than the read time. That edge is fresh: no channel may
+// go stale and failsafe must not be entered.
+//
+// usage: receiver_edges
+
+#include <cstdio>
+
+#include "Arduino.h"
+#include "EnableInterrupt.h"
+#include "pid.h"
+#include "pinmap.h"
+#include "Receiver.h"
+
+namespace
+{
+
+const unsigned long FRAME_US = 20000;
+const unsigned long STEP_US = 50;
+const unsigned long READ_US = 1000;
+const unsigned long SETTLE_US = 1000000;
+
+const uint8_t PINS[PWM_IN_NUM] = {
+   REC_CHAN_1_PIN, REC_CHAN_2_PIN, REC_CHAN_3_PIN, REC_CHAN_4_PIN, REC_CHAN_5_PIN
+};
+
+// pulse widths (us): sticks centered, arm switch low
+const unsigned long WIDTHS[PWM_IN_NUM] = { 1500, 1500, 1500, 1500, 1000 };
+
+// channels start their frames a little apart, as a receiver sends them
+const unsigned long CHANNEL_OFFSET_US = 200;
+
+// yaw (channel 4) is the first channel ReadReceiver snapshots
+const unsigned int YAW = 3;
+
+// how long after the time read the edge lands (us)
+const unsigned long EDGE_DELAY_US = 4;
+
+Receiver receiver;
+
+// Sets every pin to the level its frame calls for at the current time
+void DrivePins()
+{
+   const unsigned long now = micros();
+
+   for (unsigned int i = 0; i < PWM_IN_NUM; i++)
+   {
+      const unsigned long phase = (now + FRAME_US - i * CHANNEL_OFFSET_US) % FRAME_US;
+      HostDrivePin(PINS[i], (phase < WIDTHS[i]) ? HIGH : LOW);
+   }
+}
+
+// The yaw frame starts early: just after the receiver read the time
+void EdgeAfterRead()
+{
+   HostAdvanceMicros(EDGE_DELAY_US);
+   HostDrivePin(PINS[YAW], HIGH);
+}
+
+bool Read()
+{
+   float yaw;
+   float pitch;
+   float roll;
+   int throttle;
+   int arm;
+
+   receiver.ReadReceiver(yaw, pitch, roll, throttle, arm);
+   return (yaw >= YAW_LOWER_LIMIT) && (yaw <= YAW_UPPER_LIMIT);
+}
+
+unsigned int StaleCount(const ReceiverStatus &status)
+{
+   unsigned int count = 0;
+
+   for (unsigned int i = 0; i < PWM_IN_NUM; i++)
+   {
+      count += status.staleCount[i];
+   }
+   return count;
+}
+
+}  // namespace
+
+int main()
+{
+   unsigned int failsafeCount;
+   unsigned int staleCount;
+
+   for (unsigned int i = 0; i < PWM_IN_NUM; i++)
+   {
+      HostSetPin(PINS[i], LOW);
+   }
+   receiver.SetupReceiver();
+
+   // fly frames until the link is up, ending with the yaw pin low
+   HostAdvanceMicros(STEP_US);
+   while ((micros() < SETTLE_US) || (digitalRead(PINS[YAW]) == HIGH))
+   {
+      DrivePins();
+      if ((micros() % READ_US) == 0)
+      {
+         Read();
+      }
+      HostAdvanceMicros(STEP_US);
+   }
+   Read();
+
+   if (receiver.GetStatus().state != FAILSAFE_OK)
+   {
+      printf("FAIL: link not up after %lu us (state %u)\n",
+             micros(), receiver.GetStatus().state);
+      return 1;
+   }
+   failsafeCount = receiver.GetStatus().failsafeCount;
+   staleCount = StaleCount(receiver.GetStatus());
+
+   HostAfterMicros(EdgeAfterRead);
+   if (!Read())
+   {
+      printf("FAIL: yaw command out of range after the edge\n");
+      return 1;
+   }
+
+   printf("edge %lu us after the read: state %u, failsafe entries %u, stale %u\n",
+          EDGE_DELAY_US, receiver.GetStatus().state,
+          receiver.GetStatus().failsafeCount, StaleCount(receiver.GetStatus()));
+
+   if ((receiver.GetStatus().state != FAILSAFE_OK) ||
+       (receiver.GetStatus().failsafeCount != failsafeCount) ||
+       (StaleCount(receiver.GetStatus()) != staleCount))
+   {
+      printf("FAIL: an edge newer than the read time was taken as stale\n");
+      return 1;
+   }
+
+   return 0;
+}
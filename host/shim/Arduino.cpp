@@ -0,0 +1,276 @@
+// Host implementation of the Arduino core subset declared in Arduino.h.
+
+#include "Arduino.h"
+
+HardwareSerial Serial(stdout);
+HardwareSerial Serial2(NULL);
+
+static unsigned long long hostMicros = 0;
+
+static HostHook microsHook = NULL;
+
+static HostTimer hostTimer = NULL;
+static unsigned long long hostTimerDue = 0;
+
+static uint8_t pinLevels[256];
+static bool pinLevelsSet = false;
+
+static bool serialMuted = false;
+
+static HardwareSerial * const ports[] = { &Serial, &Serial2 };
+
+// the transmit shift register and the data register behind it
+const unsigned int UART_HARDWARE_BYTES = 2;
+
+// Moves the clock to target, stopping at every host timer and UART
+// interrupt on the way
+void AdvanceTo(const unsigned long long target)
+{
+   for (;;)
+   {
+      unsigned long long next = (hostTimer != NULL) ? hostTimerDue : ~0ULL;
+      HardwareSerial *port = NULL;
+
+      for (HardwareSerial *p : ports)
+      {
+         if (p->UdreDue() < next)
+         {
+            next = p->UdreDue();
+            port = p;
+         }
+      }
+      if (next > target)
+      {
+         break;
+      }
+
+      hostMicros = next;
+      if (port != NULL)
+      {
+         port->RunUdre();
+      }
+      else
+      {
+         hostTimerDue = hostTimer(hostMicros);
+      }
+   }
+   hostMicros = target;
+}
+
+unsigned long millis()
+{
+   return hostMicros / 1000;
+}
+
+unsigned long micros()
+{
+   const unsigned long now = hostMicros;
+   const HostHook hook = microsHook;
+
+   // the hook may read the time itself, so clear it first
+   if (hook != NULL)
+   {
+      microsHook = NULL;
+      hook();
+   }
+   return now;
+}
+
+void delay(unsigned long ms)
+{
+   AdvanceTo(hostMicros + ms * 1000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+   AdvanceTo(hostMicros + us);
+}
+
+void HostAdvanceMicros(unsigned long us)
+{
+   AdvanceTo(hostMicros + us);
+}
+
+void HostAfterMicros(HostHook hook)
+{
+   microsHook = hook;
+}
+
+void HostSetTimer(HostTimer timer, unsigned long first)
+{
+   hostTimer = timer;
+   hostTimerDue = first;
+}
+
+void HostSetPin(uint8_t pin, uint8_t value)
+{
+   if (!pinLevelsSet)
+   {
+      memset(pinLevels, HIGH, sizeof(pinLevels));
+      pinLevelsSet = true;
+   }
+   pinLevels[pin] = value;
+}
+
+void HostSerialMute(bool mute)
+{
+   serialMuted = mute;
+}
+
+void HostSerialCapture(HardwareSerial &port, FILE *out)
+{
+   port.mOut = out;
+}
+
+void HostUartAttach(HardwareSerial &port, HostUartIsr isr)
+{
+   port.mUdre = isr;
+}
+
+void HostUartEnable(HardwareSerial &port, bool enable)
+{
+   port.mUdreEnabled = enable;
+   if (enable)
+   {
+      port.RunUdre();
+   }
+}
+
+// outputs go nowhere, inputs read back HostSetPin() levels
+void pinMode(uint8_t pin, uint8_t mode)
+{
+   (void)pin;
+   (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+   (void)pin;
+   (void)value;
+}
+
+int digitalRead(uint8_t pin)
+{
+   return pinLevelsSet ? pinLevels[pin] : HIGH;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+   // start, 8 data and stop bits
+   mByteNs = 10000000000ULL / baud;
+   mDoneNs = hostMicros * 1000ULL;
+}
+
+unsigned int HardwareSerial::Queued()
+{
+   const unsigned long long now = hostMicros * 1000ULL;
+
+   if ((mByteNs == 0) || (mDoneNs <= now))
+   {
+      return 0;
+   }
+   return (mDoneNs - now + mByteNs - 1) / mByteNs;
+}
+
+unsigned long long HardwareSerial::UdreDue()
+{
+   if (!mUdreEnabled || (mUdre == NULL))
+   {
+      return ~0ULL;
+   }
+   if (Queued() < UART_HARDWARE_BYTES)
+   {
+      return hostMicros;
+   }
+   // when the shift register takes the byte waiting in the data register
+   return (mDoneNs - mByteNs + 999) / 1000;
+}
+
+void HardwareSerial::RunUdre()
+{
+   while (mUdreEnabled && (mUdre != NULL) && (Queued() < UART_HARDWARE_BYTES))
+   {
+      mUdre();
+   }
+}
+
+int HardwareSerial::availableForWrite()
+{
+   return (SERIAL_TX_BUFFER_SIZE - 1) - Queued();
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+   if (mByteNs != 0)
+   {
+      // a full buffer holds the caller until a byte goes out
+      if (Queued() >= SERIAL_TX_BUFFER_SIZE - 1)
+      {
+         const unsigned long long sent = mDoneNs - (SERIAL_TX_BUFFER_SIZE - 2) * mByteNs;
+
+         AdvanceTo((sent + 999) / 1000);
+      }
+      mDoneNs = ((mDoneNs > hostMicros * 1000ULL) ? mDoneNs : hostMicros * 1000ULL) + mByteNs;
+   }
+
+   if ((mOut == NULL) || ((this == &Serial) && serialMuted))
+   {
+      return 1;
+   }
+   return (fputc(c, mOut) == EOF) ? 0 : 1;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+   size_t n = 0;
+
+   while (size-- > 0)
+   {
+      n += write(*buffer++);
+   }
+   return n;
+}
+
+size_t Print::print(const char *s)
+{
+   // as the core, one write of the whole string
+   return write((const uint8_t *)s, strlen(s));
+}
+
+size_t Print::print(char c)
+{
+   return write((uint8_t)c);
+}
+
+size_t Print::print(long n, int base)
+{
+   char buffer[24];
+
+   if (base == DEC)
+   {
+      snprintf(buffer, sizeof(buffer), "%ld", n);
+      return print(buffer);
+   }
+   return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+   char buffer[24];
+
+   snprintf(buffer, sizeof(buffer), (base == HEX) ? "%lX" : "%lu", n);
+   return print(buffer);
+}
+
+size_t Print::print(double n, int digits)
+{
+   char buffer[48];
+
+   snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+   return print(buffer);
+}
+
+size_t Print::println()
+{
+   return print("\n");
+}
@@ -0,0 +1,163 @@
+// Minimal Arduino core for host builds of the firmware modules.
+//
+// Time is simulated: micros() only moves when delay(), delayMicroseconds()
+// or HostAdvanceMicros() is called, so a simulated bus or sensor decides how
+// long each operation takes and runs are repeatable. A host timer runs at
+// exact simulated times as time moves, like a hardware interrupt would.
+// Input pins read back the level set by HostSetPin(). Serial ports transmit
+// at the rate begin() set through a 64 byte buffer, so write() waits (time
+// moves on) when it is full, as on the board; Serial goes to stdout unless
+// muted, the other ports nowhere unless captured. A port's data register
+// empty interrupt can be attached, for code that drives the UART itself.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <type_traits>
+
+#include "avr/pgmspace.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+
+#define F(string_literal) (string_literal)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Moves simulated time forward
+void HostAdvanceMicros(unsigned long us);
+
+// Runs once straight after the next micros() read, before the caller gets
+// the time, like an interrupt landing just after the timer was read
+typedef void (*HostHook)();
+void HostAfterMicros(HostHook hook);
+
+// Called when simulated time reaches the time it last returned (us), first
+// at time first. NULL stops it.
+typedef unsigned long (*HostTimer)(unsigned long now);
+void HostSetTimer(HostTimer timer, unsigned long first);
+
+// Level digitalRead() returns for pin (pins start HIGH, as if pulled up)
+void HostSetPin(uint8_t pin, uint8_t value);
+
+// Drops Serial output while set
+void HostSerialMute(bool mute);
+
+class HardwareSerial;
+
+// Sends what is transmitted on port to out (NULL drops it)
+void HostSerialCapture(HardwareSerial &port, FILE *out);
+
+// Data register empty interrupt of port: while enabled it runs whenever the
+// transmitter can take a byte (the data register is empty), as the UDRE
+// interrupt does, and must write a byte or disable itself. Enabling it with
+// the register empty runs it straight away.
+typedef void (*HostUartIsr)();
+void HostUartAttach(HardwareSerial &port, HostUartIsr isr);
+void HostUartEnable(HardwareSerial &port, bool enable);
+
+// the core's macros, as functions returning the promoted type
+template<typename T, typename U>
+inline typename std::common_type<T, U>::type min(T a, U b) { return (a < b) ? a : b; }
+template<typename T, typename U>
+inline typename std::common_type<T, U>::type max(T a, U b) { return (a > b) ? a : b; }
+template<typename T, typename L, typename H>
+inline typename std::common_type<T, L, H>::type constrain(T x, L low, H high)
+{
+   return (x < low) ? low : ((x > high) ? high : x);
+}
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+class Print
+{
+ public:
+   virtual ~Print() {}
+   virtual size_t write(uint8_t c) = 0;
+   virtual size_t write(const uint8_t *buffer, size_t size);
+
+   size_t print(const char *s);
+   size_t print(char c);
+   size_t print(long n, int base = DEC);
+   size_t print(unsigned long n, int base = DEC);
+   size_t print(int n, int base = DEC)           { return print((long)n, base); }
+   size_t print(unsigned int n, int base = DEC)  { return print((unsigned long)n, base); }
+   size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+   size_t print(double n, int digits = 2);
+
+   size_t println();
+   template<typename T> size_t println(T value)          { size_t n = print(value); return n + println(); }
+   template<typename T> size_t println(T value, int fmt) { size_t n = print(value, fmt); return n + println(); }
+};
+
+// the core's transmit buffer, one slot of which is always left free
+#define SERIAL_TX_BUFFER_SIZE 64
+
+class HardwareSerial : public Print
+{
+ public:
+   explicit HardwareSerial(FILE *out) : mOut(out), mByteNs(0), mDoneNs(0), mUdre(NULL), mUdreEnabled(false) {}
+
+   void begin(unsigned long baud);
+   int available()                { return 0; }
+   int read()                     { return -1; }
+   long parseInt()                { return 0; }
+   int availableForWrite();
+   size_t write(uint8_t c);
+   using Print::write;
+
+ private:
+   // Bytes waiting to be shifted out
+   unsigned int Queued();
+
+   // Time (us) the data register next empties with the interrupt enabled,
+   // never (all ones) if it is disabled
+   unsigned long long UdreDue();
+
+   // Runs the interrupt while it is enabled and the data register is empty
+   void RunUdre();
+
+   FILE *mOut;
+   unsigned long long mByteNs;   // time to send a byte, 0 before begin()
+   unsigned long long mDoneNs;   // time the last queued byte is sent
+   HostUartIsr mUdre;
+   bool mUdreEnabled;
+
+   friend void HostSerialCapture(HardwareSerial &port, FILE *out);
+   friend void HostUartAttach(HardwareSerial &port, HostUartIsr isr);
+   friend void HostUartEnable(HardwareSerial &port, bool enable);
+   friend void AdvanceTo(const unsigned long long target);
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+#endif /* HOST_ARDUINO_H */
@@ -0,0 +1,45 @@
+// Host implementation of the EnableInterrupt subset declared in EnableInterrupt.h.
+
+#include "Arduino.h"
+#include "EnableInterrupt.h"
+
+// one handler per Arduino pin number, with its trigger mode
+static void (*handlers[256])(void);
+static uint8_t modes[256];
+
+void enableInterrupt(uint8_t pin, void (*handler)(void), uint8_t mode)
+{
+   handlers[pin] = handler;
+   modes[pin] = mode;
+}
+
+void disableInterrupt(uint8_t pin)
+{
+   handlers[pin] = 0;
+}
+
+void HostRaiseInterrupt(uint8_t pin)
+{
+   if (handlers[pin] != 0)
+   {
+      handlers[pin]();
+   }
+}
+
+void HostDrivePin(uint8_t pin, uint8_t level)
+{
+   const int previous = digitalRead(pin);
+
+   HostSetPin(pin, level);
+   if (level == previous)
+   {
+      return;
+   }
+
+   if ((modes[pin] == CHANGE) ||
+       ((modes[pin] == RISING) && (level == HIGH)) ||
+       ((modes[pin] == FALLING) && (level == LOW)))
+   {
+      HostRaiseInterrupt(pin);
+   }
+}
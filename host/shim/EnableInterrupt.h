@@ -0,0 +1,21 @@
+// Host stand-in for the EnableInterrupt library. Handlers are kept per pin
+// and run when simulated hardware signals an edge: HostRaiseInterrupt() for
+// a pulse (e.g. the MPU6050 INT output), HostDrivePin() for a pin level
+// change matched against the mode the handler was enabled with.
+
+#ifndef HOST_ENABLEINTERRUPT_H
+#define HOST_ENABLEINTERRUPT_H
+
+#include <stdint.h>
+
+void enableInterrupt(uint8_t pin, void (*handler)(void), uint8_t mode);
+void disableInterrupt(uint8_t pin);
+
+// Runs the handler attached to pin, if any
+void HostRaiseInterrupt(uint8_t pin);
+
+// Sets the level digitalRead() returns for pin and runs its handler if the
+// change matches the enabled mode (RISING, FALLING or CHANGE)
+void HostDrivePin(uint8_t pin, uint8_t level);
+
+#endif /* HOST_ENABLEINTERRUPT_H */
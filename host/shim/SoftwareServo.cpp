@@ -0,0 +1,126 @@
+// Host implementation of SoftwareServo, see SoftwareServo.h.
+
+#include "Arduino.h"
+#include "SoftwareServo.h"
+
+// library defaults (544 us to 2400 us) and refresh period
+const uint8_t DEFAULT_MIN16 = 34;
+const uint8_t DEFAULT_MAX16 = 150;
+const unsigned long REFRESH_MS = 20;
+
+SoftwareServo *SoftwareServo::sFirst = NULL;
+
+static uint16_t pulses[256];
+
+SoftwareServo::SoftwareServo() :
+   mPin(0),
+   mAngle(0),
+   mMin16(DEFAULT_MIN16),
+   mMax16(DEFAULT_MAX16),
+   mPulseUs(DEFAULT_MIN16 * 16),
+   mNext(NULL)
+{
+}
+
+uint8_t SoftwareServo::attach(int pin)
+{
+   if (mPin == 0)
+   {
+      mNext = sFirst;
+      sFirst = this;
+   }
+   mPin = pin;
+   write(mAngle);
+   return 1;
+}
+
+void SoftwareServo::detach()
+{
+   SoftwareServo **s;
+
+   for (s = &sFirst; *s != NULL; s = &(*s)->mNext)
+   {
+      if (*s == this)
+      {
+         *s = mNext;
+         break;
+      }
+   }
+   pulses[mPin] = 0;
+   mPin = 0;
+}
+
+void SoftwareServo::write(int angle)
+{
+   if (angle < 0)
+   {
+      angle = 0;
+   }
+   if (angle > 180)
+   {
+      angle = 180;
+   }
+   mAngle = angle;
+   mPulseUs = (mMin16 * 16L) + ((mMax16 - mMin16) * 16L * mAngle) / 180L;
+}
+
+uint8_t SoftwareServo::read()
+{
+   return mAngle;
+}
+
+uint8_t SoftwareServo::attached()
+{
+   return mPin != 0;
+}
+
+void SoftwareServo::setMinimumPulse(uint16_t us)
+{
+   mMin16 = us / 16;
+}
+
+void SoftwareServo::setMaximumPulse(uint16_t us)
+{
+   mMax16 = us / 16;
+}
+
+void SoftwareServo::refresh()
+{
+   static unsigned long lastRefresh = 0;
+   uint16_t widest = 0;
+
+   if (millis() - lastRefresh < REFRESH_MS)
+   {
+      return;
+   }
+   lastRefresh = millis();
+
+   for (SoftwareServo *s = sFirst; s != NULL; s = s->mNext)
+   {
+      pulses[s->mPin] = s->mPulseUs;
+      if (s->mPulseUs > widest)
+      {
+         widest = s->mPulseUs;
+      }
+   }
+
+   // the pulses are timed by busy waiting
+   delayMicroseconds(widest);
+}
+
+uint16_t HostServoPulse(uint8_t pin)
+{
+   return pulses[pin];
+}
+
+uint8_t HostServoAngle(uint8_t pin)
+{
+   for (SoftwareServo *s = SoftwareServo::sFirst; s != NULL; s = s->mNext)
+   {
+      if (s->mPin == pin)
+      {
+         return s->mAngle;
+      }
+   }
+   return 0;
+}
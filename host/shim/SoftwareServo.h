@@ -0,0 +1,49 @@
+// Host stand-in for the SoftwareServo library.
+//
+// write() converts an angle to a pulse width the way the library does
+// (16 us resolution limits), and refresh() latches the pulses of every
+// attached servo at most every 20 ms, the rate the library drives them. Like
+// the library, refresh() holds the CPU for as long as the widest pulse.
+// HostServoPulse() reports the width an ESC on a pin last received and
+// HostServoAngle() the angle last written for it.
+
+#ifndef HOST_SOFTWARESERVO_H
+#define HOST_SOFTWARESERVO_H
+
+#include <stdint.h>
+
+class SoftwareServo
+{
+ public:
+   SoftwareServo();
+
+   uint8_t attach(int pin);
+   void detach();
+   void write(int angle);
+   uint8_t read();
+   uint8_t attached();
+   void setMinimumPulse(uint16_t us);
+   void setMaximumPulse(uint16_t us);
+
+   static void refresh();
+
+ private:
+   uint8_t mPin;
+   uint8_t mAngle;
+   uint8_t mMin16;         // minimum pulse, 16 us units
+   uint8_t mMax16;         // maximum pulse, 16 us units
+   uint16_t mPulseUs;      // width for the current angle
+   SoftwareServo *mNext;
+
+   static SoftwareServo *sFirst;
+
+   friend uint8_t HostServoAngle(uint8_t pin);
+};
+
+// Pulse width (us) last sent on pin by SoftwareServo::refresh(), 0 if none
+uint16_t HostServoPulse(uint8_t pin);
+
+// Angle last written to the servo on pin, 0 if none
+uint8_t HostServoAngle(uint8_t pin);
+
+#endif /* HOST_SOFTWARESERVO_H */
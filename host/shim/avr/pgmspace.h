@@ -0,0 +1,19 @@
+// Host stand-in for avr-libc program memory access: flash is ordinary memory.
+
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+typedef char prog_char;
+typedef uint8_t prog_uchar;
+
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+#endif /* HOST_PGMSPACE_H */
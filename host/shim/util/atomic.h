@@ -0,0 +1,13 @@
+// Host stand-in for avr-libc atomic blocks: host "interrupts" run between
+// calls, never inside one, so the block just runs its body once.
+
+#ifndef HOST_ATOMIC_H
+#define HOST_ATOMIC_H
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON      1
+
+#define ATOMIC_BLOCK(type) \
+   for (int atomicOnce = ((void)(type), 1); atomicOnce; atomicOnce = 0)
+
+#endif /* HOST_ATOMIC_H */
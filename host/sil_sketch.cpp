@@ -0,0 +1,44 @@
+// The flight sketch compiled for the host. Like the Arduino builder, include
+// the core header ahead of the .ino; the sketch's globals stay file statics
+// and are read through the accessors in sil_sketch.h.
+
+#include "Arduino.h"
+
+#include "quadcopterrtos.ino"
+
+#include "sil_sketch.h"
+
+void SilGetCommands(float &yaw, float &pitch, float &roll, int &throttle, int &armed)
+{
+   yaw = yawCmd;
+   pitch = pitchCmd;
+   roll = rollCmd;
+   throttle = throttleCmd;
+   armed = arm;
+}
+
+void SilGetPidOutputs(float &yaw, float &pitch, float &roll)
+{
+   yaw = newYawCmd;
+   pitch = newPitchCmd;
+   roll = newRollCmd;
+}
+
+void SilGetAttitude(float &yaw, float &pitch, float &roll, unsigned long &sampleTime)
+{
+   yaw = yawDeg;
+   pitch = pitchDeg;
+   roll = rollDeg;
+   sampleTime = imuTime;
+}
+
+const BlackboxStatus &SilGetBlackboxStatus()
+{
+#if (BLACKBOX == 1)
+   return blackbox.GetStatus();
+#else
+   static const BlackboxStatus none = { 0, 0, 0, 0, 0 };
+
+   return none;
+#endif
+}
@@ -0,0 +1,25 @@
+// The flight sketch built for the host, as sil_sketch.cpp compiles it, with
+// read access to the state it keeps in file statics.
+
+#ifndef HOST_SIL_SKETCH_H
+#define HOST_SIL_SKETCH_H
+
+#include "Blackbox.h"
+
+void setup();
+void loop();
+
+// Receiver commands as quadThread last saw them (degrees, throttle 0-179,
+// arm 0-100)
+void SilGetCommands(float &yaw, float &pitch, float &roll, int &throttle, int &arm);
+
+// PID outputs passed to the motors (degrees)
+void SilGetPidOutputs(float &yaw, float &pitch, float &roll);
+
+// Latest IMU attitude (degrees) and the time of its sample (us)
+void SilGetAttitude(float &yaw, float &pitch, float &roll, unsigned long &sampleTime);
+
+// Flight recorder counters
+const BlackboxStatus &SilGetBlackboxStatus();
+
+#endif /* HOST_SIL_SKETCH_H */
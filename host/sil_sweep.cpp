@@ -0,0 +1,537 @@
+// Gain sweep and Monte Carlo robustness runs of the software in the loop
+// flight (quad_sil).
+//
+// Every candidate gain set (the product of the -a and -y grids) flies once
+// per seed, each run a quad_sil process with its seed perturbing the airframe
+// and driving gusts and sensor noise (quad_sil -u). The sketch keeps its state
+// in globals, so runs are isolated as processes; a pool of worker threads
+// launches them. Jobs are dealt round robin onto per worker deques; a worker
+// takes from the back of its own and, when empty, steals from the front of
+// the others, so uneven run times (a crash ends a run early) keep every core
+// busy.
+//
+// Candidates are ranked by crash rate, then by mean cost over the runs that
+// did not crash (see Cost()), and written as CSV.
+//
+// usage: sil_sweep [-a grid] [-y grid] [-n seeds] [-j workers] [-b quad_sil]
+//                  [-o ranked.csv] [-k top]
+//   -a  pitch and roll gains, -y yaw gains, as kp=...,ki=...,kd=... where each
+//       value is a number or lo:hi:step; unset gains keep pid.h's values
+//   -n  seeds per candidate (default 20)
+//   -j  workers (default: every core)
+//   -b  quad_sil to run (default: next to sil_sweep)
+//   -k  rows of the ranking shown on stdout (default 10)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C"
+{
+#include "pid.h"
+}
+
+extern char **environ;
+
+namespace
+{
+
+const unsigned int DEFAULT_SEEDS = 20;
+const unsigned int DEFAULT_TOP = 10;
+
+// cost weights: degrees of tracking error weigh as much as a second of
+// settling, 100% of overshoot or 10% of saturated control passes
+const double SETTLE_WEIGHT = 1.0;       // per s
+const double OVERSHOOT_WEIGHT = 0.01;   // per percent
+const double SATURATION_WEIGHT = 0.1;   // per percent
+
+struct Gains
+{
+   float kp;
+   float ki;
+   float kd;
+};
+
+struct Candidate
+{
+   Gains attitude;      // pitch and roll
+   Gains yaw;
+};
+
+// One quad_sil result line, fields in its RESULT_FIELDS order
+struct RunResult
+{
+   bool valid;          // the run completed and reported
+   bool crashed;
+   float upsetS;
+   float settleS[3];    // yaw, pitch, roll
+   float overshootPct[3];
+   float saturationPct;
+   float trackRmsDeg;
+};
+
+struct CandidateStats
+{
+   size_t index;
+   unsigned int runs;
+   unsigned int crashes;
+   unsigned int failures;  // runs that did not report
+   double cost;
+   double trackRmsDeg;
+   double settleS[3];
+   float overshootPct[3];  // worst
+   double saturationPct;
+};
+
+// Deque of job indices; the owner works from the back, thieves the front
+class WorkQueue
+{
+ public:
+   void Push(const size_t job)
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mJobs.push_back(job);
+   }
+
+   bool Pop(size_t &job)
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mJobs.empty())
+      {
+         return false;
+      }
+      job = mJobs.back();
+      mJobs.pop_back();
+      return true;
+   }
+
+   bool Steal(size_t &job)
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mJobs.empty())
+      {
+         return false;
+      }
+      job = mJobs.front();
+      mJobs.pop_front();
+      return true;
+   }
+
+ private:
+   std::mutex mMutex;
+   std::deque<size_t> mJobs;
+};
+
+// Parses "lo:hi:step" or a single value into values
+bool ParseRange(const char *text, std::vector<float> &values)
+{
+   float lo, hi, step;
+   int fields = sscanf(text, "%f:%f:%f", &lo, &hi, &step);
+
+   values.clear();
+   if (fields == 1)
+   {
+      values.push_back(lo);
+      return true;
+   }
+   if ((fields != 3) || (step <= 0) || (hi < lo))
+   {
+      return false;
+   }
+   // half a step of slack so float steps reach hi
+   for (int i = 0; lo + i * step <= hi + step / 2; i++)
+   {
+      values.push_back(lo + i * step);
+   }
+   return true;
+}
+
+// Parses "kp=...,ki=...,kd=..." into per gain value lists
+bool ParseGrid(const char *text, std::vector<float> grid[3])
+{
+   std::string spec(text);
+   size_t start = 0;
+
+   while (start < spec.size())
+   {
+      size_t end = spec.find(',', start);
+      std::string item = spec.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+      int gain;
+
+      if (item.compare(0, 3, "kp=") == 0)
+      {
+         gain = 0;
+      }
+      else if (item.compare(0, 3, "ki=") == 0)
+      {
+         gain = 1;
+      }
+      else if (item.compare(0, 3, "kd=") == 0)
+      {
+         gain = 2;
+      }
+      else
+      {
+         return false;
+      }
+      if (!ParseRange(item.c_str() + 3, grid[gain]))
+      {
+         return false;
+      }
+      if (end == std::string::npos)
+      {
+         break;
+      }
+      start = end + 1;
+   }
+   return true;
+}
+
+void ExpandGrid(const std::vector<float> grid[3], std::vector<Gains> &gains)
+{
+   for (float kp : grid[0])
+   {
+      for (float ki : grid[1])
+      {
+         for (float kd : grid[2])
+         {
+            gains.push_back({ kp, ki, kd });
+         }
+      }
+   }
+}
+
+// Runs quad_sil and reads back its result line
+RunResult Run(const std::string &binary, const Candidate &candidate, const unsigned int seed)
+{
+   RunResult result;
+   char seedArg[16];
+   char pitchArg[64];
+   char yawArg[64];
+   char line[256];
+   char *argv[] = { (char *)binary.c_str(), (char *)"-c", (char *)"-u", (char *)"-s", seedArg,
+                    (char *)"-p", pitchArg, (char *)"-r", pitchArg, (char *)"-y", yawArg, NULL };
+   posix_spawn_file_actions_t actions;
+   pid_t child;
+   int pipeFds[2];
+   int status;
+   int crashed;
+   FILE *output;
+
+   memset(&result, 0, sizeof(result));
+   snprintf(seedArg, sizeof(seedArg), "%u", seed);
+   snprintf(pitchArg, sizeof(pitchArg), "%g,%g,%g",
+            candidate.attitude.kp, candidate.attitude.ki, candidate.attitude.kd);
+   snprintf(yawArg, sizeof(yawArg), "%g,%g,%g", candidate.yaw.kp, candidate.yaw.ki, candidate.yaw.kd);
+
+   // close on exec, so no other worker's child holds this pipe open
+   if (pipe2(pipeFds, O_CLOEXEC) != 0)
+   {
+      return result;
+   }
+   posix_spawn_file_actions_init(&actions);
+   posix_spawn_file_actions_adddup2(&actions, pipeFds[1], STDOUT_FILENO);
+   status = posix_spawn(&child, binary.c_str(), &actions, NULL, argv, environ);
+   posix_spawn_file_actions_destroy(&actions);
+   close(pipeFds[1]);
+   if (status != 0)
+   {
+      close(pipeFds[0]);
+      return result;
+   }
+
+   output = fdopen(pipeFds[0], "r");
+   if ((fgets(line, sizeof(line), output) != NULL) &&
+       (sscanf(line, "%d,%f,%f,%f,%f,%f,%f,%f,%f,%f", &crashed, &result.upsetS,
+               &result.settleS[0], &result.settleS[1], &result.settleS[2],
+               &result.overshootPct[0], &result.overshootPct[1], &result.overshootPct[2],
+               &result.saturationPct, &result.trackRmsDeg) == 10))
+   {
+      result.valid = true;
+      result.crashed = (crashed != 0);
+   }
+   fclose(output);
+
+   // quad_sil exits 1 for a crash; anything else is a failed run
+   if ((waitpid(child, &status, 0) != child) || !WIFEXITED(status) || (WEXITSTATUS(status) > 1))
+   {
+      result.valid = false;
+   }
+   return result;
+}
+
+// Lower is better
+double Cost(const RunResult &r)
+{
+   double cost = r.trackRmsDeg + SATURATION_WEIGHT * r.saturationPct;
+
+   for (int i = 0; i < 3; i++)
+   {
+      cost += SETTLE_WEIGHT * r.settleS[i] + OVERSHOOT_WEIGHT * r.overshootPct[i];
+   }
+   return cost;
+}
+
+CandidateStats Aggregate(const size_t index, const RunResult *runs, const unsigned int seeds)
+{
+   CandidateStats stats;
+   unsigned int flown = 0;
+
+   memset(&stats, 0, sizeof(stats));
+   stats.index = index;
+   for (unsigned int s = 0; s < seeds; s++)
+   {
+      const RunResult &r = runs[s];
+
+      stats.runs++;
+      if (!r.valid)
+      {
+         stats.failures++;
+         continue;
+      }
+      if (r.crashed)
+      {
+         stats.crashes++;
+         continue;
+      }
+      stats.cost += Cost(r);
+      stats.trackRmsDeg += r.trackRmsDeg;
+      stats.saturationPct += r.saturationPct;
+      for (int i = 0; i < 3; i++)
+      {
+         stats.settleS[i] += r.settleS[i];
+         stats.overshootPct[i] = std::max(stats.overshootPct[i], r.overshootPct[i]);
+      }
+      flown++;
+   }
+
+   if (flown > 0)
+   {
+      stats.cost /= flown;
+      stats.trackRmsDeg /= flown;
+      stats.saturationPct /= flown;
+      for (int i = 0; i < 3; i++)
+      {
+         stats.settleS[i] /= flown;
+      }
+   }
+   else
+   {
+      stats.cost = HUGE_VAL;
+   }
+   return stats;
+}
+
+// Crash (and failure) rate first, then cost
+bool Ranks(const CandidateStats &a, const CandidateStats &b)
+{
+   const unsigned int lostA = a.crashes + a.failures;
+   const unsigned int lostB = b.crashes + b.failures;
+
+   if (lostA != lostB)
+   {
+      return lostA < lostB;
+   }
+   return a.cost < b.cost;
+}
+
+void PrintRow(FILE *out, const unsigned int rank, const Candidate &c, const CandidateStats &s)
+{
+   fprintf(out, "%u,%g,%g,%g,%g,%g,%g,%u,%u,%u,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f,%.2f\n",
+           rank, c.attitude.kp, c.attitude.ki, c.attitude.kd, c.yaw.kp, c.yaw.ki, c.yaw.kd,
+           s.runs, s.crashes, s.failures, s.cost, s.trackRmsDeg,
+           s.settleS[0], s.settleS[1], s.settleS[2],
+           s.overshootPct[0], s.overshootPct[1], s.overshootPct[2], s.saturationPct);
+}
+
+const char * const RANK_HEADER =
+   "rank,kp,ki,kd,yaw_kp,yaw_ki,yaw_kd,runs,crashes,failures,cost,track_rms_deg,"
+   "settle_yaw_s,settle_pitch_s,settle_roll_s,"
+   "max_overshoot_yaw_pct,max_overshoot_pitch_pct,max_overshoot_roll_pct,saturation_pct\n";
+
+}
+
+int main(int argc, char **argv)
+{
+   std::vector<float> attitudeGrid[3] = { { PITCH_KP }, { PITCH_KI }, { PITCH_KD } };
+   std::vector<float> yawGrid[3] = { { YAW_KP }, { YAW_KI }, { YAW_KD } };
+   std::vector<Gains> attitudeGains;
+   std::vector<Gains> yawGains;
+   std::vector<Candidate> candidates;
+   std::vector<RunResult> results;
+   std::vector<CandidateStats> ranking;
+   unsigned int seeds = DEFAULT_SEEDS;
+   unsigned int workers = std::thread::hardware_concurrency();
+   unsigned int top = DEFAULT_TOP;
+   std::string binary;
+   const char *outPath = NULL;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "a:b:j:k:n:o:y:")) != -1)
+   {
+      switch (opt)
+      {
+         case 'a':
+         case 'y':
+            if (!ParseGrid(optarg, (opt == 'a') ? attitudeGrid : yawGrid))
+            {
+               fprintf(stderr, "bad grid '%s', expected kp=...,ki=...,kd=... with values or lo:hi:step\n", optarg);
+               return 2;
+            }
+            break;
+         case 'b':
+            binary = optarg;
+            break;
+         case 'j':
+            workers = strtoul(optarg, NULL, 10);
+            break;
+         case 'k':
+            top = strtoul(optarg, NULL, 10);
+            break;
+         case 'n':
+            seeds = strtoul(optarg, NULL, 10);
+            break;
+         case 'o':
+            outPath = optarg;
+            break;
+         default:
+            fprintf(stderr, "usage: %s [-a grid] [-y grid] [-n seeds] [-j workers] [-b quad_sil]\n"
+                            "       [-o ranked.csv] [-k top]\n", argv[0]);
+            return 2;
+      }
+   }
+   if (binary.empty())
+   {
+      const char *slash = strrchr(argv[0], '/');
+
+      binary = (slash == NULL) ? std::string("./") : std::string(argv[0], slash - argv[0] + 1);
+      binary += "quad_sil";
+   }
+   if ((workers == 0) || (seeds == 0))
+   {
+      fprintf(stderr, "need at least one worker and one seed\n");
+      return 2;
+   }
+
+   ExpandGrid(attitudeGrid, attitudeGains);
+   ExpandGrid(yawGrid, yawGains);
+   for (const Gains &a : attitudeGains)
+   {
+      for (const Gains &y : yawGains)
+      {
+         candidates.push_back({ a, y });
+      }
+   }
+
+   // job j flies candidate j / seeds with seed j % seeds + 1
+   const size_t jobs = candidates.size() * seeds;
+   std::vector<WorkQueue> queues(workers);
+   std::vector<unsigned long> steals(workers, 0);
+   std::vector<std::thread> threads;
+   std::atomic<size_t> done(0);
+
+   results.resize(jobs);
+   for (size_t j = 0; j < jobs; j++)
+   {
+      queues[j % workers].Push(j);
+   }
+
+   printf("%zu candidates x %u seeds = %zu runs on %u workers\n", candidates.size(), seeds, jobs, workers);
+   const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+   for (unsigned int w = 0; w < workers; w++)
+   {
+      threads.emplace_back([&, w]()
+      {
+         size_t job;
+
+         for (;;)
+         {
+            bool found = queues[w].Pop(job);
+
+            // no jobs are added once running, so a full empty pass is the end
+            for (unsigned int v = 1; !found && (v < workers); v++)
+            {
+               found = queues[(w + v) % workers].Steal(job);
+               if (found)
+               {
+                  steals[w]++;
+               }
+            }
+            if (!found)
+            {
+               return;
+            }
+            results[job] = Run(binary, candidates[job / seeds], job % seeds + 1);
+            done++;
+         }
+      });
+   }
+   for (std::thread &t : threads)
+   {
+      t.join();
+   }
+
+   const double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+   unsigned long totalSteals = 0;
+
+   for (unsigned int w = 0; w < workers; w++)
+   {
+      totalSteals += steals[w];
+   }
+   printf("%zu runs in %.2f s wall, %.1f runs/s, %lu steals\n", done.load(), wallS, done / wallS, totalSteals);
+
+   for (size_t c = 0; c < candidates.size(); c++)
+   {
+      ranking.push_back(Aggregate(c, &results[c * seeds], seeds));
+   }
+   std::stable_sort(ranking.begin(), ranking.end(), Ranks);
+
+   if (outPath != NULL)
+   {
+      FILE *out = fopen(outPath, "w");
+
+      if (out == NULL)
+      {
+         perror(outPath);
+         return 2;
+      }
+      fputs(RANK_HEADER, out);
+      for (size_t r = 0; r < ranking.size(); r++)
+      {
+         PrintRow(out, r + 1, candidates[ranking[r].index], ranking[r]);
+      }
+      fclose(out);
+   }
+
+   fputs(RANK_HEADER, stdout);
+   for (size_t r = 0; (r < ranking.size()) && (r < top); r++)
+   {
+      PrintRow(stdout, r + 1, candidates[ranking[r].index], ranking[r]);
+   }
+
+   // every run failing to report means quad_sil could not be run
+   for (const RunResult &r : results)
+   {
+      if (r.valid)
+      {
+         return 0;
+      }
+   }
+   fprintf(stderr, "no run reported; is %s built?\n", binary.c_str());
+   return 1;
+}
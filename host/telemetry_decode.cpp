@@ -0,0 +1,541 @@
+// Decoder for the sketch's binary telemetry (Telemetry.h), read from its
+// serial port, a pty (quad_sil -e pty) or a capture file.
+//
+// Frames are found by their sync bytes and kept only if their CRC matches; a
+// bad frame is skipped a byte at a time, so a frame starting inside it is
+// still found. Bytes outside frames are the sketch's own text messages and
+// are passed to stderr a line at a time. Each message is printed as a CSV
+// line led by its name, and at the end of the stream (or on ^C) a summary
+// gives per message counts and rates, CRC failures and the frames lost,
+// from gaps in the sequence numbers.
+//
+// Log records (Log.h) carry only a site id and binary arguments; the format
+// string is looked up in the table log_strings extracted from the sources,
+// and the formatted text goes to stderr with the sketch's own text, led by
+// the record's time and level.
+//
+// usage: telemetry_decode [-b baud] [-l table] [-q] port|file
+//   -b  line rate when reading a serial port (default 115200)
+//   -l  log format table (make log-strings, build/log_strings.txt)
+//   -q  prints only the summary and the text
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "Telemetry.h"
+
+namespace
+{
+
+const unsigned long DEFAULT_BAUD = 115200;
+const size_t READ_BYTES = 4096;
+
+const char *const MESSAGE_NAMES[TELEMETRY_IDS] = { "unknown", "attitude", "rc", "motors", "status", "log",
+                                                   "raw" };
+
+struct MessageStats
+{
+   unsigned long count;
+   uint32_t firstUs;
+   uint32_t lastUs;
+};
+
+// A log site, from the table
+struct LogFormat
+{
+   std::string level;
+   std::string format;
+};
+
+volatile sig_atomic_t stop = 0;
+
+MessageStats messages[TELEMETRY_IDS];
+unsigned long frames = 0;
+unsigned long crcErrors = 0;
+unsigned long lost = 0;
+unsigned long textBytes = 0;
+bool haveSequence = false;
+uint8_t lastSequence = 0;
+std::string textLine;
+std::map<uint16_t, LogFormat> logTable;
+unsigned long logUntabled = 0;
+
+void Interrupt(int)
+{
+   stop = 1;
+}
+
+// Line rate constant for a baud rate, B0 if unsupported
+speed_t Speed(const unsigned long baud)
+{
+   switch (baud)
+   {
+      case 9600:    return B9600;
+      case 19200:   return B19200;
+      case 38400:   return B38400;
+      case 57600:   return B57600;
+      case 115200:  return B115200;
+      case 230400:  return B230400;
+      case 500000:  return B500000;
+      case 1000000: return B1000000;
+      default:      return B0;
+   }
+}
+
+// Passes a byte of the sketch's text on to stderr
+void Text(const uint8_t byte)
+{
+   textBytes++;
+   if (byte == '\n')
+   {
+      fprintf(stderr, "%s\n", textLine.c_str());
+      textLine.clear();
+   }
+   else if ((byte >= ' ') && (byte < 0x7F))
+   {
+      textLine += (char)byte;
+   }
+}
+
+// Undoes log_strings' escapes
+std::string Unescape(const std::string &s)
+{
+   std::string out;
+
+   for (size_t i = 0; i < s.size(); i++)
+   {
+      if ((s[i] != '\\') || (i + 1 == s.size()))
+      {
+         out += s[i];
+         continue;
+      }
+      switch (s[++i])
+      {
+         case 't': out += '\t'; break;
+         case 'n': out += '\n'; break;
+         default:  out += s[i]; break;
+      }
+   }
+   return out;
+}
+
+// Loads log_strings' table, false if it cannot be read
+bool LoadTable(const char *path)
+{
+   std::ifstream in(path);
+   std::string line;
+
+   if (!in)
+   {
+      return false;
+   }
+   while (std::getline(in, line))
+   {
+      const size_t level = line.find('\t');
+      const size_t where = line.find('\t', level + 1);
+      const size_t format = line.find('\t', where + 1);
+
+      if ((level == std::string::npos) || (where == std::string::npos) || (format == std::string::npos))
+      {
+         continue;
+      }
+      LogFormat &entry = logTable[(uint16_t)strtoul(line.c_str(), NULL, 16)];
+
+      entry.level = line.substr(level + 1, where - level - 1);
+      entry.format = Unescape(line.substr(format + 1));
+   }
+   return true;
+}
+
+// Reads a zig-zag varint argument, false if the record ends first
+bool ReadVarint(const uint8_t *args, const size_t length, size_t &pos, int32_t &value)
+{
+   uint32_t zigzag = 0;
+
+   for (int shift = 0; (pos < length) && (shift < 35); shift += 7)
+   {
+      const uint8_t byte = args[pos++];
+
+      zigzag |= (uint32_t)(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+      {
+         value = (int32_t)((zigzag >> 1) ^ -(zigzag & 1));
+         return true;
+      }
+   }
+   return false;
+}
+
+// Formats a log record's arguments with printf's conversions in format;
+// arguments the record lacks show as <?>
+std::string FormatLog(const std::string &format, const uint8_t *args, const size_t length)
+{
+   std::string out;
+   size_t pos = 0;
+
+   for (size_t i = 0; i < format.size(); i++)
+   {
+      const size_t end = format.find_first_of("diuxXocfeEgG%", i + 1);
+      std::string spec;
+      char text[64];
+
+      if ((format[i] != '%') || (end == std::string::npos))
+      {
+         out += format[i];
+         continue;
+      }
+      if (format[end] == '%')
+      {
+         out += '%';
+         i = end;
+         continue;
+      }
+      // flags, width and precision; the length is the decoder's to choose
+      for (size_t j = i; j < end; j++)
+      {
+         if ((format[j] != 'l') && (format[j] != 'h'))
+         {
+            spec += format[j];
+         }
+      }
+
+      const char conversion = format[end];
+
+      i = end;
+      if (strchr("feEgG", conversion) != NULL)
+      {
+         float value;
+
+         if (pos + sizeof(value) > length)
+         {
+            out += "<?>";
+            continue;
+         }
+         memcpy(&value, &args[pos], sizeof(value));
+         pos += sizeof(value);
+         snprintf(text, sizeof(text), (spec + conversion).c_str(), (double)value);
+      }
+      else
+      {
+         int32_t value;
+
+         if (!ReadVarint(args, length, pos, value))
+         {
+            out += "<?>";
+            continue;
+         }
+         if (conversion == 'c')
+         {
+            snprintf(text, sizeof(text), (spec + 'c').c_str(), (int)value);
+         }
+         else if ((conversion == 'd') || (conversion == 'i'))
+         {
+            snprintf(text, sizeof(text), (spec + 'l' + conversion).c_str(), (long)value);
+         }
+         else
+         {
+            snprintf(text, sizeof(text), (spec + 'l' + conversion).c_str(), (unsigned long)(uint32_t)value);
+         }
+      }
+      out += text;
+   }
+   return out;
+}
+
+// Passes a log record on to stderr as text
+void Log(const uint8_t *record, const uint8_t length)
+{
+   uint32_t timeUs;
+   uint16_t site;
+
+   memcpy(&timeUs, &record[0], sizeof(timeUs));
+   memcpy(&site, &record[4], sizeof(site));
+
+   const auto entry = logTable.find(site);
+
+   if (entry == logTable.end())
+   {
+      logUntabled++;
+      fprintf(stderr, "[%11.6f] ?     log site %04x, %u argument bytes\n", timeUs * 1e-6, site,
+              length - LOG_HEADER);
+      return;
+   }
+   fprintf(stderr, "[%11.6f] %-5s %s\n", timeUs * 1e-6, entry->second.level.c_str(),
+           FormatLog(entry->second.format, &record[LOG_HEADER], length - LOG_HEADER).c_str());
+}
+
+void Print(const uint8_t id, const uint8_t *payload)
+{
+   switch (id)
+   {
+      case TELEMETRY_ATTITUDE:
+      {
+         TelemetryAttitude m;
+
+         memcpy(&m, payload, sizeof(m));
+         printf("attitude,%u,%.1f,%.1f,%.1f,%d,%d,%d\n", m.timeUs, m.yaw * 0.1, m.pitch * 0.1, m.roll * 0.1,
+                m.yawRate, m.pitchRate, m.rollRate);
+         break;
+      }
+      case TELEMETRY_RC:
+      {
+         TelemetryRc m;
+
+         memcpy(&m, payload, sizeof(m));
+         printf("rc,%u,%.1f,%.1f,%.1f,%u,%u\n", m.timeUs, m.yaw * 0.1, m.pitch * 0.1, m.roll * 0.1,
+                m.throttle, m.arm);
+         break;
+      }
+      case TELEMETRY_MOTORS:
+      {
+         TelemetryMotors m;
+
+         memcpy(&m, payload, sizeof(m));
+         printf("motors,%u,%.1f,%.1f,%.1f,%u,%u,%u,%u\n", m.timeUs, m.yawPid * 0.1, m.pitchPid * 0.1,
+                m.rollPid * 0.1, m.motor[0], m.motor[1], m.motor[2], m.motor[3]);
+         break;
+      }
+      case TELEMETRY_STATUS:
+      {
+         TelemetryStatus m;
+
+         memcpy(&m, payload, sizeof(m));
+         printf("status,%u,%u,%u,%u,%u\n", m.timeUs, m.failsafe, m.failsafeCount, m.blackboxDropped,
+                m.telemetryDropped);
+         break;
+      }
+      case TELEMETRY_RAW_IMU:
+      {
+         TelemetryRawImu m;
+
+         memcpy(&m, payload, sizeof(m));
+         printf("raw,%u,%d,%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f\n", m.timeUs, m.accel[0], m.accel[1],
+                m.accel[2], m.gyro[0], m.gyro[1], m.gyro[2], m.quat[0], m.quat[1], m.quat[2], m.quat[3]);
+         break;
+      }
+   }
+}
+
+// Payload size of a known id, 0 if unknown
+uint8_t PayloadSize(const uint8_t id)
+{
+   switch (id)
+   {
+      case TELEMETRY_ATTITUDE: return sizeof(TelemetryAttitude);
+      case TELEMETRY_RC:       return sizeof(TelemetryRc);
+      case TELEMETRY_MOTORS:   return sizeof(TelemetryMotors);
+      case TELEMETRY_STATUS:   return sizeof(TelemetryStatus);
+      case TELEMETRY_RAW_IMU:  return sizeof(TelemetryRawImu);
+      default:                 return 0;
+   }
+}
+
+// True if length suits id; log records vary
+bool PayloadFits(const uint8_t id, const uint8_t length)
+{
+   if (id == TELEMETRY_LOG)
+   {
+      return length >= LOG_HEADER;
+   }
+   return (PayloadSize(id) != 0) && (PayloadSize(id) == length);
+}
+
+// Takes the frames (and text) off the front of pending, leaving a frame
+// that is not yet whole
+void Parse(std::vector<uint8_t> &pending, const bool quiet)
+{
+   size_t pos = 0;
+
+   while (pos < pending.size())
+   {
+      const uint8_t *p = &pending[pos];
+      const size_t left = pending.size() - pos;
+      uint8_t crc = 0;
+
+      if ((p[0] != TELEMETRY_SYNC1) || ((left > 1) && (p[1] != TELEMETRY_SYNC2)))
+      {
+         Text(p[0]);
+         pos++;
+         continue;
+      }
+      if ((left < TELEMETRY_HEADER) || ((p[4] <= TELEMETRY_MAX_PAYLOAD) && (left < TELEMETRY_HEADER + p[4] + 1U)))
+      {
+         // wait for the rest
+         break;
+      }
+
+      const uint8_t length = p[4];
+
+      for (uint8_t i = 2; (length <= TELEMETRY_MAX_PAYLOAD) && (i < TELEMETRY_HEADER + length); i++)
+      {
+         crc = TelemetryCrc(crc, p[i]);
+      }
+      if ((length > TELEMETRY_MAX_PAYLOAD) || (crc != p[TELEMETRY_HEADER + length]))
+      {
+         // not a frame after all, or a damaged one
+         crcErrors++;
+         Text(p[0]);
+         pos++;
+         continue;
+      }
+
+      const uint8_t sequence = p[2];
+      const uint8_t id = PayloadFits(p[3], length) ? p[3] : 0;
+      MessageStats &stats = messages[id];
+
+      frames++;
+      if (haveSequence)
+      {
+         lost += (uint8_t)(sequence - lastSequence - 1);
+      }
+      haveSequence = true;
+      lastSequence = sequence;
+
+      if (id != 0)
+      {
+         uint32_t timeUs;
+
+         // every payload leads with its time
+         memcpy(&timeUs, &p[TELEMETRY_HEADER], sizeof(timeUs));
+         if (stats.count == 0)
+         {
+            stats.firstUs = timeUs;
+         }
+         stats.lastUs = timeUs;
+         if (id == TELEMETRY_LOG)
+         {
+            Log(&p[TELEMETRY_HEADER], length);
+         }
+         else if (!quiet)
+         {
+            Print(id, &p[TELEMETRY_HEADER]);
+         }
+      }
+      stats.count++;
+      pos += TELEMETRY_HEADER + length + 1;
+   }
+   pending.erase(pending.begin(), pending.begin() + pos);
+}
+
+void Summary()
+{
+   fflush(stdout);
+   fprintf(stderr, "message,count,rate_hz\n");
+   for (int id = 1; id < TELEMETRY_IDS; id++)
+   {
+      const MessageStats &stats = messages[id];
+      const double span = (uint32_t)(stats.lastUs - stats.firstUs) * 1e-6;
+
+      fprintf(stderr, "%s,%lu,%.1f\n", MESSAGE_NAMES[id], stats.count,
+              ((stats.count > 1) && (span > 0)) ? (stats.count - 1) / span : 0.0);
+   }
+   fprintf(stderr, "%lu frames, %lu unknown, %lu lost, %lu CRC errors, %lu text bytes, "
+           "%lu log records not in the table\n",
+           frames, messages[0].count, lost, crcErrors, textBytes, logUntabled);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   unsigned long baud = DEFAULT_BAUD;
+   bool quiet = false;
+   std::vector<uint8_t> pending;
+   uint8_t buffer[READ_BYTES];
+   int fd;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "b:l:q")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b':
+            baud = strtoul(optarg, NULL, 10);
+            break;
+         case 'l':
+            if (!LoadTable(optarg))
+            {
+               perror(optarg);
+               return 2;
+            }
+            break;
+         case 'q':
+            quiet = true;
+            break;
+         default:
+            optind = argc;
+            break;
+      }
+   }
+   if (optind != argc - 1)
+   {
+      fprintf(stderr, "usage: %s [-b baud] [-l table] [-q] port|file\n", argv[0]);
+      return 2;
+   }
+
+   fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+   if (fd < 0)
+   {
+      perror(argv[optind]);
+      return 2;
+   }
+   if (isatty(fd))
+   {
+      struct termios tty;
+
+      if ((tcgetattr(fd, &tty) != 0) || (Speed(baud) == B0))
+      {
+         fprintf(stderr, "%s: cannot set %lu baud\n", argv[optind], baud);
+         return 2;
+      }
+      cfmakeraw(&tty);
+      cfsetspeed(&tty, Speed(baud));
+      tcsetattr(fd, TCSANOW, &tty);
+   }
+
+   // reads are interrupted, not restarted, so ^C ends the stream
+   struct sigaction action;
+
+   memset(&action, 0, sizeof(action));
+   action.sa_handler = Interrupt;
+   sigaction(SIGINT, &action, NULL);
+   sigaction(SIGTERM, &action, NULL);
+
+   memset(messages, 0, sizeof(messages));
+   while (!stop)
+   {
+      const ssize_t n = read(fd, buffer, sizeof(buffer));
+
+      if (n < 0)
+      {
+         // a pty whose writer has gone reads EIO
+         if ((errno != EINTR) && (errno != EIO))
+         {
+            perror(argv[optind]);
+         }
+         break;
+      }
+      if (n == 0)
+      {
+         break;
+      }
+      pending.insert(pending.end(), buffer, buffer + n);
+      Parse(pending, quiet);
+   }
+   close(fd);
+
+   Summary();
+   return 0;
+}
@@ -0,0 +1,163 @@
+#include <cstring>
+
+#include "twi_model.h"
+
+TwiControl TWCR = { 0 };
+uint8_t TWSR = 0xF8;
+uint8_t TWDR = 0;
+uint8_t TWBR = 0;
+uint8_t PORTC = 0;
+uint8_t PORTD = 0;
+
+namespace
+{
+
+// TWI status codes (see <util/twi.h>)
+const uint8_t TW_START       = 0x08;
+const uint8_t TW_REP_START   = 0x10;
+const uint8_t TW_MT_SLA_ACK  = 0x18;
+const uint8_t TW_MT_SLA_NACK = 0x20;
+const uint8_t TW_MT_DATA_ACK = 0x28;
+const uint8_t TW_MR_SLA_ACK  = 0x40;
+const uint8_t TW_MR_SLA_NACK = 0x48;
+const uint8_t TW_MR_DATA_ACK = 0x50;
+const uint8_t TW_MR_DATA_NACK = 0x58;
+const uint8_t TW_NO_INFO     = 0xF8;
+
+enum Phase
+{
+   IDLE,      // no START on the bus
+   ADDRESS,   // START sent, next TWDR is the address
+   POINTER,   // addressed for write, next TWDR is the register pointer
+   WRITE,     // writing data
+   READ       // reading data
+};
+
+uint8_t slave;
+uint8_t registers[256];
+uint8_t pointer;
+Phase phase = IDLE;
+bool busOwned = false;
+uint8_t readIndex;
+
+bool faultArmed = false;
+uint8_t faultIndex;
+uint8_t faultStatus;
+
+void Step(const uint8_t control)
+{
+   if (control & (1 << TWSTA))
+   {
+      TWSR = busOwned ? TW_REP_START : TW_START;
+      busOwned = true;
+      phase = ADDRESS;
+      return;
+   }
+   if (control & (1 << TWSTO))
+   {
+      TWSR = TW_NO_INFO;
+      busOwned = false;
+      phase = IDLE;
+      return;
+   }
+
+   switch (phase)
+   {
+      case ADDRESS:
+         if ((TWDR >> 1) != slave)
+         {
+            TWSR = (TWDR & 1) ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+            phase = IDLE;
+         }
+         else if (TWDR & 1)
+         {
+            TWSR = TW_MR_SLA_ACK;
+            phase = READ;
+            readIndex = 0;
+         }
+         else
+         {
+            TWSR = TW_MT_SLA_ACK;
+            phase = POINTER;
+         }
+         break;
+      case POINTER:
+         pointer = TWDR;
+         TWSR = TW_MT_DATA_ACK;
+         phase = WRITE;
+         break;
+      case WRITE:
+         registers[pointer++] = TWDR;
+         TWSR = TW_MT_DATA_ACK;
+         break;
+      case READ:
+         if (faultArmed && (readIndex == faultIndex))
+         {
+            faultArmed = false;
+            TWDR = 0xFF;
+            TWSR = faultStatus;
+            phase = IDLE;
+            break;
+         }
+         TWDR = registers[pointer++];
+         TWSR = (control & (1 << TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+         readIndex++;
+         break;
+      default:
+         TWSR = TW_NO_INFO;
+         break;
+   }
+}
+
+}
+
+TwiControl &TwiControl::operator=(const uint8_t value)
+{
+   mValue = value & ~(1 << TWINT);
+   if (!(value & (1 << TWEN)))
+   {
+      // module off: pins go back to the port
+      busOwned = false;
+      phase = IDLE;
+      return *this;
+   }
+   if (value & (1 << TWINT))
+   {
+      Step(value);
+      // the part gives no interrupt for a STOP
+      if (!(value & (1 << TWSTO)) || (value & (1 << TWSTA)))
+      {
+         mValue |= (1 << TWINT);
+      }
+   }
+   return *this;
+}
+
+namespace TwiModel
+{
+
+void Reset(const uint8_t devAddr)
+{
+   slave = devAddr;
+   memset(registers, 0, sizeof(registers));
+   pointer = 0;
+   phase = IDLE;
+   busOwned = false;
+   faultArmed = false;
+   TWCR.mValue = 0;
+   TWSR = TW_NO_INFO;
+}
+
+uint8_t *Registers()
+{
+   return registers;
+}
+
+void FailReadByte(const uint8_t index, const uint8_t status)
+{
+   faultArmed = true;
+   faultIndex = index;
+   faultStatus = status;
+}
+
+}
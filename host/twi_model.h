@@ -0,0 +1,71 @@
+// Host model of the ATmega TWI (hardware I2C) peripheral.
+//
+// Lets the Fastwire build of I2Cdev run on the host: TWCR, TWSR, TWDR and
+// TWBR are globals, and a write to TWCR with TWINT set runs the requested
+// bus step at once against a register file slave, leaving the TWI status in
+// TWSR and TWINT set again (a STOP alone leaves TWINT clear, as the part
+// does). The slave auto-increments its register pointer on each data byte.
+//
+// A fault can be armed to replace the status of one data byte of a read,
+// e.g. TW_BUS_ERROR (0x00) on an illegal START or STOP mid-transfer.
+//
+// Force-include this header (-include twi_model.h) when compiling I2Cdev.cpp
+// with ARDUINO defined; on the part these come from <avr/io.h>.
+
+#ifndef HOST_TWI_MODEL_H
+#define HOST_TWI_MODEL_H
+
+#include <stdint.h>
+
+// TWCR bits
+#define TWINT 7
+#define TWEA  6
+#define TWSTA 5
+#define TWSTO 4
+#define TWEN  2
+
+// ATmega2560 TWI pins
+#define SDA 20
+#define SCL 21
+
+#define TW_BUS_ERROR 0x00
+
+// writes run a bus step, reads give the last value written (or TWINT set)
+class TwiControl
+{
+ public:
+   TwiControl &operator=(const uint8_t value);
+   operator uint8_t() const { return mValue; }
+
+   uint8_t mValue;
+};
+
+extern TwiControl TWCR;
+extern uint8_t TWSR;
+extern uint8_t TWDR;
+extern uint8_t TWBR;
+extern uint8_t PORTC;
+extern uint8_t PORTD;
+
+namespace TwiModel
+{
+
+/*
+ * Puts the bus idle and the slave at 7-bit address devAddr, registers zeroed.
+ */
+void Reset(const uint8_t devAddr);
+
+/*
+ * The slave's register file.
+ */
+uint8_t *Registers();
+
+/*
+ * Reports status instead of the data ack/nack of byte index of the next
+ * read (index 0 is the first byte); the byte read is 0xFF.
+ */
+void FailReadByte(const uint8_t index, const uint8_t status);
+
+}
+
+#endif /* HOST_TWI_MODEL_H */
@@ -30,7 +30,7 @@ void ServoMotor::SetupMotor()
 }
 
 MotorSet::MotorSet() :
-   mMotors(
+   mMotors
    {
       // corresponds to motor inputs 1-4 in order
       // front right CCW
@@ -42,7 +42,7 @@ MotorSet::MotorSet() :
       ServoMotor(MOTOR_2_PIN, 0,  -1, -1,   1, 1),
       ServoMotor(MOTOR_3_PIN, 0,   1, -1,  -1, 1),
       ServoMotor(MOTOR_4_PIN, 0,  -1,  1,  -1, 1)
-   })
+   }
 {
 }
 
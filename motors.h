@@ -33,6 +33,7 @@ class ServoMotor
    
    void SetupMotor();               // Attach and bound Servo motor
    void SetSpeed(const int pwm);    // Set the speed of a motor in degrees (0-180)
+   inline int GetSpeed()            { return mServo.read(); }  // speed last set, as limited by the servo
    
    inline unsigned int GetPin()  const { return mPin; }
    inline int GetError()         const { return mError; }
@@ -67,6 +68,9 @@ class MotorSet
    // Control the motors pased on channel parameters
    // Yaw pitch and roll are PID values, throttle is % 
    void controlMotors(const int yaw, const int pitch, const int roll, const int throttle);
+
+   // Speed last output to motor 0 to MOTORS_NUM - 1 (degrees)
+   inline int getSpeed(const int motor) { return mMotors[motor].GetSpeed(); }
    
  private:
    void calibrateMotors(); // Calibrate all the motors 
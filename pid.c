@@ -3,6 +3,31 @@
 
 #include "pid.h"
 
+#if (PID_TUNABLE == 1)
+PidGains pidPitchGains = { PITCH_KP, PITCH_KI, PITCH_KD };
+PidGains pidRollGains  = { ROLL_KP,  ROLL_KI,  ROLL_KD };
+PidGains pidYawGains   = { YAW_KP,   YAW_KI,   YAW_KD };
+
+#undef PITCH_KP
+#undef PITCH_KI
+#undef PITCH_KD
+#undef ROLL_KP
+#undef ROLL_KI
+#undef ROLL_KD
+#undef YAW_KP
+#undef YAW_KI
+#undef YAW_KD
+#define PITCH_KP pidPitchGains.kp
+#define PITCH_KI pidPitchGains.ki
+#define PITCH_KD pidPitchGains.kd
+#define ROLL_KP  pidRollGains.kp
+#define ROLL_KI  pidRollGains.ki
+#define ROLL_KD  pidRollGains.kd
+#define YAW_KP   pidYawGains.kp
+#define YAW_KI   pidYawGains.ki
+#define YAW_KD   pidYawGains.kd
+#endif
+
 float pidPitch(float cmd, 
                float actual)
 {
@@ -16,7 +41,7 @@ float pidPitch(float cmd,
   error = cmd - actual;
 
   /* don't integrate if error is small */
-  if (abs(error) > epsilon)
+  if (fabs(error) > epsilon)
   {
     /* integral */
     errorInt = errorInt + dt * error;
@@ -26,7 +51,7 @@ float pidPitch(float cmd,
   derivative = ((float)(error - errorDerivative))/dt;
 
   /* calculate output */
-  output = PITCH_KP * error + PITCH_KI * errorInt - PITCH_KD * derivative;
+  output = PITCH_KP * error + PITCH_KI * errorInt + PITCH_KD * derivative;
 
   /* clamp the output */
   if (output > PITCH_UPPER_LIMIT)
@@ -65,7 +90,7 @@ float pidRoll(float cmd,
   error = cmd - actual;
 
   /* don't integrate if error is small */
-  if (abs(error) > epsilon)
+  if (fabs(error) > epsilon)
   {
     /* integral */
     errorInt = errorInt + dt * error;
@@ -75,7 +100,7 @@ float pidRoll(float cmd,
   derivative = ((float)(error - errorDerivative))/dt;
 
   /* calculate output */
-  output = ROLL_KP * error + ROLL_KI * errorInt - ROLL_KD * derivative;
+  output = ROLL_KP * error + ROLL_KI * errorInt + ROLL_KD * derivative;
 
   /* clamp the output */
   if (output > ROLL_UPPER_LIMIT)
@@ -110,11 +135,11 @@ float pidYaw(float cmd,
   float        error           = 0.0;
   float        output          = 0.0;
 
-  /* calculate error */
-  error = fmod((cmd - actual) + M_PI, 2 * M_PI) - M_PI;
+  /* calculate error, wrapped to +-180 degrees */
+  error = fmod((cmd - actual) + 540.0, 360.0) - 180.0;
 
   /* don't integrate if error is small */
-  if (abs(error) > epsilon)
+  if (fabs(error) > epsilon)
   {
     /* integral */
     errorInt = errorInt + dt * error;
@@ -124,7 +149,7 @@ float pidYaw(float cmd,
   derivative = ((float)(error - errorDerivative))/dt;
 
   /* calculate output */
-  output = YAW_KP * error + YAW_KI * errorInt - YAW_KD * derivative;
+  output = YAW_KP * error + YAW_KI * errorInt + YAW_KD * derivative;
 
   /* clamp the output */
   if (output > YAW_UPPER_LIMIT)
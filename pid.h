@@ -4,7 +4,7 @@
 #define epsilon 0.01 /* error limit */
 #define dt      0.01 /* sampling time in seconds */
 
-/* UNITS ARE IN RADIANS */
+/* UNITS ARE IN DEGREES */
 /* gains - TUNE ME */
 #define PITCH_KP           0.1
 #define PITCH_KI           0
@@ -24,6 +24,25 @@
 #define YAW_UPPER_LIMIT    45
 #define YAW_LOWER_LIMIT   -45
 
+/* set to 1 to make the gains variables, so host simulations can tune them
+   at run time; the values above are their initial values */
+#ifndef PID_TUNABLE
+#define PID_TUNABLE 0
+#endif
+
+#if (PID_TUNABLE == 1)
+typedef struct
+{
+  float kp;
+  float ki;
+  float kd;
+} PidGains;
+
+extern PidGains pidPitchGains;
+extern PidGains pidRollGains;
+extern PidGains pidYawGains;
+#endif
+
 /**
  * Outputs the new adjusted pitch command based on current
  * command and IMU reading.
@@ -36,7 +36,7 @@
  * Timer 2     9, 10       8-bit
  * Timer 3     2, 3, 5     16-bit
  * Timer 4     6, 7, 8     16-bit
- * Timer 5     44, 45, 46  16-bit Servo library (up to 12 servos)
+ * Timer 5     44, 45, 46  16-bit Servo library (up to 12 servos), LoopProfile clock
  */
  
 #endif
\ No newline at end of file
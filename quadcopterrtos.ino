@@ -6,10 +6,27 @@ extern "C"
 #include "motors.h"
 #include "IMU.h"
 #include "Receiver.h"
+#include "Blackbox.h"
+#include "Telemetry.h"
+#include "Log.h"
+#include "LoopProfile.h"
 
-#define PRINT_DEBUG 0
 #define MOTOR_DEBUG 0
 
+// Set to 1 to run the control chain (IMU read, PID, motor output) once per new
+// IMU sample, with the receiver read in the slack between samples. The PID
+// dt in pid.h must match the IMU sample rate. Set to 0 to poll every loop.
+#ifndef EVENT_LOOP
+#define EVENT_LOOP 0
+#endif
+
+// Longest wait for an IMU sample before EVENT_LOOP runs the control chain
+// anyway (us), so disarm and failsafe still reach the motors if samples stop
+const unsigned long SAMPLE_TIMEOUT_US = 25000;
+
+// Period of the I2C transaction profile dump when I2Cdev.h has I2CDEV_PROFILE
+const unsigned long I2C_PROFILE_PERIOD_MS = 5000;
+
 const int ARM_PERCENT = 50; // Channel percent to arm quadcopter for flying. Error is 0.
 
 // IMU class
@@ -21,56 +38,138 @@ Receiver receiver;
 // Motors set class
 MotorSet motors;
 
+#if (BLACKBOX == 1)
+// Flight recorder
+Blackbox blackbox;
+#endif
+
+// Ground station link, which also carries the log
+Telemetry telemetry;
+
 /* commands */
 static int arm           = 0;
 static int throttleCmd   = 0;
-static int yawCmd        = 0;
-static int pitchCmd      = 0;
-static int rollCmd       = 0;
+static float yawCmd      = 0.0;
+static float pitchCmd    = 0.0;
+static float rollCmd     = 0.0;
 
 static float newYawCmd   = 0.0;
 static float newPitchCmd = 0.0;
 static float newRollCmd  = 0.0;
 
+/* motors were last turned off for want of arming */
+static bool disarmed     = false;
+
 /* IMU readings */
 static float yawDeg      = 0.0;
 static float pitchDeg    = 0.0;
 static float rollDeg     = 0.0;
 
-void imuThread(void)
+/* IMU body rates - in degrees/second */
+static float yawRate     = 0.0;
+static float pitchRate   = 0.0;
+static float rollRate    = 0.0;
+
+/* time the IMU sample behind the readings was taken - in microseconds */
+static unsigned long imuTime = 0;
+
+#if (IMU_LOG_RAW == 1)
+static_assert(sizeof(TelemetryRawImu) <= TELEMETRY_MAX_PAYLOAD, "raw samples must fit a telemetry frame");
+
+/* sends the raw sample behind a new DMP reading for offline filter comparison */
+void sendRawImu(void)
 {
-   /* read IMU for each channel - in degrees */
-   imu.ReadIMU(yawDeg, pitchDeg, rollDeg);
-   
-   printYPRT(1, "YPRT IMU Val: ", yawDeg, pitchDeg, rollDeg, throttleCmd);
+   ImuRawSample raw;
+   TelemetryRawImu m;
+
+   if (!imu.TakeRawSample(raw))
+   {
+      return;
+   }
+
+   m.timeUs = raw.time;
+   for (uint8_t i = 0; i < 3; i++)
+   {
+      m.accel[i] = raw.accel[i];
+      m.gyro[i] = raw.gyro[i];
+   }
+   for (uint8_t i = 0; i < 4; i++)
+   {
+      m.quat[i] = raw.quat[i];
+   }
+   telemetry.Send(TELEMETRY_RAW_IMU, &m, sizeof(m));
 }
+#endif
 
-// Quadcopter state machine (main loop)
-void quadThread(void)
+/* returns true when the readings come from a new IMU sample */
+bool imuThread(void)
+{
+   bool updated;
+   LOOP_TIMER(PROBE_IMU);
+
+   /* read IMU for each channel - in degrees and degrees/second */
+   updated = imu.ReadIMU(yawDeg, pitchDeg, rollDeg, yawRate, pitchRate, rollRate, imuTime);
+
+#if (IMU_LOG_RAW == 1)
+   sendRawImu();
+#endif
+
+   return updated;
+}
+
+void receiverThread(void)
 {
 #if MOTOR_DEBUG == 0
+   LOOP_TIMER(PROBE_RECEIVER);
+
    /* read receiver */
    receiver.ReadReceiver(yawCmd, pitchCmd, rollCmd, throttleCmd, arm);
-   
-   printYPRT(1, "YPRT Rec CMD: ", yawCmd, pitchCmd, rollCmd, throttleCmd);
+#endif
+}
+
+// Quadcopter state machine (main loop)
+void quadThread(void)
+{
+#if MOTOR_DEBUG == 0
+   /* without a trustworthy attitude, disarm as for a lost receiver link */
+   if (imu.GetStatus().sensorLost || imu.GetStatus().recoveryFailed)
+   {
+      receiver.ForceDisarm();
+      arm = 0;
+   }
 
    /* quadcopter must be armed to fly */
    if (arm > ARM_PERCENT)
    {
-      /* adjust command using PID - in degrees */
-      newYawCmd   = pidYaw(yawCmd,     yawDeg);
-      newPitchCmd = pidPitch(pitchCmd, pitchDeg);
-      newRollCmd  = pidRoll(rollCmd,   rollDeg);
+      disarmed = false;
 
-      printYPRT(1, "YPRT PID CMD: ", newYawCmd, newPitchCmd, newRollCmd, throttleCmd);
+      /* adjust command using PID - in degrees */
+      {
+         LOOP_TIMER(PROBE_PID_YAW);
+         newYawCmd   = pidYaw(yawCmd,     yawDeg);
+      }
+      {
+         LOOP_TIMER(PROBE_PID_PITCH);
+         newPitchCmd = pidPitch(pitchCmd, pitchDeg);
+      }
+      {
+         LOOP_TIMER(PROBE_PID_ROLL);
+         newRollCmd  = pidRoll(rollCmd,   rollDeg);
+      }
 
       /* output to motors - in microseconds */
-      motors.controlMotors(yawCmd, pitchCmd, rollCmd, throttleCmd);
+      LOOP_TIMER(PROBE_MOTORS);
+      motors.controlMotors(newYawCmd, newPitchCmd, newRollCmd, throttleCmd);
    }
    else
    {
-      /* turn off motors */
-      Serial.println(F("Disarming motors"));
+      /* turn off motors - said once, not every pass */
+      if (!disarmed)
+      {
+         LOG_INFO("Disarming motors");
+         disarmed = true;
+      }
+      LOOP_TIMER(PROBE_MOTORS);
       motors.controlMotors(BASE_VAL_DEG, BASE_VAL_DEG, BASE_VAL_DEG, MIN_THROTTLE_DEG);
    }
 #else
@@ -85,60 +184,229 @@ void quadThread(void)
 #endif
 }
 
+#if (BLACKBOX == 1)
+// Logs the control pass that just ran - angles in tenths of a degree
+void blackboxThread(void)
+{
+   static unsigned long iteration = 0;
+   static unsigned long lastPass = 0;
+   const unsigned long now = micros();
+   int32_t fields[BB_FIELDS];
+
+   fields[BB_ITERATION]  = iteration++;
+   fields[BB_TIME_US]    = now;
+   fields[BB_LOOP_US]    = now - lastPass;
+   fields[BB_YAW_CMD]    = yawCmd * 10.0;
+   fields[BB_PITCH_CMD]  = pitchCmd * 10.0;
+   fields[BB_ROLL_CMD]   = rollCmd * 10.0;
+   fields[BB_THROTTLE]   = throttleCmd;
+   fields[BB_ARM]        = arm;
+   fields[BB_YAW]        = yawDeg * 10.0;
+   fields[BB_PITCH]      = pitchDeg * 10.0;
+   fields[BB_ROLL]       = rollDeg * 10.0;
+   fields[BB_YAW_RATE]   = yawRate;
+   fields[BB_PITCH_RATE] = pitchRate;
+   fields[BB_ROLL_RATE]  = rollRate;
+   fields[BB_YAW_PID]    = newYawCmd * 10.0;
+   fields[BB_PITCH_PID]  = newPitchCmd * 10.0;
+   fields[BB_ROLL_PID]   = newRollCmd * 10.0;
+   for (int i = 0; i < MOTORS_NUM; i++)
+   {
+      fields[BB_MOTOR_1 + i] = motors.getSpeed(i);
+   }
+   fields[BB_FAILSAFE]   = receiver.GetStatus().state;
+   lastPass = now;
+
+   blackbox.Log(fields);
+}
+#endif
+
+#if (TELEMETRY == 1)
+// Queues the telemetry messages that are due - angles in tenths of a degree
+void telemetryThread(void)
+{
+   const unsigned long now = millis();
+
+   if (telemetry.Due(TELEMETRY_ATTITUDE, now))
+   {
+      TelemetryAttitude attitude;
+
+      attitude.timeUs    = imuTime;
+      attitude.yaw       = yawDeg * 10.0;
+      attitude.pitch     = pitchDeg * 10.0;
+      attitude.roll      = rollDeg * 10.0;
+      attitude.yawRate   = yawRate;
+      attitude.pitchRate = pitchRate;
+      attitude.rollRate  = rollRate;
+      telemetry.Send(TELEMETRY_ATTITUDE, &attitude, sizeof(attitude));
+   }
+
+   if (telemetry.Due(TELEMETRY_RC, now))
+   {
+      TelemetryRc rc;
+
+      rc.timeUs   = micros();
+      rc.yaw      = yawCmd * 10.0;
+      rc.pitch    = pitchCmd * 10.0;
+      rc.roll     = rollCmd * 10.0;
+      rc.throttle = throttleCmd;
+      rc.arm      = arm;
+      telemetry.Send(TELEMETRY_RC, &rc, sizeof(rc));
+   }
+
+   if (telemetry.Due(TELEMETRY_MOTORS, now))
+   {
+      TelemetryMotors out;
+
+      out.timeUs   = micros();
+      out.yawPid   = newYawCmd * 10.0;
+      out.pitchPid = newPitchCmd * 10.0;
+      out.rollPid  = newRollCmd * 10.0;
+      for (int i = 0; i < MOTORS_NUM; i++)
+      {
+         out.motor[i] = motors.getSpeed(i);
+      }
+      telemetry.Send(TELEMETRY_MOTORS, &out, sizeof(out));
+   }
+
+   if (telemetry.Due(TELEMETRY_STATUS, now))
+   {
+      TelemetryStatus status;
+
+      status.timeUs           = micros();
+      status.failsafe         = receiver.GetStatus().state;
+      status.failsafeCount    = receiver.GetStatus().failsafeCount;
+#if (BLACKBOX == 1)
+      status.blackboxDropped  = blackbox.GetStatus().dropped;
+#else
+      status.blackboxDropped  = 0;
+#endif
+      status.telemetryDropped = telemetry.GetDropped();
+      telemetry.Send(TELEMETRY_STATUS, &status, sizeof(status));
+   }
+}
+#endif
+
+static_assert(LOG_MAX_RECORD <= TELEMETRY_MAX_PAYLOAD, "log records must fit a telemetry frame");
+
+// Frames each log record for the ground station
+void logSink(const uint8_t *record, const uint8_t length)
+{
+   telemetry.Send(TELEMETRY_LOG, record, length);
+}
+
+#if (I2CDEV_PROFILE == 1)
+// Prints and restarts the I2C transaction profile every I2C_PROFILE_PERIOD_MS,
+// once no telemetry frame is part way out on the port
+void profileThread(void)
+{
+   static unsigned long lastDump = 0;
+
+   if ((millis() - lastDump >= I2C_PROFILE_PERIOD_MS) && telemetry.Idle())
+   {
+      I2Cdev::profileDump();
+      I2Cdev::profileReset();
+      lastDump = millis();
+   }
+}
+#endif
+
+#if (LOOP_PROFILE == 1)
+// Prints and restarts the task timings every LOOP_PROFILE_PERIOD_MS, outside
+// the loop pass being timed and once no telemetry frame is part way out
+void loopProfileThread(void)
+{
+   static unsigned long lastDump = 0;
+
+   if ((millis() - lastDump >= LOOP_PROFILE_PERIOD_MS) && telemetry.Idle())
+   {
+      loopProfile.Dump(Serial);
+      loopProfile.Reset();
+      lastDump = millis();
+   }
+}
+#endif
+
 // Initialize Quadcopter 
 void setup()
 {
    Serial.begin(115200);
    //Serial2.begin(115200);
 
+   // from here on log records queue until the loop sends them
+   LogSetSink(logSink);
+
    // Initialize motors
    motors.setupMotors();
 
    // Initialize IMU
    imu.SetupIMU();
+
+#if (I2CDEV_PROFILE == 1)
+   // bring-up traffic, then steady state from here on
+   I2Cdev::profileDump();
+   I2Cdev::profileReset();
+#endif
    
    // Set up receiver PWM interrupts
    receiver.SetupReceiver();
+
+#if (BLACKBOX == 1)
+   blackbox.Begin();
+#endif
+
+#if (LOOP_PROFILE == 1)
+   loopProfile.Begin();
+#endif
 }
 
-// Outputs yaw, pitch, roll, and throttle via serial.
-void printYPRT(const int port, const char * const str, const float yaw, const float pitch, const float roll, const int throttle)
+void loop()
 {
-#if (PRINT_DEBUG == 1)
-   if(port == 2)
+#if (LOOP_PROFILE == 1)
+   loopProfileThread();
+#endif
+   LOOP_TIMER(PROBE_LOOP);
+
+#if (EVENT_LOOP == 1)
+   static unsigned long lastPass = 0;
+
+   /* a new sample runs the whole chain straight away, everything else
+      waits for the slack before the next one; with no sample for too long
+      the chain runs on the last readings */
+   if (imuThread() || (micros() - lastPass > SAMPLE_TIMEOUT_US))
    {
-      Serial2.print(yaw);
-      Serial2.print(",");
-      Serial2.print(pitch);
-      Serial2.print(",");
-      Serial2.print(roll);
-      Serial2.print(",   ");
-      Serial2.println(throttle);
+      lastPass = micros();
+      quadThread();
+#if (BLACKBOX == 1)
+      blackboxThread();
+#endif
    }
-   else
+   else if (!imu.DataReady())
    {
-      Serial.print(str);
-      Serial.print(yaw);
-      Serial.print(",");
-      Serial.print(pitch);
-      Serial.print(",");
-      Serial.print(roll);
-      Serial.print(",   ");
-      Serial.println(throttle);
+      receiverThread();
    }
 #else
-   (void)str;
-   (void)yaw;
-   (void)pitch;
-   (void)roll;
-   (void)throttle;
-#endif
-   (void) port;
-}
-
-void loop()
-{
+   receiverThread();
    quadThread();
    imuThread();
-   SoftwareServo::refresh();
+#if (BLACKBOX == 1)
+   blackboxThread();
+#endif
+#endif
+#if (BLACKBOX == 1)
+   /* drain whatever the sink takes without waiting, every loop */
+   blackbox.Service();
+#endif
+#if (TELEMETRY == 1)
+   telemetryThread();
+#endif
+   /* hand the port what it takes without waiting */
+   telemetry.Service();
+#if (I2CDEV_PROFILE == 1)
+   profileThread();
+#endif
+   {
+      LOOP_TIMER(PROBE_SERVO_REFRESH);
+      SoftwareServo::refresh();
+   }
 }
\ No newline at end of file